@@ -0,0 +1,206 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <cerrno>
+#include <cstring>
+
+#include <mutex>
+#include <vector>
+
+#ifdef WIN32
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#include <centralised_log.h>
+
+#include "asset_archive.h"
+
+namespace {
+
+    struct MountedArchive {
+        std::string filename;
+        const uint8_t *base;
+        size_t size;
+        const AssetArchiveSlot *slots;
+        uint32_t numSlots;
+        const char *names;
+        size_t namesLength;
+        #ifdef WIN32
+        HANDLE file, mapping;
+        #endif
+
+        bool find (const std::string &name, uint64_t hash, AssetView &view) const
+        {
+            const uint32_t mask = numSlots - 1;
+            for (uint32_t i=hash & mask ; ; i = (i + 1) & mask) {
+                const AssetArchiveSlot &slot = slots[i];
+                if (slot.nameLength == 0) return false;
+                if (slot.hash != hash || slot.nameLength != name.length()) continue;
+                // Bounds were checked at mount time.
+                if (memcmp(names + slot.nameOffset, name.data(), name.length()) != 0) continue;
+                view.data = base + slot.offset;
+                view.length = slot.length;
+                return true;
+            }
+        }
+
+        void unmap (void)
+        {
+            #ifdef WIN32
+            UnmapViewOfFile(base);
+            CloseHandle(mapping);
+            CloseHandle(file);
+            #else
+            munmap(const_cast<uint8_t*>(base), size);
+            #endif
+        }
+    };
+
+    std::mutex mounted_lock;
+    std::vector<MountedArchive> mounted;
+
+    /** Throws if the mapped file is not a valid archive, otherwise fills in the rest of a. */
+    void check_archive (MountedArchive &a)
+    {
+        if (a.size < sizeof(AssetArchiveHeader))
+            EXCEPT << "Not an archive (too small): \"" << a.filename << "\"" << ENDL;
+        const AssetArchiveHeader &h = *reinterpret_cast<const AssetArchiveHeader*>(a.base);
+        if (memcmp(h.magic, ASSET_ARCHIVE_MAGIC, sizeof(h.magic)) != 0)
+            EXCEPT << "Not an archive: \"" << a.filename << "\"" << ENDL;
+        if (h.version != ASSET_ARCHIVE_VERSION)
+            EXCEPT << "Archive \"" << a.filename << "\" has version " << h.version
+                   << " but expected " << ASSET_ARCHIVE_VERSION << ENDL;
+        uint64_t slots_bytes = uint64_t(h.numSlots) * sizeof(AssetArchiveSlot);
+        if (h.numSlots == 0 || (h.numSlots & (h.numSlots - 1)) != 0
+            || h.slotsOffset % alignof(AssetArchiveSlot) != 0
+            || h.slotsOffset > a.size || slots_bytes > a.size - h.slotsOffset
+            || h.namesOffset > h.slotsOffset)
+            EXCEPT << "Archive is corrupt (bad table of contents): \"" << a.filename << "\"" << ENDL;
+
+        a.slots = reinterpret_cast<const AssetArchiveSlot*>(a.base + h.slotsOffset);
+        a.numSlots = h.numSlots;
+        a.names = reinterpret_cast<const char*>(a.base + h.namesOffset);
+        a.namesLength = h.slotsOffset - h.namesOffset;
+
+        // Check every entry now, so lookups need not.  There must be an empty slot to terminate
+        // the probing.
+        bool has_empty = false;
+        for (uint32_t i=0 ; i<a.numSlots ; ++i) {
+            const AssetArchiveSlot &slot = a.slots[i];
+            if (slot.nameLength == 0) {
+                has_empty = true;
+                continue;
+            }
+            if (slot.nameOffset > a.namesLength || slot.nameLength > a.namesLength - slot.nameOffset
+                || slot.offset > h.namesOffset || slot.length > h.namesOffset - slot.offset)
+                EXCEPT << "Archive is corrupt (bad entry): \"" << a.filename << "\"" << ENDL;
+        }
+        if (!has_empty)
+            EXCEPT << "Archive is corrupt (full table of contents): \"" << a.filename << "\"" << ENDL;
+    }
+
+}
+
+void asset_archive_mount (const std::string &filename)
+{
+    MountedArchive a;
+    a.filename = filename;
+
+    #ifdef WIN32
+    a.file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL, NULL);
+    if (a.file == INVALID_HANDLE_VALUE)
+        EXCEPT << "Could not open archive: \"" << filename << "\"" << ENDL;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(a.file, &size) || size.QuadPart == 0) {
+        CloseHandle(a.file);
+        EXCEPT << "Could not get size of archive: \"" << filename << "\"" << ENDL;
+    }
+    a.size = size_t(size.QuadPart);
+    a.mapping = CreateFileMappingA(a.file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (a.mapping == NULL) {
+        CloseHandle(a.file);
+        EXCEPT << "Could not map archive: \"" << filename << "\"" << ENDL;
+    }
+    a.base = static_cast<const uint8_t*>(MapViewOfFile(a.mapping, FILE_MAP_READ, 0, 0, 0));
+    if (a.base == NULL) {
+        CloseHandle(a.mapping);
+        CloseHandle(a.file);
+        EXCEPT << "Could not map archive: \"" << filename << "\"" << ENDL;
+    }
+    #else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        EXCEPT << "Could not open archive: \"" << filename << "\" (" << strerror(errno) << ")" << ENDL;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        EXCEPT << "Could not get size of archive: \"" << filename << "\"" << ENDL;
+    }
+    a.size = size_t(st.st_size);
+    void *base = mmap(NULL, a.size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps the file open.
+    close(fd);
+    if (base == MAP_FAILED)
+        EXCEPT << "Could not map archive: \"" << filename << "\" (" << strerror(errno) << ")" << ENDL;
+    a.base = static_cast<const uint8_t*>(base);
+    #endif
+
+    try {
+        check_archive(a);
+    } catch (...) {
+        a.unmap();
+        throw;
+    }
+
+    std::lock_guard<std::mutex> _lock(mounted_lock);
+    mounted.push_back(a);
+    CVERB << "Mounted archive: \"" << filename << "\"" << std::endl;
+}
+
+void asset_archive_unmount_all (void)
+{
+    std::lock_guard<std::mutex> _lock(mounted_lock);
+    for (size_t i=0 ; i<mounted.size() ; ++i) mounted[i].unmap();
+    mounted.clear();
+}
+
+size_t asset_archive_num_mounted (void)
+{
+    std::lock_guard<std::mutex> _lock(mounted_lock);
+    return mounted.size();
+}
+
+bool asset_archive_find (const std::string &name, AssetView &view)
+{
+    std::lock_guard<std::mutex> _lock(mounted_lock);
+    if (mounted.size() == 0) return false;
+    uint64_t hash = asset_archive_hash(name.data(), name.length());
+    for (size_t i=mounted.size() ; i-- > 0 ; ) {
+        if (mounted[i].find(name, hash, view)) return true;
+    }
+    return false;
+}
@@ -0,0 +1,98 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Read-only archives of game files, built by grit_pack.  A mounted archive is mapped into memory
+ * once, and the files within can be read without any system calls or copying.  Disk resource
+ * loaders try the mounted archives first, and fall back to loose files.
+ *
+ * The format (all integers little endian):
+ *
+ *   AssetArchiveHeader
+ *   file data, each file aligned to ASSET_ARCHIVE_ALIGNMENT
+ *   names, concatenated, not terminated
+ *   AssetArchiveSlot[numSlots], an open addressing hash table keyed by asset_archive_hash(name)
+ *       with linear probing, numSlots is a power of 2 and at most half the slots are full.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#ifndef AssetArchive_h
+#define AssetArchive_h
+
+#define ASSET_ARCHIVE_MAGIC "GRITPAK"
+#define ASSET_ARCHIVE_VERSION 1
+#define ASSET_ARCHIVE_ALIGNMENT 16
+
+struct AssetArchiveHeader {
+    char magic[8];  // ASSET_ARCHIVE_MAGIC, 0 terminated
+    uint32_t version;
+    uint32_t numSlots;
+    uint64_t slotsOffset;
+    uint64_t namesOffset;
+};
+
+struct AssetArchiveSlot {
+    uint64_t hash;
+    uint64_t offset;
+    uint64_t length;
+    uint32_t nameOffset;  // relative to namesOffset
+    uint32_t nameLength;  // 0 means the slot is empty
+};
+
+/** FNV-1a, part of the file format so must not change. */
+static inline uint64_t asset_archive_hash (const char *name, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i=0 ; i<len ; ++i) {
+        h ^= (unsigned char)name[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/** The contents of a file in a mounted archive.  Valid until the archive is unmounted, which only
+ * happens at shutdown.  The memory is read-only. */
+struct AssetView {
+    const uint8_t *data;
+    size_t length;
+    AssetView (void) : data(NULL), length(0) { }
+};
+
+/** Map the archive into memory and make its files available.  Files in archives mounted later take
+ * precedence over those in earlier ones.  Throws an exception if the file is not a valid archive.
+ * Thread safe.
+ */
+void asset_archive_mount (const std::string &filename);
+
+/** Unmap all archives.  Call only when no disk resources are being loaded. */
+void asset_archive_unmount_all (void);
+
+/** The number of mounted archives. */
+size_t asset_archive_num_mounted (void);
+
+/** Look up the file (an absolute Grit path, e.g. /system/foo.bcol) in the mounted archives.
+ * Returns false if it is not in any of them, in which case it should be read from disk as usual.
+ * Thread safe. */
+bool asset_archive_find (const std::string &name, AssetView &view);
+
+#endif
@@ -23,6 +23,7 @@
 #include <AL/alc.h>
 
 #include <centralised_log.h>
+#include "../frame_profiler.h"
 #include "../vect_util.h"
 #include "../option.h"
 
@@ -287,6 +288,7 @@ void audio_play (const std::string& filename, const Vector3& position, float vol
 
 void audio_update (const Vector3& position, const Vector3& velocity, const Quaternion& rotation)
 {
+    FRAME_PROFILER_ZONE("audio_update");
     ALfloat pos[] = { position.x, position.y, position.z };
     ALfloat vel[] = { velocity.x, velocity.y, velocity.z };
     ALfloat zeros[] = { 0.0f, 0.0f, 0.0f };
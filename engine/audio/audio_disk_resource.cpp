@@ -19,6 +19,8 @@
  * THE SOFTWARE.
  */
 
+#include "../asset_archive.h"
+
 #include "audio_disk_resource.h"
 #include "audio.h"
 #include <portable_io.h>
@@ -30,12 +32,8 @@ void AudioDiskResource::loadImpl (void)
 
     // why using OGRE anyways? I'm just following CollisionMesh.c++'s example and doing so here
     // [DC] we are still using ogre's IO code, that understands putting files in zips etc.
-    Ogre::DataStreamPtr file;
-    try {
-        file = Ogre::ResourceGroupManager::getSingleton().openResource(name.substr(1),"GRIT");
-    } catch (Ogre::Exception &e) {
-        GRIT_EXCEPT(e.getDescription());
-    }
+    AssetView view;
+    Ogre::DataStreamPtr file = disk_resource_open(name, view);
 
     uint32_t fourcc = 0;
     file->read(&fourcc, sizeof(fourcc));
@@ -43,7 +41,7 @@ void AudioDiskResource::loadImpl (void)
     if (fourcc == 0x46464952) // RIFF
     {
         file->seek(0);
-        loadWAV(file);
+        loadWAV(file, view);
     }
     else if (fourcc == 0x5367674F) // OggS
     {
@@ -80,7 +78,7 @@ struct wave_format
     uint16_t size;
 };
 
-void AudioDiskResource::loadWAV(Ogre::DataStreamPtr &file)
+void AudioDiskResource::loadWAV(Ogre::DataStreamPtr &file, const AssetView &view)
 {
     riff_header header;
     file->read(&header, sizeof(header));
@@ -144,8 +142,16 @@ void AudioDiskResource::loadWAV(Ogre::DataStreamPtr &file)
     size_t bytes_per_sample = fmt.bitsPerSample/8;
     size_t samples = dataHeader.size / fmt.channels / bytes_per_sample;
 
-    uint8_t* data = new uint8_t[dataHeader.size];
-    file->read(data, dataHeader.size);
+    // If the file is in an archive, give OpenAL the samples directly.
+    std::vector<uint8_t> copy;
+    const uint8_t *data;
+    if (view.data != NULL && dataHeader.size <= view.length - file->tell()) {
+        data = view.data + file->tell();
+    } else {
+        copy.resize(dataHeader.size);
+        file->read(&copy[0], dataHeader.size);
+        data = &copy[0];
+    }
 
     // generate an AL buffer
 
@@ -160,6 +166,8 @@ void AudioDiskResource::loadWAV(Ogre::DataStreamPtr &file)
         stereo = false;
         alGenBuffers(1, &alBufferLeft);
         alBufferData(alBufferLeft, mono_format, data, dataHeader.size, fmt.samples);
+        // OpenAL keeps its buffers in host memory.
+        setHostRAM(dataHeader.size);
     } else {
         stereo = true;
         alGenBuffers(1, &alBuffer);
@@ -172,12 +180,10 @@ void AudioDiskResource::loadWAV(Ogre::DataStreamPtr &file)
         alGenBuffers(1, &alBufferRight);
         alBufferData(alBufferRight, mono_format, data1, dataHeader.size/2, fmt.samples);
         delete[] data1;
+        // The interleaved buffer, plus each channel separately.
+        setHostRAM(2 * size_t(dataHeader.size));
     }
 
-
-    // free the data (as memory is in the AL buffer now)
-    delete[] data;
-
     // close the stream
     file->close();
 }
@@ -221,10 +227,12 @@ void AudioDiskResource::loadOGG(Ogre::DataStreamPtr &file)
         alGenBuffers(1, &alBufferRight);
         alBufferData(alBufferRight, mono_format, data1, data.size()/2, decoder.rate());
         delete[] data1;
+        setHostRAM(2 * data.size());
     } else { //mono
         stereo = false;
         alGenBuffers(1, &alBufferLeft);
         alBufferData(alBufferLeft, mono_format, &data[0], data.size(), decoder.rate());
+        setHostRAM(data.size());
     }
     
     file->close();
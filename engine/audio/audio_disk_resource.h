@@ -49,6 +49,8 @@ public:
     /** The name of the resource, i.e. the filename on disk as an absolute Grit path. */
     virtual const std::string &getName (void) const { return name; }
 
+    virtual const char *getTypeName (void) const { return "Audio"; }
+
     /** A buffer containing either both channels interleaved (in the case of stereo) or just the single channel. */
     ALuint getALBufferAll(void) { return stereo ? alBuffer : alBufferLeft; }
 
@@ -63,8 +65,9 @@ public:
 
 private:
 
-    /** Utility function to load a PCM file with .wav header from the byte stream. */
-    void loadWAV (Ogre::DataStreamPtr &file);
+    /** Utility function to load a PCM file with .wav header from the byte stream.  If the file is
+     * in an asset archive, view holds its bytes, otherwise view.data is NULL. */
+    void loadWAV (Ogre::DataStreamPtr &file, const AssetView &view);
     
     /** Utility function to load and decode Ogg Vorbis file. */
     void loadOGG (Ogre::DataStreamPtr &file);
@@ -25,6 +25,7 @@
 #include "gfx/gfx_disk_resource.h"
 
 #include "background_loader.h"
+#include "frame_profiler.h"
 #include "main.h"
 
 #define SYNCHRONISED std::unique_lock<std::recursive_mutex> _scoped_lock(lock)
@@ -33,10 +34,13 @@
 bool Demand::requestLoad (float dist)
 {
     // called by main thread only
-    mDist = dist;
     {
         SYNCHRONISED2(bgl);
-        if (mInBackgroundQueue) return false;
+        if (mInBackgroundQueue) {
+            bgl->reprioritise(this, dist);
+            return false;
+        }
+        mDist = dist;
     }
 
     if (!incremented) {
@@ -44,6 +48,7 @@ bool Demand::requestLoad (float dist)
         for (unsigned i=0 ; i<resources.size() ; ++i) {
             // increment all the resource counters so that we know they're in use
             resources[i]->increment();
+            bgl->reclaim(resources[i]);
         }
         incremented = true;
     }
@@ -78,6 +83,7 @@ void Demand::immediateLoad (void)
     if (!incremented) {
         for (unsigned i=0 ; i<resources.size() ; ++i) {
             resources[i]->increment();
+            bgl->reclaim(resources[i]);
         }
         incremented = true;
     }
@@ -119,13 +125,11 @@ void Demand::finishedWith (void)
 
 
 BackgroundLoader::BackgroundLoader (void)
-  : mNumBastards(0), mThread(NULL), mCurrent(NULL),
+  : mNumBastards(0), mNumActive(0), mNumWorkers(0),
     mQuit(false), mAllowance(0)
 {
-    SYNCHRONISED;
-
-    mThread = new std::thread((void (*)(BackgroundLoader*))thread_main,
-                              const_cast<BackgroundLoader*>(this));
+    // CORE_LOADER_THREADS adjusts this once the options are initialised.
+    setNumThreads(1);
 }
 
 BackgroundLoader::~BackgroundLoader (void)
@@ -139,21 +143,52 @@ void BackgroundLoader::shutdown (void)
     {
         SYNCHRONISED;
         mQuit = true;
-        cVar.notify_one();
+        cVar.notify_all();
     }
-    mThread->join();
+    for (unsigned i=0 ; i<mThreads.size() ; ++i) {
+        mThreads[i]->join();
+        delete mThreads[i];
+    }
+    mThreads.clear();
     handleBastards();
     mDeathRowGPU.clear();
     mDeathRowHost.clear();
     mDemands.clear();
-    delete mThread;
+}
+
+// called by main thread only
+void BackgroundLoader::setNumThreads (unsigned n)
+{
+    if (n < 1) n = 1;
+    std::vector<std::thread*> retired;
+    {
+        SYNCHRONISED;
+        if (mQuit) return;
+        mNumWorkers = n;
+        while (mThreads.size() > n) {
+            retired.push_back(mThreads.back());
+            mThreads.pop_back();
+        }
+        if (mCurrent.size() < n) mCurrent.resize(n, NULL);
+        while (mThreads.size() < n) {
+            unsigned worker = mThreads.size();
+            mThreads.push_back(new std::thread((void (*)(BackgroundLoader*, unsigned))thread_main,
+                                               this, worker));
+        }
+        cVar.notify_all();
+    }
+    // Must not hold the lock here, the retired threads need it to finish up.
+    for (unsigned i=0 ; i<retired.size() ; ++i) {
+        retired[i]->join();
+        delete retired[i];
+    }
 }
 
 // called by main thread only
 void BackgroundLoader::add (Demand *d)
 {
     SYNCHRONISED;
-    mDemands.push_back(d);
+    mDemands.push(d);
     d->mInBackgroundQueue = true;
     d->causedError = false;
     cVar.notify_one();
@@ -164,15 +199,28 @@ void BackgroundLoader::remove (Demand *d)
 {
     SYNCHRONISED;
     if (!d->mInBackgroundQueue) return;
-    mDemands.erase(d);
     //CVERB << "Retracted demand." << std::endl;
-    if (mCurrent == d) {
+    if (d->mWorker >= 0) {
         //CVERB << "making a bastard..." << std::endl;
-        mCurrent = NULL;
+        mCurrent[d->mWorker] = NULL;
+        d->mWorker = -1;
+        mNumActive--;
+    } else {
+        mDemands.erase(d);
     }
     d->mInBackgroundQueue = false;
 }           
 
+// called by main thread only
+void BackgroundLoader::reprioritise (Demand *d, float dist)
+{
+    SYNCHRONISED;
+    if (d->mDist == dist) return;
+    d->mDist = dist;
+    // if a thread already took it, the new distance is of no consequence
+    if (d->mInBackgroundQueue && d->mWorker < 0) mDemands.update(d);
+}
+
 void BackgroundLoader::handleBastards (void)
 {
     // access volatile field without taking lock first
@@ -193,29 +241,30 @@ void BackgroundLoader::handleBastards (void)
 }
 
 
-void BackgroundLoader::thread_main (BackgroundLoader *self)
+void BackgroundLoader::thread_main (BackgroundLoader *self, unsigned worker)
 {
-    self->thread_main();
+    self->thread_main(worker);
 }
 
-void BackgroundLoader::thread_main (void)
+void BackgroundLoader::thread_main (unsigned worker)
 {
     //APP_VERBOSE("BackgroundLoader: thread started");
+    frame_profiler_thread_name("BackgroundLoader " + std::to_string(worker));
     DiskResources pending;
     bool caused_error = false;
-    while (!mQuit) {
+    while (true) {
         {
             SYNCHRONISED;
-            if (mCurrent) {
+            Demand *d = mCurrent[worker];
+            if (d != NULL) {
                 // Usual case:
                 // demand was not retracted while we were
                 // processing it
-                mCurrent->mInBackgroundQueue = false;
-                mCurrent->causedError = caused_error;
-                // cache in d to suppress compiler error
-                Demand *d = mCurrent;
-                mDemands.erase(d);
-                mCurrent = NULL;
+                d->mInBackgroundQueue = false;
+                d->causedError = caused_error;
+                d->mWorker = -1;
+                mCurrent[worker] = NULL;
+                mNumActive--;
             } else {
                 // demand was retracted, and we actually
                 // loaded stuff
@@ -231,19 +280,26 @@ void BackgroundLoader::thread_main (void)
                    //asynchronously call sm.finishedWith(resource);
             }
             pending.clear();
-            if (mAllowance <= 0 || !nearestDemand(mCurrent)) {
+            if (mQuit || worker >= mNumWorkers) break;
+            if (mAllowance <= 0 || mDemands.size() == 0) {
                 cVar.wait(_scoped_lock);
                 continue;    
             }
-            pending = mCurrent->resources;
+            d = mDemands.pop();
+            d->mWorker = worker;
+            mCurrent[worker] = d;
+            mNumActive++;
+            pending = d->resources;
         }
         //APP_VERBOSE("BackgroundLoader: loading: " + name);
         caused_error = false;
         for (DiskResources::iterator i=pending.begin(), i_=pending.end() ; i != i_ ; ++i) {
             DiskResource *rp = *i;
             try {
-                if (!rp->isLoaded()) {
-                    rp->load();
+                // Another thread may be loading the same resource, if so this waits for it, and
+                // only the one that did the work is charged for it.
+                if (!rp->isLoaded() && rp->load()) {
+                    SYNCHRONISED;
                     mAllowance--;
                     //CVERB << "Loaded a resource: " << *rp << std::endl;
                 }
@@ -259,35 +315,11 @@ void BackgroundLoader::thread_main (void)
 }
 
 
-bool BackgroundLoader::nearestDemand (Demand * volatile &return_demand)
-{
-    if (mDemands.size() == 0) return false;
-
-    float closest_dist = mDemands[0]->mDist;
-    Demand *rd = mDemands[0];
-
-    for (unsigned i=1 ; i<mDemands.size() ; ++i) {
-
-        Demand *d = mDemands[i];
-        
-        float this_dist = d->mDist;
-        
-        if (this_dist<closest_dist) {
-            closest_dist = this_dist;
-            rd = d;
-        }       
-
-    }       
-
-    return_demand = rd;
-    return true;
-}
-
 void BackgroundLoader::setAllowance (float m)
 {
     SYNCHRONISED;
     mAllowance = std::max(mAllowance + m, m);
-    cVar.notify_one();
+    cVar.notify_all();
 }
 
 
@@ -24,14 +24,14 @@
 
 class BackgroundLoader;
 class Demand;
-typedef fast_erase_vector<Demand*> Demands;
+struct DemandNearer;
+typedef fast_erase_heap<Demand*, DemandNearer> Demands;
 
 #ifndef BACKGROUNDLOADER_H
 #define BACKGROUNDLOADER_H
 
 #include <algorithm>
 #include <condition_variable>
-#include <list>
 #include <mutex>
 #include <thread>
 
@@ -39,85 +39,6 @@ typedef fast_erase_vector<Demand*> Demands;
 
 #include "disk_resource.h"
 
-/** A least recently used queue, used to select resources to unload in the
- * event of memory pressure.  The basic idea is you push to the queue when you
- * no-longer need something, and you pop if you need to free space.  If you
- * start using something, you call removeIfPresent to mark it as being used
- * again.
- */
-template<typename T> class LRUQueue {
-
-    protected:
-
-    typedef std::list<T> Queue;
-
-    typedef typename Queue::size_type size_type;
-
-
-    public:
-
-    /** Create an empty queue. */
-    LRUQueue () : mSize(0) { }
-
-    /** Destructor. */
-    ~LRUQueue () { }
-
-    /** If v is in the queue, remove it, otherwise a no-op. */
-    inline void removeIfPresent (const T &v)
-    {
-        //if already in queue, remove
-        typename Queue::iterator end = mQueue.end();
-        typename Queue::iterator i = std::find(mQueue.begin(), end, v);
-        if (i != end) {
-            mQueue.erase(i);
-            mSize--;
-        }
-    }
-
-    /** Add a new object v to the queue.
-     *
-     * This means you're not intending to use it anymore, but it is the most recently used thing.
-     */
-    inline void push (const T &v)
-    {
-        //it only gets pushed if it's not referenced anywhere
-        //so the following line is a waste of time
-        //removeIfPresent(v);
-
-        //add to young end of queue
-        mQueue.push_front(v);
-        mSize++;
-    }
-
-    /** Retrieve the least-recently used thing, and remove it from the queue. */
-    inline T pop ()
-    {
-        //remove from old end of queue
-        T v = mQueue.back();
-        mQueue.pop_back();
-        mSize--;
-        return v;
-    }
-
-    /** Return the number of elements in the queue.  This is the number of
-     * resources that are loaded but not being used (i.e. it's a cache in case they
-     * need to be used again. */
-    inline size_type size () const { return mSize; }
-
-    /** Make the queue empty. */
-    inline void clear () { mQueue.clear() ; mSize=0; }
-
-
-    protected:
-
-    /** Cache of the number of elements in the queue. */
-    size_t mSize;
-
-    /** The queue itself, a linked list. */
-    Queue mQueue;
-};
-
-
 /** When a GritObject wants to load something, it registers a 'demand' with the
  * BackgroundLoader.  This acts as a channel of communication.  The  object can
  * communicate its changing position (the distance to the demand is used by the
@@ -138,7 +59,8 @@ class Demand : public fast_erase_index {
     public:
 
     Demand (void)
-        : mInBackgroundQueue(false), mDist(0.0f), incremented(false), causedError(false)
+        : mInBackgroundQueue(false), mDist(0.0f), mWorker(-1), incremented(false),
+          causedError(false)
     { }
 
     /** Add a required disk resource (by absolute path to the file). */
@@ -210,9 +132,14 @@ class Demand : public fast_erase_index {
     /** The vector of resources that are required. */
     DiskResources resources;
 
-    /** Distance from the player to the user of these resources. */
+    /** Distance from the player to the user of these resources.  Only changed while holding
+     * the BackgroundLoader lock, as it is the key of the queue. */
     volatile float mDist;
 
+    /** The loader thread currently processing this demand, or -1 if it is waiting in the queue
+     * (or not queued at all). */
+    int mWorker;
+
     /** Have we called increment on the resources yet? */
     bool incremented;
 
@@ -220,14 +147,21 @@ class Demand : public fast_erase_index {
     bool causedError;
 
     friend class BackgroundLoader;
+    friend struct DemandNearer;
+};
+
+/** Orders the BackgroundLoader queue, closest demand first. */
+struct DemandNearer {
+    bool operator() (const Demand &a, const Demand &b) const { return a.mDist < b.mDist; }
 };
 
 
 /** Singleton class that managest the background loading of DiskResources using
- * a system thread to block on the I/O involved.  The intent is to avoid stalls
- * in the frame loop due to loading from disk.  Resources are loaded ahead of
- * when they are needed, and when multiple resources are needed, the closest to
- * the player is loaded first. */
+ * a pool of system threads to block on the I/O involved.  The intent is to avoid
+ * stalls in the frame loop due to loading from disk.  Resources are loaded ahead
+ * of when they are needed, and when multiple resources are needed, the closest
+ * to the player is loaded first.  Each thread takes the closest demand off a
+ * heap, so demands are re-prioritised in place as the player moves. */
 class BackgroundLoader {
 
     public:
@@ -243,33 +177,49 @@ class BackgroundLoader {
 
     void remove (Demand *d);
 
+    /** Move d to its new place in the queue, if it is waiting there. */
+    void reprioritise (Demand *d, float dist);
+
     void handleBastards (void);
 
-    size_t size (void) { return mDemands.size(); }
+    /** Number of demands waiting or being loaded. */
+    size_t size (void) { return mDemands.size() + mNumActive; }
 
     void setAllowance (float m);
 
+    /** Grow or shrink the pool of loader threads.  Shrinking waits for the
+     * retired threads to finish the demand they are working on. */
+    void setNumThreads (unsigned n);
+
+    unsigned getNumThreads (void) const { return mThreads.size(); }
+
 
     // background thread entry point
-    static void thread_main (BackgroundLoader *self);
+    static void thread_main (BackgroundLoader *self, unsigned worker);
 
-    void thread_main (void);
+    void thread_main (unsigned worker);
 
     std::recursive_mutex lock;
     std::condition_variable_any cVar;
 
     protected:
 
-    bool nearestDemand (Demand * volatile &return_demand);
-
     DiskResources mBastards;
     volatile unsigned short mNumBastards;
 
     Demands mDemands;
 
-    std::thread *mThread;
+    std::vector<std::thread*> mThreads;
+
+    /** The demand each thread is working on, set to NULL if it is retracted meanwhile. */
+    std::vector<Demand*> mCurrent;
+
+    /** Number of demands being loaded, i.e. taken off the queue but not finished. */
+    volatile unsigned mNumActive;
+
+    /** Threads with an index >= this exit after finishing their current demand. */
+    unsigned mNumWorkers;
 
-    Demand * volatile mCurrent;
     volatile bool mQuit;
 
     float mAllowance;
@@ -284,13 +234,20 @@ class BackgroundLoader {
 
     void finishedWith (DiskResource *);
 
+    /** The resource has users again, so take it off death row. */
+    void reclaim (DiskResource *de)
+    {
+        mDeathRowGPU.removeIfPresent(de);
+        mDeathRowHost.removeIfPresent(de);
+    }
+
     void checkRAMHost (void);
     void checkRAMGPU (void);
 
     protected:
 
-    LRUQueue<DiskResource*> mDeathRowGPU;
-    LRUQueue<DiskResource*> mDeathRowHost;
+    LRUQueue<DiskResource> mDeathRowGPU;
+    LRUQueue<DiskResource> mDeathRowHost;
 
 };
 
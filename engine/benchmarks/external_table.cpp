@@ -0,0 +1,154 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Compares class table reads from the flat, interned-key ExternalTable with the std::map based
+ * table it replaced.
+ *
+ * Usage: bench_external_table [reads]
+ *
+ * Each table looks like a typical object class: a couple of dozen fields, of which a spawn or an
+ * activation reads a handful, and some of the reads miss (the caller then tries the parent
+ * class).  Reads are timed by string, as from Lua or most C++ code, and by a kept
+ * ExternalTableKey, as from hot C++ paths.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <centralised_log.h>
+
+#include "../external_table.h"
+
+CentralisedLog clog;
+
+// The implementation before the flat one, just the parts needed to read numbers.
+class MapTable {
+    std::map<std::string, ExternalTable::Value> fields;
+    public:
+    void set (const std::string &key, lua_Number r)
+    {
+        fields[key].type = 0;
+        fields[key].real = r;
+    }
+    bool get (const std::string &key, lua_Number &v) const
+    {
+        auto it = fields.find(key);
+        if (it == fields.end()) return false;
+        if (it->second.type != 0) return false;
+        v = it->second.real;
+        return true;
+    }
+};
+
+static const char *field_names[] = {
+    "renderingDistance", "gfxMesh", "colMesh", "placementZOffset", "placementRandomRotation",
+    "castShadows", "activate", "deactivate", "init", "destroy", "setFade", "stepCallback",
+    "frameCallback", "receiveDamage", "health", "mass", "lightColour", "lightRange", "lightAim",
+    "emissiveColour", "materialMap", "canDrive", "driveBackgroundColour", "engineSmokeVents",
+};
+static const size_t num_fields = sizeof(field_names) / sizeof(*field_names);
+
+// Read on spawn / activation, including some that classes rarely define.
+static const char *read_names[] = {
+    "renderingDistance", "gfxMesh", "colMesh", "castShadows", "init", "activate", "health",
+    "placementZOffset", "lodDistance", "neverUnload", "stepCallback", "frameCallback",
+};
+static const size_t num_reads = sizeof(read_names) / sizeof(*read_names);
+
+template<class F> static double time_ms (F f)
+{
+    auto before = std::chrono::steady_clock::now();
+    f();
+    auto after = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(after - before).count();
+}
+
+int main (int argc, char **argv)
+{
+    size_t reads = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+    const size_t num_classes = 1000;
+
+    std::vector<MapTable> map_tables(num_classes);
+    std::vector<ExternalTable> flat_tables(num_classes);
+    std::mt19937 rng(1);
+    for (size_t c=0 ; c<num_classes ; ++c) {
+        // Classes define different subsets of the fields.
+        for (size_t f=0 ; f<num_fields ; ++f) {
+            if (rng() % 4 == 0) continue;
+            map_tables[c].set(field_names[f], lua_Number(f));
+            flat_tables[c].set(field_names[f], lua_Number(f));
+        }
+    }
+
+    std::vector<std::string> read_strings(read_names, read_names + num_reads);
+    std::vector<ExternalTableKey> read_keys;
+    for (size_t i=0 ; i<num_reads ; ++i) read_keys.push_back(ExternalTableKey(read_strings[i]));
+
+    // Visit the classes in a random order, as spawning a map does.
+    std::vector<unsigned> order(reads / num_reads + 1);
+    for (size_t i=0 ; i<order.size() ; ++i) order[i] = rng() % num_classes;
+
+    lua_Number sum_map = 0, sum_flat = 0, sum_key = 0;
+    double map_ms = time_ms([&] {
+        for (size_t i=0 ; i<order.size() ; ++i) {
+            const MapTable &t = map_tables[order[i]];
+            for (size_t j=0 ; j<num_reads ; ++j) {
+                lua_Number v;
+                if (t.get(read_strings[j], v)) sum_map += v;
+            }
+        }
+    });
+    double flat_ms = time_ms([&] {
+        for (size_t i=0 ; i<order.size() ; ++i) {
+            const ExternalTable &t = flat_tables[order[i]];
+            for (size_t j=0 ; j<num_reads ; ++j) {
+                lua_Number v;
+                if (t.get(read_strings[j], v)) sum_flat += v;
+            }
+        }
+    });
+    double key_ms = time_ms([&] {
+        for (size_t i=0 ; i<order.size() ; ++i) {
+            const ExternalTable &t = flat_tables[order[i]];
+            for (size_t j=0 ; j<num_reads ; ++j) {
+                lua_Number v;
+                if (t.get(read_keys[j], v)) sum_key += v;
+            }
+        }
+    });
+
+    size_t total = order.size() * num_reads;
+    printf("%zu reads over %zu classes of up to %zu fields\n", total, num_classes, num_fields);
+    printf("std::map, string key:           %10.3f ms  (%6.1f ns/read)\n", map_ms, map_ms * 1e6 / total);
+    printf("ExternalTable, string key:      %10.3f ms  (%6.1f ns/read)\n", flat_ms, flat_ms * 1e6 / total);
+    printf("ExternalTable, interned key:    %10.3f ms  (%6.1f ns/read)\n", key_ms, key_ms * 1e6 / total);
+    if (sum_map != sum_flat || sum_map != sum_key) {
+        fprintf(stderr, "Implementations disagree!\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,155 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Compares std::vector with FrameVector for the temporary lists built every frame.
+ *
+ * Usage: bench_frame_arena [frames]
+ *
+ * Each frame mimics the streamer and physics: a few vectors of pointers are filled with a number
+ * of elements that varies from frame to frame (so the arena has to grow to the biggest frame),
+ * read, and thrown away.  Heap allocations are counted by replacing the global operator new; the
+ * arena's blocks come from malloc and are reported separately by its own stats.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <chrono>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "../frame_arena.h"
+
+static size_t allocations = 0;
+
+void *operator new (size_t sz)
+{
+    allocations++;
+    void *r = malloc(sz == 0 ? 1 : sz);
+    if (r == NULL) throw std::bad_alloc();
+    return r;
+}
+
+void operator delete (void *p) noexcept
+{
+    free(p);
+}
+
+struct Object {
+    float pos[3];
+    bool activated;
+};
+
+struct Result {
+    double ms;
+    size_t allocations;
+    size_t steadyAllocations;  // In the second half of the frames.
+    size_t checksum;
+};
+
+template<class Vector> static void frame (const std::vector<Object> &objects,
+                                          const std::vector<unsigned> &sizes, unsigned f,
+                                          Vector &&found, Vector &&ahead, Vector &&kill,
+                                          size_t &checksum)
+{
+    // Like streamer_centre: range query results, then lists derived from them.
+    unsigned n = sizes[f];
+    for (unsigned i=0 ; i<n ; ++i) found.push_back(&objects[(f * 7 + i) % objects.size()]);
+    for (const Object *o : found) {
+        if (o->activated) kill.push_back(o);
+        else ahead.push_back(o);
+    }
+    checksum += found.size() + 3 * kill.size() + 5 * ahead.size();
+}
+
+static Result run_std (const std::vector<Object> &objects, const std::vector<unsigned> &sizes)
+{
+    typedef std::vector<const Object*> Vector;
+    Result r = { 0, 0, 0, 0 };
+    size_t before_allocs = allocations;
+    auto before = std::chrono::steady_clock::now();
+    for (unsigned f=0 ; f<sizes.size() ; ++f) {
+        if (f == sizes.size() / 2) r.steadyAllocations = allocations;
+        frame(objects, sizes, f, Vector(), Vector(), Vector(), r.checksum);
+    }
+    auto after = std::chrono::steady_clock::now();
+    r.ms = std::chrono::duration<double, std::milli>(after - before).count();
+    r.allocations = allocations - before_allocs;
+    r.steadyAllocations = allocations - r.steadyAllocations;
+    return r;
+}
+
+static Result run_arena (const std::vector<Object> &objects, const std::vector<unsigned> &sizes,
+                         FrameArena &arena)
+{
+    typedef FrameVector<const Object*> Vector;
+    FrameAllocator<const Object*> alloc(arena);
+    Result r = { 0, 0, 0, 0 };
+    size_t before_allocs = allocations;
+    uint64_t before_blocks = arena.getStats().heapAllocations;
+    size_t half_blocks = 0;
+    auto before = std::chrono::steady_clock::now();
+    for (unsigned f=0 ; f<sizes.size() ; ++f) {
+        if (f == sizes.size() / 2) half_blocks = arena.getStats().heapAllocations;
+        frame(objects, sizes, f, Vector(alloc), Vector(alloc), Vector(alloc), r.checksum);
+        arena.reset();
+    }
+    auto after = std::chrono::steady_clock::now();
+    r.ms = std::chrono::duration<double, std::milli>(after - before).count();
+    r.allocations = allocations - before_allocs + (arena.getStats().heapAllocations - before_blocks);
+    r.steadyAllocations = arena.getStats().heapAllocations - half_blocks;
+    return r;
+}
+
+int main (int argc, char **argv)
+{
+    unsigned frames = argc > 1 ? unsigned(atoi(argv[1])) : 20000;
+    if (frames < 2) {
+        fprintf(stderr, "Need at least 2 frames.\n");
+        return EXIT_FAILURE;
+    }
+
+    std::mt19937 rng(42);
+    std::vector<Object> objects(10000);
+    for (Object &o : objects) o.activated = rng() % 4 == 0;
+    // Mostly a few hundred objects in range, occasionally a lot more.
+    std::vector<unsigned> sizes(frames);
+    for (unsigned &s : sizes) s = rng() % 100 == 0 ? 2000 + rng() % 3000 : 100 + rng() % 400;
+
+    FrameArena arena;
+    Result s = run_std(objects, sizes);
+    Result a = run_arena(objects, sizes, arena);
+    printf("%u frames\n", frames);
+    printf("std::vector:  %10.3f ms  %8zu heap allocations  (%zu in the second half)\n",
+           s.ms, s.allocations, s.steadyAllocations);
+    printf("FrameVector:  %10.3f ms  %8zu heap allocations  (%zu in the second half)\n",
+           a.ms, a.allocations, a.steadyAllocations);
+    const FrameArenaStats &stats = arena.getStats();
+    printf("Arena: %llu KB capacity, %llu KB peak frame, %llu deferred resets\n",
+           (unsigned long long)stats.capacity / 1024, (unsigned long long)stats.peakBytes / 1024,
+           (unsigned long long)stats.deferredResets);
+    if (s.checksum != a.checksum) {
+        fprintf(stderr, "Implementations disagree!\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
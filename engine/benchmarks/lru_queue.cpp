@@ -0,0 +1,191 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Compares the intrusive LRUQueue used for the background loader's death rows with the
+ * std::list implementation it replaced.
+ *
+ * Usage: bench_lru_queue [trace]
+ *
+ * Without arguments, a synthetic streamer is run: a camera flies over a grid of resources and
+ * each frame, resources coming into range are reclaimed, resources going out of range are pushed,
+ * and under memory pressure the oldest are popped.  A trace file can be given instead, one
+ * operation per line: "push <id>", "reclaim <id>" or "pop".
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "../lru_queue.h"
+
+struct Resource {
+    bool used;
+    LRUQueueLinks<Resource> lruLinks;
+    Resource (void) : used(false) { }
+};
+
+// The implementation before the intrusive one.
+class ListLRUQueue {
+    std::list<Resource*> mQueue;
+    size_t mSize;
+    public:
+    ListLRUQueue (void) : mSize(0) { }
+    void removeIfPresent (Resource *v)
+    {
+        auto i = std::find(mQueue.begin(), mQueue.end(), v);
+        if (i != mQueue.end()) {
+            mQueue.erase(i);
+            mSize--;
+        }
+    }
+    void push (Resource *v) { mQueue.push_front(v); mSize++; }
+    Resource *pop (void) { Resource *v = mQueue.back(); mQueue.pop_back(); mSize--; return v; }
+    size_t size (void) const { return mSize; }
+};
+
+struct Op {
+    enum Kind { PUSH, RECLAIM, POP } kind;
+    unsigned id;
+};
+
+static void synthesise (std::vector<Op> &ops, unsigned &num_resources)
+{
+    const int side = 200;  // resources on a side, one every 10m
+    const float spacing = 10, range = 300, speed = 25;  // speed is per frame
+    const size_t budget = 2000;  // death row length that triggers unloading
+    const unsigned frames = 2000;
+    num_resources = side * side;
+
+    std::vector<bool> in_range(num_resources, false);
+    size_t death_row = 0;
+    for (unsigned f=0 ; f<frames ; ++f) {
+        // Circle around the world, with a wobble so we revisit some areas and not others.
+        float t = f * speed / (side * spacing);
+        float cx = side * spacing * (0.5f + 0.35f * std::cos(t));
+        float cy = side * spacing * (0.5f + 0.35f * std::sin(t) + 0.05f * std::sin(7 * t));
+        int x0 = std::max(0, int((cx - range - speed) / spacing));
+        int x1 = std::min(side - 1, int((cx + range + speed) / spacing));
+        int y0 = std::max(0, int((cy - range - speed) / spacing));
+        int y1 = std::min(side - 1, int((cy + range + speed) / spacing));
+        for (int y=y0 ; y<=y1 ; ++y) {
+            for (int x=x0 ; x<=x1 ; ++x) {
+                unsigned id = y * side + x;
+                float dx = x * spacing - cx, dy = y * spacing - cy;
+                bool now = dx*dx + dy*dy < range*range;
+                if (now == in_range[id]) continue;
+                in_range[id] = now;
+                if (now) {
+                    ops.push_back(Op{Op::RECLAIM, id});
+                } else {
+                    ops.push_back(Op{Op::PUSH, id});
+                    death_row++;
+                }
+            }
+        }
+        // Approximate: reclaimed ones are not subtracted, so this errs on the side of popping.
+        while (death_row > budget) {
+            ops.push_back(Op{Op::POP, 0});
+            death_row--;
+        }
+    }
+}
+
+static bool read_trace (const char *filename, std::vector<Op> &ops, unsigned &num_resources)
+{
+    std::ifstream f(filename);
+    if (!f.good()) return false;
+    num_resources = 0;
+    std::string kind;
+    while (f >> kind) {
+        Op op = {Op::POP, 0};
+        if (kind == "push" || kind == "reclaim") {
+            op.kind = kind == "push" ? Op::PUSH : Op::RECLAIM;
+            f >> op.id;
+            num_resources = std::max(num_resources, op.id + 1);
+        } else if (kind != "pop") {
+            fprintf(stderr, "Unknown operation in trace: %s\n", kind.c_str());
+            return false;
+        }
+        ops.push_back(op);
+    }
+    return true;
+}
+
+// Mirrors BackgroundLoader: push when the last user goes, reclaim when a user returns, and pop
+// skips resources that were reclaimed.
+template<class Q> static double run (const std::vector<Op> &ops, unsigned num_resources,
+                                     size_t &unloads)
+{
+    std::vector<Resource> resources(num_resources);
+    Q q;
+    unloads = 0;
+    auto before = std::chrono::steady_clock::now();
+    for (const Op &op : ops) {
+        switch (op.kind) {
+            case Op::PUSH:
+            resources[op.id].used = false;
+            q.push(&resources[op.id]);
+            break;
+            case Op::RECLAIM:
+            resources[op.id].used = true;
+            q.removeIfPresent(&resources[op.id]);
+            break;
+            case Op::POP:
+            if (q.size() > 0 && !q.pop()->used) unloads++;
+            break;
+        }
+    }
+    auto after = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(after - before).count();
+}
+
+int main (int argc, char **argv)
+{
+    std::vector<Op> ops;
+    unsigned num_resources = 0;
+    if (argc > 1) {
+        if (!read_trace(argv[1], ops, num_resources)) {
+            fprintf(stderr, "Could not read trace: %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+    } else {
+        synthesise(ops, num_resources);
+    }
+
+    printf("%zu operations on %u resources\n", ops.size(), num_resources);
+    size_t unloads_list, unloads_intrusive;
+    double list_ms = run<ListLRUQueue>(ops, num_resources, unloads_list);
+    double intrusive_ms = run<LRUQueue<Resource>>(ops, num_resources, unloads_intrusive);
+    printf("std::list:  %10.3f ms  (%zu unloads)\n", list_ms, unloads_list);
+    printf("intrusive:  %10.3f ms  (%zu unloads)\n", intrusive_ms, unloads_intrusive);
+    if (unloads_list != unloads_intrusive) {
+        fprintf(stderr, "Implementations disagree!\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
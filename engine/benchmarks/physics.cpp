@@ -0,0 +1,233 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Physics step time against the number of threads solving the simulation islands.
+ *
+ * Usage: bench_physics [steps] [stacks] [vehicles]
+ *
+ * Build with BULLET_PROFILE_DEFS=BT_NO_PROFILE, otherwise every run uses only 1 thread.
+ *
+ * The scene is a bumpy triangle mesh terrain with stacks of boxes and simple vehicles (a chassis
+ * with 4 motorised wheels on hinges) driving over it.  Nothing is allowed to go to sleep, so the
+ * load is the same throughout.  Each thread count is run twice from the same start, to check the
+ * result does not change from run to run.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <btBulletDynamicsCommon.h>
+
+#include "../job_system.h"
+#include "../physics/parallel_dynamics_world.h"
+
+static const float step_size = 1 / 200.0f;
+static const int stack_height = 8;
+
+static float terrain_height (float x, float y)
+{
+    return 2 * std::sin(x * 0.05f) * std::cos(y * 0.07f);
+}
+
+struct Scene {
+    btDefaultCollisionConfiguration conf;
+    btCollisionDispatcher dispatcher;
+    btDbvtBroadphase broadphase;
+    btSequentialImpulseConstraintSolver solver;
+    ParallelDynamicsWorld world;
+
+    btTriangleMesh terrainMesh;
+    btBvhTriangleMeshShape *terrainShape;
+    btBoxShape box;
+    btBoxShape chassis;
+    btCylinderShapeX wheel;
+    std::vector<btRigidBody*> bodies;  // Dynamic ones.
+    std::vector<btTypedConstraint*> constraints;
+
+    Scene (unsigned threads, unsigned stacks, unsigned vehicles)
+      : dispatcher(&conf), world(&dispatcher, &broadphase, &solver, &conf),
+        box(btVector3(0.5f, 0.5f, 0.5f)), chassis(btVector3(1, 2, 0.4f)),
+        wheel(btVector3(0.2f, 0.4f, 0.4f))
+    {
+        world.setGravity(btVector3(0, 0, -9.807f));
+        world.setNumThreads(threads);
+
+        // Big enough for everything to be spread out, so there are lots of islands.
+        const int cells = 100;
+        const float cell = 4, origin = -cells * cell / 2;
+        for (int y=0 ; y<cells ; ++y) {
+            for (int x=0 ; x<cells ; ++x) {
+                float x0 = origin + x * cell, y0 = origin + y * cell;
+                float x1 = x0 + cell, y1 = y0 + cell;
+                btVector3 a(x0, y0, terrain_height(x0, y0)), b(x1, y0, terrain_height(x1, y0));
+                btVector3 c(x1, y1, terrain_height(x1, y1)), d(x0, y1, terrain_height(x0, y1));
+                terrainMesh.addTriangle(a, b, c);
+                terrainMesh.addTriangle(a, c, d);
+            }
+        }
+        terrainShape = new btBvhTriangleMeshShape(&terrainMesh, true);
+        addBody(0, terrainShape, btVector3(0, 0, 0));
+
+        // Stacks in the west half, vehicles in the east half.
+        unsigned side = unsigned(std::ceil(std::sqrt(float(std::max(stacks, vehicles)))));
+        float spacing = -origin / (side + 1);
+        for (unsigned i=0 ; i<stacks ; ++i) {
+            float x = origin + spacing * (1 + i % side), y = origin + 2 * spacing * (1 + i / side);
+            float z = terrain_height(x, y) + 0.5f;
+            for (int j=0 ; j<stack_height ; ++j) addBody(1, &box, btVector3(x, y, z + j * 1.01f));
+        }
+        for (unsigned i=0 ; i<vehicles ; ++i) {
+            float x = spacing * (1 + i % side), y = origin + 2 * spacing * (1 + i / side);
+            addVehicle(btVector3(x, y, terrain_height(x, y) + 1.5f));
+        }
+    }
+
+    ~Scene (void)
+    {
+        for (btTypedConstraint *c : constraints) {
+            world.removeConstraint(c);
+            delete c;
+        }
+        for (int i=world.getNumCollisionObjects()-1 ; i>=0 ; --i) {
+            btRigidBody *b = btRigidBody::upcast(world.getCollisionObjectArray()[i]);
+            world.removeRigidBody(b);
+            delete b->getMotionState();
+            delete b;
+        }
+        delete terrainShape;
+    }
+
+    btRigidBody *addBody (float mass, btCollisionShape *shape, const btVector3 &pos)
+    {
+        btVector3 inertia(0, 0, 0);
+        if (mass > 0) shape->calculateLocalInertia(mass, inertia);
+        btTransform xform(btQuaternion(0, 0, 0, 1), pos);
+        btRigidBody::btRigidBodyConstructionInfo info(mass, new btDefaultMotionState(xform), shape,
+                                                      inertia);
+        btRigidBody *b = new btRigidBody(info);
+        world.addRigidBody(b);
+        if (mass > 0) {
+            b->setActivationState(DISABLE_DEACTIVATION);
+            bodies.push_back(b);
+        }
+        return b;
+    }
+
+    void addVehicle (const btVector3 &pos)
+    {
+        btRigidBody *body = addBody(800, &chassis, pos);
+        for (int i=0 ; i<4 ; ++i) {
+            btVector3 offset(i % 2 ? 1.3f : -1.3f, i / 2 ? 1.5f : -1.5f, -0.3f);
+            btRigidBody *w = addBody(20, &wheel, pos + offset);
+            btVector3 axis(1, 0, 0);
+            btHingeConstraint *hinge =
+                new btHingeConstraint(*body, *w, offset, btVector3(0, 0, 0), axis, axis);
+            hinge->enableAngularMotor(true, 10, 50);
+            world.addConstraint(hinge, true);
+            constraints.push_back(hinge);
+        }
+    }
+
+    // FNV-1a of the bits of every dynamic body's position and orientation.
+    uint64_t hash (void) const
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for (const btRigidBody *b : bodies) {
+            const btTransform &xform = b->getWorldTransform();
+            btQuaternion q = xform.getRotation();
+            float v[7] = { float(xform.getOrigin().x()), float(xform.getOrigin().y()),
+                           float(xform.getOrigin().z()), float(q.x()), float(q.y()),
+                           float(q.z()), float(q.w()) };
+            unsigned char bytes[sizeof v];
+            memcpy(bytes, v, sizeof v);
+            for (unsigned char byte : bytes) {
+                h ^= byte;
+                h *= 1099511628211ULL;
+            }
+        }
+        return h;
+    }
+};
+
+struct Result {
+    unsigned threads;
+    double msPerStep;
+    uint64_t hash;
+};
+
+static Result run (unsigned threads, unsigned steps, unsigned stacks, unsigned vehicles)
+{
+    Scene scene(threads, stacks, vehicles);
+    Result r;
+    r.threads = scene.world.getNumThreads();
+    auto before = std::chrono::steady_clock::now();
+    for (unsigned i=0 ; i<steps ; ++i) scene.world.stepSimulation(step_size, 1, step_size);
+    auto after = std::chrono::steady_clock::now();
+    r.msPerStep = std::chrono::duration<double, std::milli>(after - before).count() / steps;
+    r.hash = scene.hash();
+    return r;
+}
+
+int main (int argc, char **argv)
+{
+    unsigned steps = argc > 1 ? unsigned(atoi(argv[1])) : 400;
+    unsigned stacks = argc > 2 ? unsigned(atoi(argv[2])) : 100;
+    unsigned vehicles = argc > 3 ? unsigned(atoi(argv[3])) : 100;
+    if (steps == 0) {
+        fprintf(stderr, "Need at least 1 step.\n");
+        return EXIT_FAILURE;
+    }
+
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    job_system_set_num_threads(cores - 1);
+    std::vector<unsigned> thread_counts;
+    for (unsigned t=1 ; t<cores ; t*=2) thread_counts.push_back(t);
+    thread_counts.push_back(cores);
+
+    printf("%u steps, %u stacks of %d boxes, %u vehicles, %u cores\n",
+           steps, stacks, stack_height, vehicles, cores);
+    printf("threads   ms/step   speedup   state\n");
+    bool deterministic = true;
+    double serial_ms = 0;
+    for (unsigned t : thread_counts) {
+        Result a = run(t, steps, stacks, vehicles);
+        Result b = run(t, steps, stacks, vehicles);
+        if (a.hash != b.hash) deterministic = false;
+        double ms = std::min(a.msPerStep, b.msPerStep);
+        if (serial_ms == 0) serial_ms = ms;
+        printf("%7u  %8.3f  %8.2fx   %016llx%s\n", a.threads, ms, serial_ms / ms,
+               (unsigned long long)a.hash, a.hash == b.hash ? "" : " (differs between runs!)");
+    }
+    job_system_shutdown();
+    if (!deterministic) {
+        fprintf(stderr, "Not deterministic!\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
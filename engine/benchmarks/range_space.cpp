@@ -0,0 +1,395 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Compares the range space implementations at 10k, 100k and 1M items:
+ *
+ *  - CacheFriendlyRangeSpace (scalar, short x/y/d broad phase, then an exact test),
+ *  - the array of structures SIMDVector4 range space that CacheFriendlyRangeSpaceSIMD replaced,
+ *  - CacheFriendlyRangeSpaceSIMD with each of its kernels (scalar, SSE, AVX2 if supported),
+ *  - LooseGridRangeSpace, which the streamer uses, for reference (it avoids most tests).
+ *
+ * Usage: bench_range_space [queries]
+ *
+ * Each query is a full sweep (num = size) around a random point, as GfxRangedInstances does when
+ * its step size exceeds the number of instances.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../cache_friendly_range_space.h"
+#include "../cache_friendly_range_space_simd.h"
+#include "../sse_allocator.h"
+
+struct Item {
+    float x, y, z, r;
+    int index;
+    void updateIndex (int i) { index = i; }
+    int getIndex (void) const { return index; }
+    float getX (void) const { return x; }
+    float getY (void) const { return y; }
+    float getZ (void) const { return z; }
+    float getR (void) const { return r; }
+};
+
+// The implementation before the structure of arrays one.
+class OldSIMDVector4 {
+
+    protected:
+
+    union U {
+        struct Raw {
+            float x, y, z, d;
+        } raw;
+        float simd __attribute__ ((vector_size (16)));
+    };
+
+
+    public:
+
+    inline void updateAll (float x, float y, float z, float d)
+    {
+        u.raw.x = x;
+        u.raw.y = y;
+        u.raw.z = z;
+        u.raw.d = d;
+    }
+
+    inline float x(void) const { return u.raw.x; }
+    inline float y(void) const { return u.raw.y; }
+    inline float z(void) const { return u.raw.z; }
+    inline float d(void) const { return u.raw.d; }
+
+    OldSIMDVector4 operator- (const OldSIMDVector4 &b) const
+    {
+        OldSIMDVector4 r;
+        r.u.simd = u.simd - b.u.simd;
+        return r;
+    }
+
+    OldSIMDVector4 operator* (const OldSIMDVector4 &b) const
+    {
+        OldSIMDVector4 r;
+        r.u.simd = u.simd * b.u.simd;
+        return r;
+    }
+    OldSIMDVector4 &operator*= (OldSIMDVector4 &b)
+    {
+        *this = *this * b;
+        return *this;
+    }
+
+     protected:
+
+    U u;
+};
+
+typedef std::vector<OldSIMDVector4,SSEAllocator<OldSIMDVector4> > OldSIMDVector4s;
+
+template <typename T>
+class OldCacheFriendlyRangeSpaceSIMD {
+
+    public:
+
+    typedef std::vector<T> Cargo;
+
+    OldCacheFriendlyRangeSpaceSIMD (void) : hence(0) { }
+
+    ~OldCacheFriendlyRangeSpaceSIMD (void) { }
+
+    void reserve (size_t s)
+    {
+        cargo.reserve(s);
+        positions.reserve(s);
+    }
+
+    void add (const T &o)
+    {
+        typename Cargo::iterator begin = cargo.begin(),
+                         end = cargo.end();
+        // if it's already in there, this is a no-op
+        if (find(begin,end,o) != end) return;
+        
+        size_t index = cargo.size();
+        cargo.push_back(o);
+        positions.push_back(OldSIMDVector4());
+        o->updateIndex(index);
+    }
+
+    inline void updateSphere (size_t index, float x, float y, float z, float d)
+    {
+        positions[index].updateAll(x,y,z,d);
+    }
+
+    // only meaningful if the radius is stored in pos.d and
+    // other.d is 0, thus the subtraction and squaring
+    // yields d^2
+    static inline bool isNear (const OldSIMDVector4 &pos,
+                               const OldSIMDVector4 &centre,
+                               const float factor2)
+    {
+        OldSIMDVector4 diff;
+        diff = pos - centre;
+        diff *= diff;
+        return diff.x() + diff.y() + diff.z()
+            < diff.d() * factor2;
+    }
+
+    void getPresent (const float x,
+                     const float y,
+                     const float z,
+                     size_t num,
+                     const float factor,
+                     Cargo &found)
+    {
+        if (num == 0) return;
+        if (cargo.size() == 0) return;
+        if (num>cargo.size()) num=cargo.size();
+        if (hence>=cargo.size()) hence = 0;
+
+        // iterate from this point for a while
+        OldSIMDVector4s::size_type iter = hence, end = positions.size();        
+
+        if (num>positions.size()) {
+            iter = 0;
+            num = positions.size();
+        }
+
+        OldSIMDVector4 home;
+        float factor2 = factor*factor;
+        home.updateAll(x,y,z,0);
+        for (OldSIMDVector4s::size_type i=0 ; i<num ; ++i) {
+            OldSIMDVector4 &pos = positions[iter];
+            if (isNear(home,pos,factor2)) {
+                found.push_back(cargo[iter]);
+            }
+            iter++;
+            if (iter == end) iter=0;
+        }
+
+        hence = iter;
+    }
+
+    void remove (const T &o)
+    {
+        typename Cargo::iterator begin = cargo.begin(),
+                       end = cargo.end();
+        typename Cargo::iterator iter = find(begin,end,o);
+
+        // no-op if o was not in the rangespace somewhere
+        if (iter == end) return;
+
+        // otherwise, carefully remove it -
+        size_t index = iter - begin;
+
+        positions[index] = positions[positions.size()-1];
+        positions.pop_back();
+        cargo[index] = cargo[cargo.size()-1];
+        cargo[index]->updateIndex(index);
+        cargo.pop_back();
+        o->updateIndex(-1);
+    }
+
+    void clear (void)
+    {
+        cargo.clear();
+        positions.clear();
+        hence = 0;
+    }
+
+    size_t size (void) const { return cargo.size(); }
+
+
+    protected:
+
+    size_t hence;
+    OldSIMDVector4s positions;
+    Cargo cargo;
+};
+
+
+// The add() functions check for duplicates with a linear search, which would dominate setting up a
+// million items, so these fill the range spaces directly.
+
+struct ScalarRS : CacheFriendlyRangeSpace<Item*> {
+    void fill (std::vector<Item> &items)
+    {
+        for (Item &i : items) {
+            i.updateIndex(cargoes.size());
+            cargoes.push_back(&i);
+            positions.push_back(Position());
+            updateSphere(i.index, i.x, i.y, i.z, i.r);
+        }
+    }
+};
+
+struct OldSIMDRS : OldCacheFriendlyRangeSpaceSIMD<Item*> {
+    void fill (std::vector<Item> &items)
+    {
+        reserve(items.size());
+        for (Item &i : items) {
+            i.updateIndex(cargo.size());
+            cargo.push_back(&i);
+            positions.push_back(OldSIMDVector4());
+            updateSphere(i.index, i.x, i.y, i.z, i.r);
+        }
+    }
+};
+
+struct SIMDRS : CacheFriendlyRangeSpaceSIMD<Item*> {
+    void fill (std::vector<Item> &items)
+    {
+        reserve(items.size());
+        for (Item &i : items) {
+            i.updateIndex(cargo.size());
+            cargo.push_back(&i);
+            xs.push_back(0);
+            ys.push_back(0);
+            zs.push_back(0);
+            ds.push_back(0);
+            updateSphere(i.index, i.x, i.y, i.z, i.r);
+        }
+    }
+};
+
+struct LooseGridRS : LooseGridRangeSpace<Item*> {
+    void fill (std::vector<Item> &items)
+    {
+        reserve(items.size());
+        for (Item &i : items) {
+            size_t index = cargo.size();
+            i.updateIndex(index);
+            cargo.push_back(&i);
+            spheres.push_back(Sphere());
+            homes.push_back(homeFor(spheres[index]));
+            link(index);
+            updateSphere(i.index, i.x, i.y, i.z, i.r);
+        }
+    }
+};
+
+
+typedef std::chrono::steady_clock Clock;
+
+static double millis (Clock::time_point before)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - before).count();
+}
+
+static void report (const char *name, size_t n, unsigned queries, double ms, size_t found)
+{
+    printf("%-36s %8zu items  %9.3f ms  %6.2f ns/item  (%zu found)\n",
+           name, n, ms, ms * 1e6 / (double(n) * queries), found);
+}
+
+template<class RS> static void run_simd (const char *name, RS &rs, const std::vector<Item> &items,
+                                         const std::vector<Item> &centres)
+{
+    std::vector<Item*> found;
+    found.reserve(items.size());
+    size_t total = 0;
+    auto before = Clock::now();
+    for (const Item &c : centres) {
+        found.clear();
+        rs.getPresent(c.x, c.y, c.z, items.size(), 1.0f, found);
+        total += found.size();
+    }
+    report(name, items.size(), centres.size(), millis(before), total);
+}
+
+static void bench (size_t n, unsigned queries)
+{
+    // Density similar to clutter: a 30km square, things within 50 to 500m.
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> coord(-15000, 15000), height(0, 200), rad(50, 500);
+    std::vector<Item> items(n);
+    for (Item &i : items) {
+        i.x = coord(rng);
+        i.y = coord(rng);
+        i.z = height(rng);
+        i.r = rad(rng);
+    }
+    std::vector<Item> centres(queries);
+    for (Item &c : centres) {
+        c.x = coord(rng);
+        c.y = coord(rng);
+        c.z = height(rng);
+    }
+
+    {
+        ScalarRS rs;
+        rs.fill(items);
+        std::vector<Item**> found;
+        size_t total = 0;
+        auto before = Clock::now();
+        for (const Item &c : centres) {
+            found.clear();
+            rs.getPresent(c.x, c.y, c.z, n, found);
+            total += found.size();
+        }
+        report("CacheFriendlyRangeSpace", n, queries, millis(before), total);
+    }
+
+    {
+        OldSIMDRS rs;
+        rs.fill(items);
+        run_simd("SIMDVector4 (old)", rs, items, centres);
+    }
+
+    {
+        SIMDRS rs;
+        rs.fill(items);
+        rs.setKernel(range_space_kernel_scalar);
+        run_simd("CacheFriendlyRangeSpaceSIMD scalar", rs, items, centres);
+        #ifdef RANGE_SPACE_X86
+        rs.setKernel(range_space_kernel_sse);
+        run_simd("CacheFriendlyRangeSpaceSIMD SSE", rs, items, centres);
+        if (range_space_cpu_has_avx2()) {
+            rs.setKernel(range_space_kernel_avx2);
+            run_simd("CacheFriendlyRangeSpaceSIMD AVX2", rs, items, centres);
+        }
+        #endif
+    }
+
+    {
+        LooseGridRS rs;
+        rs.fill(items);
+        run_simd("LooseGridRangeSpace", rs, items, centres);
+    }
+}
+
+int main (int argc, char **argv)
+{
+    unsigned queries = argc > 1 ? unsigned(atoi(argv[1])) : 20;
+    if (queries == 0) {
+        fprintf(stderr, "Usage: %s [queries]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    bench(10000, queries);
+    bench(100000, queries);
+    bench(1000000, queries);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* Compares IntrusivePtr, with plain and atomic counts, with the SharedPtr that allocates its
+ * counter separately.
+ *
+ * Usage: bench_refcount [objects]
+ *
+ * The objects are about the size of a GritObject.  Each phase mimics what the engine does with its
+ * handles: create the objects, copy handles to them in a random order (as when Lua code and the
+ * streamer pass them around) while reading a field, and finally drop all the references.  Heap
+ * allocations are counted by replacing the global operator new.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "../intrusive_ptr.h"
+#include "../shared_ptr.h"
+
+static size_t allocations = 0;
+
+void *operator new (size_t sz)
+{
+    allocations++;
+    void *r = malloc(sz == 0 ? 1 : sz);
+    if (r == NULL) throw std::bad_alloc();
+    return r;
+}
+
+void operator delete (void *p) noexcept
+{
+    free(p);
+}
+
+struct Payload {
+    float pos[3];
+    float fade;
+    char other[176];
+    Payload (void) : fade(1) { pos[0] = pos[1] = pos[2] = 0; }
+};
+
+struct PlainObject : Payload { };
+struct IntrusiveObject : Payload, RefCountedBase<false> { };
+struct AtomicObject : Payload, RefCountedBase<true> { };
+
+struct Result {
+    double createMs, copyMs, destroyMs;
+    size_t allocations;
+    float checksum;
+};
+
+template<class Ptr, class T> static Result run (size_t num_objects,
+                                                const std::vector<size_t> &order)
+{
+    Result r;
+    std::vector<Ptr> handles;
+    handles.reserve(num_objects);
+    size_t allocations_before = allocations;
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i=0 ; i<num_objects ; ++i) {
+        handles.push_back(Ptr(new T()));
+        handles.back()->pos[0] = float(i % 7);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    r.allocations = allocations - allocations_before;
+
+    float sum = 0;
+    for (size_t i : order) {
+        Ptr p = handles[i];
+        sum += p->pos[0] * p->fade;
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    handles.clear();
+    auto t3 = std::chrono::steady_clock::now();
+
+    r.createMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    r.copyMs = std::chrono::duration<double, std::milli>(t2 - t1).count();
+    r.destroyMs = std::chrono::duration<double, std::milli>(t3 - t2).count();
+    r.checksum = sum;
+    return r;
+}
+
+static void print (const char *name, const Result &r, size_t num_objects, size_t num_copies)
+{
+    printf("%-22s %4.2f allocs/object  create %6.1f ns  copy+deref %6.1f ns  destroy %6.1f ns\n",
+           name, double(r.allocations) / num_objects, r.createMs * 1e6 / num_objects,
+           r.copyMs * 1e6 / num_copies, r.destroyMs * 1e6 / num_objects);
+}
+
+int main (int argc, char **argv)
+{
+    size_t num_objects = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+    if (num_objects == 0) {
+        fprintf(stderr, "Usage: %s [objects]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<size_t> order;
+    for (int pass=0 ; pass<10 ; ++pass) {
+        for (size_t i=0 ; i<num_objects ; ++i) order.push_back(i);
+    }
+    std::mt19937 rng(42);
+    std::shuffle(order.begin(), order.end(), rng);
+
+    Result shared = run<SharedPtr<PlainObject>, PlainObject>(num_objects, order);
+    Result intrusive = run<IntrusivePtr<IntrusiveObject>, IntrusiveObject>(num_objects, order);
+    Result atomic = run<IntrusivePtr<AtomicObject>, AtomicObject>(num_objects, order);
+
+    printf("%zu objects, %zu handle copies\n", num_objects, order.size());
+    print("SharedPtr:", shared, num_objects, order.size());
+    print("IntrusivePtr, plain:", intrusive, num_objects, order.size());
+    print("IntrusivePtr, atomic:", atomic, num_objects, order.size());
+
+    if (shared.checksum != intrusive.checksum || shared.checksum != atomic.checksum) {
+        fprintf(stderr, "Implementations disagree!\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -20,6 +20,7 @@
  */
 
 template <typename T> class CacheFriendlyRangeSpace;
+template <typename T> class LooseGridRangeSpace;
 
 #ifndef CACHEFRIENDLYRANGESPACE_H
 #define CACHEFRIENDLYRANGESPACE_H
@@ -29,6 +30,8 @@ template <typename T> class CacheFriendlyRangeSpace;
 #include <iostream>
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <unordered_map>
 
 #include <centralised_log.h>
 
@@ -165,4 +168,390 @@ class CacheFriendlyRangeSpace {
 };
 
 
+/** A hierarchy of loose 3D grids, for finding the spheres that contain a given point.
+ *
+ * Each item lives in exactly one cell, chosen from the finest level whose cell
+ * size is at least the item's radius, according to the position of its
+ * centre.  Therefore any sphere containing the query point must have its
+ * centre within cellSize * factor of the query point, so a query only visits
+ * the few cells of each level that overlap that range, rather than the whole
+ * world.  The cells are hashed so that empty space costs nothing.
+ *
+ * The interface matches the range space in cache_friendly_range_space_simd.h, so T must provide
+ * updateIndex(int), and also getIndex() to return it.  Items with radius larger than the coarsest level are kept
+ * in a separate list that is always tested.
+ */
+template <typename T>
+class LooseGridRangeSpace {
+
+    public:
+
+    typedef std::vector<T> Cargo;
+
+
+    protected:
+
+    /** Side length of the cells in the finest level (metres). */
+    static constexpr float MIN_CELL_SIZE = 8.0f;
+
+    /** Each level has cells twice the size of the previous one. */
+    static const int NUM_LEVELS = 16;
+
+    /** Used as the level of items too big for any level. */
+    static const int OVERSIZE = NUM_LEVELS;
+
+    struct Sphere {
+        Sphere (void) : x(0), y(0), z(0), d(0) { }
+        float x, y, z, d;
+    };
+
+    /** Where an item is referenced from, so it can be moved or removed in O(1). */
+    struct Home {
+        Home (void) : level(0), key(0), slot(0) { }
+        int level;
+        uint64_t key;
+        size_t slot;
+    };
+
+    /** Indexes into the dense arrays. */
+    typedef std::vector<size_t> Cell;
+
+    typedef std::unordered_map<uint64_t, Cell> Cells;
+
+    typedef std::vector<Sphere> Spheres;
+    typedef std::vector<Home> Homes;
+
+
+    public:
+
+    LooseGridRangeSpace (void) : hence(0) { }
+
+    ~LooseGridRangeSpace (void) { }
+
+    void reserve (size_t s)
+    {
+        cargo.reserve(s);
+        spheres.reserve(s);
+        homes.reserve(s);
+    }
+
+    void add (const T &o)
+    {
+        // if it's already in there, this is a no-op
+        if (contains(o)) return;
+
+        size_t index = cargo.size();
+        cargo.push_back(o);
+        spheres.push_back(Sphere());
+        homes.push_back(homeFor(spheres[index]));
+        link(index);
+        o->updateIndex(index);
+    }
+
+    inline void updateSphere (size_t index, float x, float y, float z, float d)
+    {
+        Sphere &s = spheres[index];
+        s.x = x;
+        s.y = y;
+        s.z = z;
+        s.d = d;
+        Home h = homeFor(s);
+        const Home &old = homes[index];
+        if (h.level == old.level && h.key == old.key) return;
+        unlink(index);
+        homes[index] = h;
+        link(index);
+    }
+
+    /** Append to found every item whose sphere (scaled by factor) contains
+     * the given point.  At most num items are tested, if that cuts the search
+     * short then the next call resumes from the item after the last one tested, so every item
+     * near the point gets its turn.  found can be any vector of T, e.g. a FrameVector. */
+    template<class Found>
+    void getPresent (const float x,
+                     const float y,
+                     const float z,
+                     size_t num,
+                     const float factor,
+                     Found &found)
+    {
+        if (num == 0) return;
+        if (cargo.size() == 0) return;
+
+        const float factor2 = factor * factor;
+
+        // Gather the cells that may hold a sphere containing the point.  The order changes little
+        // from one call to the next, so a position within it is a good place to resume from.
+        visit.clear();
+        size_t total = 0;
+        if (oversize.size() > 0) {
+            visit.push_back(&oversize);
+            total += oversize.size();
+        }
+
+        for (int level=0 ; level<NUM_LEVELS ; ++level) {
+            Cells &cells = levels[level];
+            if (cells.size() == 0) continue;
+
+            const float size = cellSize(level);
+            const float reach = size * factor;
+            const int x0 = cellCoord(x - reach, size), x1 = cellCoord(x + reach, size);
+            const int y0 = cellCoord(y - reach, size), y1 = cellCoord(y + reach, size);
+            const int z0 = cellCoord(z - reach, size), z1 = cellCoord(z + reach, size);
+            const size_t box = size_t(x1 - x0 + 1) * size_t(y1 - y0 + 1) * size_t(z1 - z0 + 1);
+
+            if (box > cells.size()) {
+                // Sparse level, cheaper to look at what is there than what might be.
+                for (typename Cells::iterator i=cells.begin(), i_=cells.end() ; i != i_ ; ++i) {
+                    visit.push_back(&i->second);
+                    total += i->second.size();
+                }
+                continue;
+            }
+
+            for (int cx=x0 ; cx<=x1 ; ++cx) {
+                for (int cy=y0 ; cy<=y1 ; ++cy) {
+                    for (int cz=z0 ; cz<=z1 ; ++cz) {
+                        typename Cells::iterator i = cells.find(cellKey(cx, cy, cz));
+                        if (i == cells.end()) continue;
+                        visit.push_back(&i->second);
+                        total += i->second.size();
+                    }
+                }
+            }
+        }
+
+        if (total == 0) return;
+        if (num >= total) {
+            num = total;
+            hence = 0;
+        }
+
+        // Find where the last call stopped, then test num items from there, wrapping around.
+        size_t skip = hence % total;
+        size_t c = 0;
+        while (skip >= visit[c]->size()) {
+            skip -= visit[c]->size();
+            c++;
+        }
+        size_t slot = skip;
+        for (size_t n=0 ; n<num ; ++n) {
+            test((*visit[c])[slot], x, y, z, factor2, found);
+            if (++slot == visit[c]->size()) {
+                slot = 0;
+                if (++c == visit.size()) c = 0;
+            }
+        }
+        hence = (hence % total + num) % total;
+    }
+
+    /** Append to found every item whose sphere (scaled by factor) touches the
+     * segment from a to b.  Unlike getPresent, there is no limit on the number
+     * of tests, but only the cells near the segment are visited. */
+    template<class Found>
+    void getPresentAlong (const float ax, const float ay, const float az,
+                          const float bx, const float by, const float bz,
+                          const float factor,
+                          Found &found)
+    {
+        if (cargo.size() == 0) return;
+
+        const float factor2 = factor * factor;
+        const float ex = bx - ax, ey = by - ay, ez = bz - az;
+        const float len = std::sqrt(ex*ex + ey*ey + ez*ez);
+
+        for (size_t i=0 ; i<oversize.size() ; ++i) {
+            testAlong(oversize[i], ax, ay, az, ex, ey, ez, factor2, found);
+        }
+
+        for (int level=0 ; level<NUM_LEVELS ; ++level) {
+            Cells &cells = levels[level];
+            if (cells.size() == 0) continue;
+
+            // Visit the cells near each piece of the segment, one cell long.
+            const float size = cellSize(level);
+            const float reach = size * factor;
+            const int pieces = 1 + int(len / size);
+            keys.clear();
+            for (int p=0 ; p<pieces && keys.size()<=cells.size() ; ++p) {
+                float t0 = float(p) / pieces, t1 = float(p + 1) / pieces;
+                float x0 = ax + ex*t0, y0 = ay + ey*t0, z0 = az + ez*t0;
+                float x1 = ax + ex*t1, y1 = ay + ey*t1, z1 = az + ez*t1;
+                const int cx0 = cellCoord(std::min(x0, x1) - reach, size);
+                const int cx1 = cellCoord(std::max(x0, x1) + reach, size);
+                const int cy0 = cellCoord(std::min(y0, y1) - reach, size);
+                const int cy1 = cellCoord(std::max(y0, y1) + reach, size);
+                const int cz0 = cellCoord(std::min(z0, z1) - reach, size);
+                const int cz1 = cellCoord(std::max(z0, z1) + reach, size);
+                for (int cx=cx0 ; cx<=cx1 ; ++cx) {
+                    for (int cy=cy0 ; cy<=cy1 ; ++cy) {
+                        for (int cz=cz0 ; cz<=cz1 ; ++cz) {
+                            keys.push_back(cellKey(cx, cy, cz));
+                        }
+                    }
+                }
+            }
+
+            if (keys.size() > cells.size()) {
+                // Sparse level, cheaper to look at what is there than what might be.
+                for (typename Cells::iterator i=cells.begin(), i_=cells.end() ; i != i_ ; ++i) {
+                    const Cell &cell = i->second;
+                    for (size_t j=0 ; j<cell.size() ; ++j)
+                        testAlong(cell[j], ax, ay, az, ex, ey, ez, factor2, found);
+                }
+                continue;
+            }
+
+            // Neighbouring pieces overlap.
+            std::sort(keys.begin(), keys.end());
+            keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+            for (size_t k=0 ; k<keys.size() ; ++k) {
+                typename Cells::iterator i = cells.find(keys[k]);
+                if (i == cells.end()) continue;
+                const Cell &cell = i->second;
+                for (size_t j=0 ; j<cell.size() ; ++j)
+                    testAlong(cell[j], ax, ay, az, ex, ey, ez, factor2, found);
+            }
+        }
+    }
+
+    void remove (const T &o)
+    {
+        // no-op if o was not in the rangespace somewhere
+        if (!contains(o)) return;
+
+        // otherwise, carefully remove it -
+        size_t index = o->getIndex();
+        size_t last = cargo.size() - 1;
+
+        unlink(index);
+        if (index != last) {
+            // the last item takes the place of the removed one, so fix its cell's reference
+            cellOf(homes[last])[homes[last].slot] = index;
+            spheres[index] = spheres[last];
+            homes[index] = homes[last];
+            cargo[index] = cargo[last];
+            cargo[index]->updateIndex(index);
+        }
+        spheres.pop_back();
+        homes.pop_back();
+        cargo.pop_back();
+        o->updateIndex(-1);
+    }
+
+    void clear (void)
+    {
+        cargo.clear();
+        spheres.clear();
+        homes.clear();
+        oversize.clear();
+        for (int l=0 ; l<NUM_LEVELS ; ++l) levels[l].clear();
+        hence = 0;
+    }
+
+    size_t size (void) const { return cargo.size(); }
+
+
+    protected:
+
+    /** Uses the index the item was told about, rather than searching. */
+    bool contains (const T &o) const
+    {
+        int index = o->getIndex();
+        return index >= 0 && size_t(index) < cargo.size() && cargo[index] == o;
+    }
+
+    static float cellSize (int level) { return MIN_CELL_SIZE * float(1 << level); }
+
+    static int cellCoord (float v, float size) { return int(std::floor(v / size)); }
+
+    /** 21 bits per axis.  Distant cells may alias, which only costs a few extra tests. */
+    static uint64_t cellKey (int cx, int cy, int cz)
+    {
+        const uint64_t mask = (uint64_t(1) << 21) - 1;
+        return (uint64_t(cx) & mask) | ((uint64_t(cy) & mask) << 21) | ((uint64_t(cz) & mask) << 42);
+    }
+
+    static Home homeFor (const Sphere &s)
+    {
+        Home h;
+        h.level = 0;
+        while (h.level < NUM_LEVELS && cellSize(h.level) < s.d) h.level++;
+        if (h.level == OVERSIZE) return h;
+        const float size = cellSize(h.level);
+        h.key = cellKey(cellCoord(s.x, size), cellCoord(s.y, size), cellCoord(s.z, size));
+        return h;
+    }
+
+    Cell &cellOf (const Home &h)
+    {
+        if (h.level == OVERSIZE) return oversize;
+        return levels[h.level][h.key];
+    }
+
+    void link (size_t index)
+    {
+        Home &h = homes[index];
+        Cell &cell = cellOf(h);
+        h.slot = cell.size();
+        cell.push_back(index);
+    }
+
+    void unlink (size_t index)
+    {
+        const Home &h = homes[index];
+        Cell &cell = cellOf(h);
+        size_t moved = cell[cell.size() - 1];
+        cell[h.slot] = moved;
+        homes[moved].slot = h.slot;
+        cell.pop_back();
+        if (cell.size() == 0 && h.level != OVERSIZE) levels[h.level].erase(h.key);
+    }
+
+    template<class Found>
+    inline void test (size_t index, float x, float y, float z, float factor2, Found &found)
+    {
+        const Sphere &s = spheres[index];
+        float dx = s.x - x;
+        float dy = s.y - y;
+        float dz = s.z - z;
+        if (dx*dx + dy*dy + dz*dz < s.d * s.d * factor2) {
+            found.push_back(cargo[index]);
+        }
+    }
+
+    /** Test against the segment from a to a+e. */
+    template<class Found>
+    inline void testAlong (size_t index, float ax, float ay, float az,
+                           float ex, float ey, float ez, float factor2, Found &found)
+    {
+        const Sphere &s = spheres[index];
+        float px = s.x - ax;
+        float py = s.y - ay;
+        float pz = s.z - az;
+        // closest point on the segment
+        float len2 = ex*ex + ey*ey + ez*ez;
+        float t = len2 > 0 ? (px*ex + py*ey + pz*ez) / len2 : 0;
+        t = std::max(0.0f, std::min(1.0f, t));
+        float dx = px - t*ex;
+        float dy = py - t*ey;
+        float dz = pz - t*ez;
+        if (dx*dx + dy*dy + dz*dz < s.d * s.d * factor2) {
+            found.push_back(cargo[index]);
+        }
+    }
+
+    size_t hence;
+    Spheres spheres;
+    Homes homes;
+    Cargo cargo;
+    Cells levels[NUM_LEVELS];
+    Cell oversize;
+    /** Scratch space for getPresent. */
+    std::vector<const Cell*> visit;
+    /** Scratch space for getPresentAlong. */
+    std::vector<uint64_t> keys;
+};
+
+
 #endif
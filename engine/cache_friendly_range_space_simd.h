@@ -24,134 +24,174 @@ template <typename T> class CacheFriendlyRangeSpaceSIMD;
 #ifndef CACHEFRIENDLYRANGESPACESIMD_H
 #define CACHEFRIENDLYRANGESPACESIMD_H
 
-#include <map>
+#include <cstdint>
 #include <vector>
-#include <iostream>
 #include <algorithm>
-#include <cmath>
 
-#ifdef WIN32
-#include <xmmintrin.h>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define RANGE_SPACE_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 #endif
 
-#include <centralised_log.h>
-
-#include "sse_allocator.h"
-
-class SIMDVector4 {
-
-    protected:
-
-    union U {
-        struct Raw {
-            float x, y, z, d;
-        } raw;
-        #ifdef WIN32
-        __m128 simd;
-        #else
-        float simd __attribute__ ((vector_size (16)));
-        #endif
-    };
-
-
-    public:
-
-    inline void updateAll (float x, float y, float z, float d)
-    {
-        u.raw.x = x;
-        u.raw.y = y;
-        u.raw.z = z;
-        u.raw.d = d;
-    }
-
-    inline float x(void) const { return u.raw.x; }
-    inline float y(void) const { return u.raw.y; }
-    inline float z(void) const { return u.raw.z; }
-    inline float d(void) const { return u.raw.d; }
+// GCC and clang need to be told which functions may use AVX2, as the rest of the program may be
+// compiled for an older CPU.  MSVC allows intrinsics anywhere.
+#if defined(RANGE_SPACE_X86) && !defined(_MSC_VER)
+#define RANGE_SPACE_TARGET_AVX2 __attribute__((target("avx2")))
+#define RANGE_SPACE_TARGET_SSE __attribute__((target("sse2")))
+#else
+#define RANGE_SPACE_TARGET_AVX2
+#define RANGE_SPACE_TARGET_SSE
+#endif
 
-    SIMDVector4 operator- (const SIMDVector4 &b) const
-    {
-        SIMDVector4 r;
-        #ifdef WIN32
-        r.u.simd = _mm_sub_ps(u.simd, b.u.simd);
-        #else
-        r.u.simd = u.simd - b.u.simd;
-        #endif
-        return r;
+/** A kernel for the range space sphere test.  Considers spheres [begin, end) of the given arrays
+ * and writes the index of each sphere containing the point (x, y, z) to out, after scaling the
+ * radius d by sqrt(factor2).  Returns the number of indexes written.
+ */
+typedef size_t RangeSpaceKernel (const float *xs, const float *ys, const float *zs,
+                                 const float *ds, size_t begin, size_t end,
+                                 float x, float y, float z, float factor2, uint32_t *out);
+
+static inline size_t range_space_kernel_scalar (const float *xs, const float *ys, const float *zs,
+                                                const float *ds, size_t begin, size_t end,
+                                                float x, float y, float z, float factor2,
+                                                uint32_t *out)
+{
+    size_t counter = 0;
+    for (size_t i=begin ; i<end ; ++i) {
+        float dx = x - xs[i], dy = y - ys[i], dz = z - zs[i];
+        if (dx*dx + dy*dy + dz*dz < ds[i]*ds[i] * factor2) out[counter++] = uint32_t(i);
     }
-
-    SIMDVector4 operator* (const SIMDVector4 &b) const
-    {
-        SIMDVector4 r;
-        #ifdef WIN32
-        r.u.simd = _mm_mul_ps(u.simd, b.u.simd);
-        #else
-        r.u.simd = u.simd * b.u.simd;
-        #endif
-        return r;
+    return counter;
+}
+
+#ifdef RANGE_SPACE_X86
+
+static inline unsigned range_space_ctz (unsigned mask)
+{
+    #ifdef _MSC_VER
+    unsigned long r;
+    _BitScanForward(&r, mask);
+    return r;
+    #else
+    return __builtin_ctz(mask);
+    #endif
+}
+
+RANGE_SPACE_TARGET_SSE
+static inline size_t range_space_kernel_sse (const float *xs, const float *ys, const float *zs,
+                                             const float *ds, size_t begin, size_t end,
+                                             float x, float y, float z, float factor2,
+                                             uint32_t *out)
+{
+    size_t counter = 0;
+    const __m128 cx = _mm_set1_ps(x), cy = _mm_set1_ps(y), cz = _mm_set1_ps(z);
+    const __m128 f2 = _mm_set1_ps(factor2);
+    size_t i = begin;
+    for ( ; i+4 <= end ; i+=4) {
+        __m128 dx = _mm_sub_ps(cx, _mm_loadu_ps(xs + i));
+        __m128 dy = _mm_sub_ps(cy, _mm_loadu_ps(ys + i));
+        __m128 dz = _mm_sub_ps(cz, _mm_loadu_ps(zs + i));
+        __m128 d = _mm_loadu_ps(ds + i);
+        __m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                                  _mm_mul_ps(dz, dz));
+        unsigned mask = _mm_movemask_ps(_mm_cmplt_ps(dist2, _mm_mul_ps(_mm_mul_ps(d, d), f2)));
+        while (mask) {
+            out[counter++] = uint32_t(i + range_space_ctz(mask));
+            mask &= mask - 1;
+        }
     }
-    SIMDVector4 &operator*= (SIMDVector4 &b)
-    {
-        *this = *this * b;
-        return *this;
+    return counter + range_space_kernel_scalar(xs, ys, zs, ds, i, end, x, y, z, factor2,
+                                               out + counter);
+}
+
+RANGE_SPACE_TARGET_AVX2
+static inline size_t range_space_kernel_avx2 (const float *xs, const float *ys, const float *zs,
+                                              const float *ds, size_t begin, size_t end,
+                                              float x, float y, float z, float factor2,
+                                              uint32_t *out)
+{
+    size_t counter = 0;
+    const __m256 cx = _mm256_set1_ps(x), cy = _mm256_set1_ps(y), cz = _mm256_set1_ps(z);
+    const __m256 f2 = _mm256_set1_ps(factor2);
+    size_t i = begin;
+    for ( ; i+8 <= end ; i+=8) {
+        __m256 dx = _mm256_sub_ps(cx, _mm256_loadu_ps(xs + i));
+        __m256 dy = _mm256_sub_ps(cy, _mm256_loadu_ps(ys + i));
+        __m256 dz = _mm256_sub_ps(cz, _mm256_loadu_ps(zs + i));
+        __m256 d = _mm256_loadu_ps(ds + i);
+        // No FMA, so the results are identical to the other kernels.
+        __m256 dist2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                     _mm256_mul_ps(dz, dz));
+        __m256 lim = _mm256_mul_ps(_mm256_mul_ps(d, d), f2);
+        unsigned mask = _mm256_movemask_ps(_mm256_cmp_ps(dist2, lim, _CMP_LT_OQ));
+        while (mask) {
+            out[counter++] = uint32_t(i + range_space_ctz(mask));
+            mask &= mask - 1;
+        }
     }
+    return counter + range_space_kernel_scalar(xs, ys, zs, ds, i, end, x, y, z, factor2,
+                                               out + counter);
+}
+
+static inline bool range_space_cpu_has_avx2 (void)
+{
+    #ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    // The OS must also save the AVX registers.
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+    #else
+    return __builtin_cpu_supports("avx2");
+    #endif
+}
 
-     protected:
-
-    U u;
-};
-
-// msvc needs a horrible wrapper class because it can't handle aligned parameters
-// thus operations like resize() and push_back() cause compile errors
-#ifdef WIN32
-class SIMDVector4s {
-
-    public:
-
-    struct Stupid { float x, y, z, d; };
-    typedef std::vector<Stupid,SSEAllocator<Stupid> > Wrapped;
-    typedef Wrapped::size_type size_type;
-
-    void pop_back (void) { wrapped.pop_back(); }
-
-    void push_back (const SIMDVector4 &v)
-    { wrapped.push_back(reinterpret_cast<const Stupid&>(v)); }
-
-    void clear (void) { wrapped.clear(); }
-
-    SIMDVector4 &operator[] (size_type index)
-    { return reinterpret_cast<SIMDVector4&>(wrapped[index]); }
-
-    const SIMDVector4 &operator[] (size_type index) const
-    { return reinterpret_cast<const SIMDVector4&>(wrapped[index]); }
-
-    Wrapped::size_type size (void) const { return wrapped.size(); }
-
-    void reserve (size_t s) { wrapped.reserve(s); }
-
-
-    protected:
-    Wrapped wrapped;
-};
-#else
-typedef std::vector<SIMDVector4,SSEAllocator<SIMDVector4> > SIMDVector4s;
 #endif
 
+/** The best kernel for this CPU, chosen on first use. */
+static inline RangeSpaceKernel *range_space_kernel (void)
+{
+    #ifdef RANGE_SPACE_X86
+    static RangeSpaceKernel *k = range_space_cpu_has_avx2() ? range_space_kernel_avx2
+                                                              : range_space_kernel_sse;
+    return k;
+    #else
+    return range_space_kernel_scalar;
+    #endif
+}
+
+
+/** Spheres stored as a structure of arrays, searched (a window at a time) with SSE or AVX2
+ * depending on the CPU.
+ */
 template <typename T>
-class CacheFriendlyRangeSpace {
+class CacheFriendlyRangeSpaceSIMD {
 
     public:
 
     typedef std::vector<T> Cargo;
 
-    CacheFriendlyRangeSpace (void) : hence(0) { }
+    CacheFriendlyRangeSpaceSIMD (void) : hence(0), kernel(range_space_kernel()) { }
+
+    ~CacheFriendlyRangeSpaceSIMD (void) { }
 
-    ~CacheFriendlyRangeSpace (void) { }
+    /** Override the kernel chosen for this CPU, e.g. for benchmarking. */
+    void setKernel (RangeSpaceKernel *k) { kernel = k; }
 
     void reserve (size_t s)
     {
         cargo.reserve(s);
-        positions.reserve(s);
+        xs.reserve(s);
+        ys.reserve(s);
+        zs.reserve(s);
+        ds.reserve(s);
     }
 
     void add (const T &o)
@@ -163,27 +203,19 @@ class CacheFriendlyRangeSpace {
         
         size_t index = cargo.size();
         cargo.push_back(o);
-        positions.push_back(SIMDVector4());
+        xs.push_back(0);
+        ys.push_back(0);
+        zs.push_back(0);
+        ds.push_back(0);
         o->updateIndex(index);
     }
 
     inline void updateSphere (size_t index, float x, float y, float z, float d)
     {
-        positions[index].updateAll(x,y,z,d);
-    }
-
-    // only meaningful if the radius is stored in pos.d and
-    // other.d is 0, thus the subtraction and squaring
-    // yields d^2
-    static inline bool isNear (const SIMDVector4 &pos,
-                               const SIMDVector4 &centre,
-                               const float factor2)
-    {
-        SIMDVector4 diff;
-        diff = pos - centre;
-        diff *= diff;
-        return diff.x() + diff.y() + diff.z()
-            < diff.d() * factor2;
+        xs[index] = x;
+        ys[index] = y;
+        zs[index] = z;
+        ds[index] = d;
     }
 
     void getPresent (const float x,
@@ -198,27 +230,22 @@ class CacheFriendlyRangeSpace {
         if (num>cargo.size()) num=cargo.size();
         if (hence>=cargo.size()) hence = 0;
 
-        // iterate from this point for a while
-        SIMDVector4s::size_type iter = hence, end = positions.size();        
-
-        if (num>positions.size()) {
-            iter = 0;
-            num = positions.size();
-        }
-
-        SIMDVector4 home;
+        // iterate from this point for a while, wrapping around at the end
         float factor2 = factor*factor;
-        home.updateAll(x,y,z,0);
-        for (SIMDVector4s::size_type i=0 ; i<num ; ++i) {
-            SIMDVector4 &pos = positions[iter];
-            if (isNear(home,pos,factor2)) {
-                found.push_back(cargo[iter]);
-            }
-            iter++;
-            if (iter == end) iter=0;
+        size_t first_end = std::min(cargo.size(), hence + num);
+        size_t rest = num - (first_end - hence);
+        hits.resize(num);
+        size_t counter = kernel(xs.data(), ys.data(), zs.data(), ds.data(), hence, first_end,
+                                x, y, z, factor2, hits.data());
+        // counter may equal num here, so do not index hits with it.
+        counter += kernel(xs.data(), ys.data(), zs.data(), ds.data(), 0, rest,
+                          x, y, z, factor2, hits.data() + counter);
+        for (size_t i=0 ; i<counter ; ++i) {
+            found.push_back(cargo[hits[i]]);
         }
 
-        hence = iter;
+        hence = rest > 0 ? rest : first_end;
+        if (hence == cargo.size()) hence = 0;
     }
 
     void remove (const T &o)
@@ -232,10 +259,17 @@ class CacheFriendlyRangeSpace {
 
         // otherwise, carefully remove it -
         size_t index = iter - begin;
-
-        positions[index] = positions[positions.size()-1];
-        positions.pop_back();
-        cargo[index] = cargo[cargo.size()-1];
+        size_t last = cargo.size() - 1;
+
+        xs[index] = xs[last];
+        ys[index] = ys[last];
+        zs[index] = zs[last];
+        ds[index] = ds[last];
+        xs.pop_back();
+        ys.pop_back();
+        zs.pop_back();
+        ds.pop_back();
+        cargo[index] = cargo[last];
         cargo[index]->updateIndex(index);
         cargo.pop_back();
         o->updateIndex(-1);
@@ -244,7 +278,10 @@ class CacheFriendlyRangeSpace {
     void clear (void)
     {
         cargo.clear();
-        positions.clear();
+        xs.clear();
+        ys.clear();
+        zs.clear();
+        ds.clear();
         hence = 0;
     }
 
@@ -254,7 +291,10 @@ class CacheFriendlyRangeSpace {
     protected:
 
     size_t hence;
-    SIMDVector4s positions;
+    RangeSpaceKernel *kernel;
+    std::vector<float> xs, ys, zs, ds;
+    /** Scratch space for the kernel's output. */
+    std::vector<uint32_t> hits;
     Cargo cargo;
 };
 
@@ -19,7 +19,12 @@
  * THE SOFTWARE.
  */
 
+#include <algorithm>
+#include <thread>
+
 #include "core_option.h"
+#include "job_system.h"
+#include "main.h"
 #include "streamer.h"
 
 static CoreBoolOption option_keys_bool[] = {
@@ -31,12 +36,15 @@ static CoreFloatOption option_keys_float[] = {
     CORE_VISIBILITY,
     CORE_PREPARE_DISTANCE_FACTOR,
     CORE_FADE_OUT_FACTOR,
-    CORE_FADE_OVERLAP_FACTOR
+    CORE_FADE_OVERLAP_FACTOR,
+    CORE_LOOKAHEAD_DISTANCE
 };
 
 static CoreIntOption option_keys_int[] = {
     CORE_STEP_SIZE,
-    CORE_RAM
+    CORE_RAM,
+    CORE_LOADER_THREADS,
+    CORE_JOB_THREADS
 };
 
 
@@ -72,6 +80,8 @@ std::string core_option_to_string (CoreIntOption o)
     switch (o) {
         case CORE_STEP_SIZE: return "STEP_SIZE";
         case CORE_RAM: return "RAM";
+        case CORE_LOADER_THREADS: return "LOADER_THREADS";
+        case CORE_JOB_THREADS: return "JOB_THREADS";
     }   
     return "UNKNOWN_INT_OPTION";
 }
@@ -82,6 +92,7 @@ std::string core_option_to_string (CoreFloatOption o)
         case CORE_PREPARE_DISTANCE_FACTOR: return "PREPARE_DISTANCE_FACTOR";
         case CORE_FADE_OUT_FACTOR: return "FADE_OUT_FACTOR";
         case CORE_FADE_OVERLAP_FACTOR: return "FADE_OVERLAP_FACTOR";
+        case CORE_LOOKAHEAD_DISTANCE: return "LOOKAHEAD_DISTANCE";
     }   
     return "UNKNOWN_FLOAT_OPTION";
 }
@@ -97,11 +108,14 @@ void core_option_from_string (const std::string &s,
 
     else if (s == "STEP_SIZE") { t = 1 ; o1 = CORE_STEP_SIZE; }
     else if (s == "RAM") { t = 1 ; o1 = CORE_RAM; }
+    else if (s == "LOADER_THREADS") { t = 1 ; o1 = CORE_LOADER_THREADS; }
+    else if (s == "JOB_THREADS") { t = 1 ; o1 = CORE_JOB_THREADS; }
 
     else if (s == "VISIBILITY") { t = 2 ; o2 = CORE_VISIBILITY; }
     else if (s == "PREPARE_DISTANCE_FACTOR") { t = 2 ; o2 = CORE_PREPARE_DISTANCE_FACTOR; }
     else if (s == "FADE_OUT_FACTOR") { t = 2 ; o2 = CORE_FADE_OUT_FACTOR; }
     else if (s == "FADE_OVERLAP_FACTOR") { t = 2 ; o2 = CORE_FADE_OVERLAP_FACTOR; }
+    else if (s == "LOOKAHEAD_DISTANCE") { t = 2 ; o2 = CORE_LOOKAHEAD_DISTANCE; }
 
     else t = -1;
 }
@@ -131,6 +145,12 @@ static void options_update (bool flush)
             case CORE_STEP_SIZE:
             case CORE_RAM:
             break;
+            case CORE_LOADER_THREADS:
+            bgl->setNumThreads(v_new);
+            break;
+            case CORE_JOB_THREADS:
+            job_system_set_num_threads(v_new);
+            break;
         }
     }
     for (unsigned i=0 ; i<sizeof(option_keys_float)/sizeof(*option_keys_float) ; ++i) {
@@ -151,6 +171,9 @@ static void options_update (bool flush)
             case CORE_FADE_OVERLAP_FACTOR:
             streamer_fade_overlap_factor = v_new;
             break;
+            case CORE_LOOKAHEAD_DISTANCE:
+            streamer_lookahead_distance = v_new;
+            break;
         }
     }
 
@@ -166,11 +189,18 @@ void core_option_reset (void)
 
     core_option(CORE_STEP_SIZE, 20000);
     core_option(CORE_RAM, 1024); // 1GB
+    // Leave some cores for the frame loop and the graphics driver.
+    unsigned cores = std::thread::hardware_concurrency();
+    unsigned loaders = std::max(1u, std::min(4u, cores / 2));
+    core_option(CORE_LOADER_THREADS, loaders);
+    // The main thread runs jobs too, while it waits for them, and the loaders have their own cores.
+    core_option(CORE_JOB_THREADS, cores > loaders + 1 ? cores - loaders - 1 : 0);
 
     core_option(CORE_VISIBILITY, 1.0f);
     core_option(CORE_PREPARE_DISTANCE_FACTOR, 1.3f);
     core_option(CORE_FADE_OUT_FACTOR, 0.7f);
     core_option(CORE_FADE_OVERLAP_FACTOR, 0.7f);
+    core_option(CORE_LOOKAHEAD_DISTANCE, 200.0f);
 }
 
 
@@ -182,11 +212,14 @@ void core_option_init (void)
 
     valid_option(CORE_STEP_SIZE, new ValidOptionRange<int>(0, 20000));
     valid_option(CORE_RAM, new ValidOptionRange<int>(0, 1024*1024)); // 1TB
+    valid_option(CORE_LOADER_THREADS, new ValidOptionRange<int>(1, 64));
+    valid_option(CORE_JOB_THREADS, new ValidOptionRange<int>(0, 64));
 
     valid_option(CORE_VISIBILITY, new ValidOptionRange<float>(0, 10));
     valid_option(CORE_PREPARE_DISTANCE_FACTOR, new ValidOptionRange<float>(1, 3));
     valid_option(CORE_FADE_OUT_FACTOR, new ValidOptionRange<float>(0, 1));
     valid_option(CORE_FADE_OVERLAP_FACTOR, new ValidOptionRange<float>(0, 1));
+    valid_option(CORE_LOOKAHEAD_DISTANCE, new ValidOptionRange<float>(0, 10000));
 
 
     core_option(CORE_AUTOUPDATE, false);
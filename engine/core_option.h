@@ -49,14 +49,23 @@ enum CoreFloatOption {
     CORE_FADE_OUT_FACTOR,
 
     /** The proportion of rendering distance at which fading to the next lod level begins. */
-    CORE_FADE_OVERLAP_FACTOR
+    CORE_FADE_OVERLAP_FACTOR,
+
+    /** How far ahead (in metres) of a moving player to start background loading the disk
+     * resources of objects along the predicted path.  0 disables prefetching. */
+    CORE_LOOKAHEAD_DISTANCE
 };
 
 enum CoreIntOption {
-    /** The number of objects per frame considered for streaming in. */
+    /** The maximum number of objects per frame considered for streaming in.  Only objects
+     * whose grid cells are near the player are considered at all. */
     CORE_STEP_SIZE,
     /** The number of megabytes of host RAM to use for cached disk resources. */
-    CORE_RAM
+    CORE_RAM,
+    /** The number of background threads loading disk resources. */
+    CORE_LOADER_THREADS,
+    /** The number of worker threads running jobs, in addition to the main thread. */
+    CORE_JOB_THREADS
 };
 
 /** Returns the enum value of the option described by s.  Only one of o0, o1,
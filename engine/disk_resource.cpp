@@ -21,117 +21,164 @@
 
 
 #include "core_option.h"
+#include "frame_profiler.h"
 #include "main.h"
 
-#include "gfx/gfx_disk_resource.h"
-
-#include "audio/audio_disk_resource.h"
-#include "physics/collision_mesh.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 
 bool disk_resource_foreground_warnings = true;
 bool disk_resource_verbose_loads = false;
 bool disk_resource_verbose_incs = false;
 
-// should map nothing to NULL
-typedef std::map<std::string, DiskResource*> DiskResourceMap;
-DiskResourceMap disk_resource_map;
+/** Every disk resource, keyed by name in an open addressing (linear probing) hash table.  The
+ * names are not copied, as each resource already owns its name.  Resources are never removed.
+ * Loader threads add dependencies while the main thread looks things up, so every access takes
+ * the lock.
+ */
+class DiskResourceRegistry {
+
+    struct Slot {
+        size_t hash;
+        DiskResource *dr;  // NULL if the slot is empty
+    };
+
+    /** Size is always a power of 2, and at most half full. */
+    std::vector<Slot> slots;
+
+    /** In order of creation. */
+    DiskResources all;
+
+    mutable std::mutex lock;
+
+    static size_t hash (const std::string &name)
+    {
+        // FNV-1a
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i=0 ; i<name.length() ; ++i) {
+            h ^= (unsigned char)name[i];
+            h *= 1099511628211ULL;
+        }
+        return size_t(h);
+    }
+
+    /** The slot holding the given name, or the empty slot where it would go. */
+    size_t probe (const std::string &name, size_t h) const
+    {
+        size_t mask = slots.size() - 1;
+        for (size_t i=h&mask ; ; i=(i+1)&mask) {
+            const Slot &s = slots[i];
+            if (s.dr == NULL) return i;
+            if (s.hash == h && s.dr->getName() == name) return i;
+        }
+    }
+
+    void grow (void)
+    {
+        std::vector<Slot> old(slots.size() * 2, Slot{0, NULL});
+        old.swap(slots);
+        for (const Slot &s : old) {
+            if (s.dr == NULL) continue;
+            slots[probe(s.dr->getName(), s.hash)] = s;
+        }
+    }
+
+    public:
+
+    DiskResourceRegistry (void) : slots(1024, Slot{0, NULL}) { }
+
+    DiskResource *find (const std::string &name) const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return slots[probe(name, hash(name))].dr;
+    }
+
+    /** Make the resource with disk_resource_make if it is not already in the registry.  The
+     * lock is held throughout, so two threads cannot make the same resource. */
+    DiskResource *findOrMake (const std::string &name)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        size_t h = hash(name);
+        DiskResource *existing = slots[probe(name, h)].dr;
+        if (existing != NULL) return existing;
+        DiskResource *dr = disk_resource_make(name);
+        if (2 * (all.size() + 1) > slots.size()) grow();
+        Slot &s = slots[probe(name, h)];
+        s.hash = h;
+        s.dr = dr;
+        all.push_back(dr);
+        return dr;
+    }
+
+    size_t size (void) const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return all.size();
+    }
+
+    /** A copy, as other threads may add to it. */
+    DiskResources getAll (void) const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return all;
+    }
+};
+
+static DiskResourceRegistry disk_resource_registry;
+
+std::mutex disk_resource_ogre_lock;
+
+// Maintained by load / unload.
+static std::atomic<int> disk_resource_loaded_count(0);
+
+// Updated from the background loader threads.
+static std::atomic<size_t> host_ram_bytes(0);
+
+static bool disk_resource_name_less (const DiskResource *a, const DiskResource *b)
+{
+    return a->getName() < b->getName();
+}
 
 bool disk_resource_has (const std::string &n)
 {
     if (n[0] != '/') EXCEPT << "Path must be absolute: \"" << n << "\"" << ENDL;
-    DiskResourceMap::iterator it = disk_resource_map.find(n);
-    if (it == disk_resource_map.end()) return false;
-    return true;
+    return disk_resource_registry.find(n) != NULL;
 }
 
 unsigned long disk_resource_num (void)
 {
-    return disk_resource_map.size();
+    return disk_resource_registry.size();
 }
 
 int disk_resource_num_loaded (void)
 {
-    int r = 0;
-    DiskResourceMap &m = disk_resource_map;
-    for (DiskResourceMap::iterator i=m.begin(), i_=m.end() ; i != i_ ; ++i) {
-        if (i->second->isLoaded()) r++;
-    }
-    return r;
+    return disk_resource_loaded_count;
 }
 
 DiskResources disk_resource_all (void)
 {
-    DiskResources r;
-    DiskResourceMap &m = disk_resource_map;
-    for (DiskResourceMap::iterator i=m.begin(), i_=m.end() ; i != i_ ; ++i) {
-        r.push_back(i->second);
-    }
+    DiskResources r = disk_resource_registry.getAll();
+    std::sort(r.begin(), r.end(), disk_resource_name_less);
     return r;
 }
 
 DiskResources disk_resource_all_loaded (void)
 {
     DiskResources r;
-    DiskResourceMap &m = disk_resource_map;
-    for (DiskResourceMap::iterator i=m.begin(), i_=m.end() ; i != i_ ; ++i) {
-        if (i->second->isLoaded())
-            r.push_back(i->second);
+    const DiskResources all = disk_resource_registry.getAll();
+    for (DiskResources::const_iterator i=all.begin(), i_=all.end() ; i != i_ ; ++i) {
+        if ((*i)->isLoaded())
+            r.push_back(*i);
     }
+    std::sort(r.begin(), r.end(), disk_resource_name_less);
     return r;
 }
  
-static bool ends_with (const std::string &str, const std::string &snippet)
-{
-    if (snippet.length() > str.length()) return false;
-    return str.substr(str.length() - snippet.length()) == snippet;
-}
-
 DiskResource *disk_resource_get_or_make (const std::string &rn)
 {
-    if (disk_resource_has(rn))
-        return disk_resource_map[rn];
-
-    size_t pos = rn.rfind('.');
-    if (pos == rn.npos) {
-        EXCEPT << "Disk resource \"" << rn << "\" does not have a file extension." << ENDL;
-    }
-    std::string suffix(rn, pos + 1);
-
-    const char *texture_formats[] = { "jpg", "png", "tga", "tiff", "hdr", "dds" };
-    unsigned num_texture_formats = sizeof(texture_formats)/sizeof(*texture_formats);
-
-    DiskResource *dr = nullptr;
-    if (suffix == "mesh") {
-        dr = new GfxMeshDiskResource(rn);
-    } else if (suffix == "tcol" || suffix == "gcol" || suffix == "bcol") {
-        dr = new CollisionMesh(rn);
-    } else if (suffix == "wav" || suffix == "ogg" || suffix == "mp3") {
-        dr = new AudioDiskResource(rn);
-    } else if (ends_with(rn, ".envcube.tiff")) {
-        dr = new GfxEnvCubeDiskResource(rn);
-    } else if (ends_with(rn, ".lut.png")) {
-        dr = new GfxColourGradeLUTDiskResource(rn);
-    } else if (ends_with(rn, ".lut.tiff")) {
-        dr = new GfxColourGradeLUTDiskResource(rn);
-    } else {
-        for (unsigned i=0 ; i<num_texture_formats ; ++i) {
-            if (suffix == texture_formats[i]) {
-                dr = new GfxTextureDiskResource(rn);
-                break;
-            }
-        }
-    }
-    if (dr == NULL) {
-        std::stringstream ss;
-        for (unsigned i=0 ; i<num_texture_formats ; ++i) {
-            if (i>0) ss << ", ";
-            ss << texture_formats[i];
-        }
-        GRIT_EXCEPT("Ignoring resource \"" + rn + "\" as "
-                    "its file extension was not recognised.  Recognised extensions: " + ss.str());
-    }
-    disk_resource_map[rn] = dr;
-    return dr;
+    if (rn[0] != '/') EXCEPT << "Path must be absolute: \"" << rn << "\"" << ENDL;
+    return disk_resource_registry.findOrMake(rn);
 }
 
 void DiskResource::callReloadWatchers (void) const
@@ -150,21 +197,27 @@ void DiskResource::reload (void)
     callReloadWatchers();
 }
 
-void DiskResource::load (void)
+bool DiskResource::load (void)
 {
-    APP_ASSERT(!loaded);
+    FRAME_PROFILER_ZONE("DiskResource::load");
+    std::lock_guard<std::mutex> guard(loadLock);
+    // another thread may have got here first
+    if (loaded) return false;
 
     loadImpl();
 
     if (disk_resource_verbose_loads)
             CVERB << "LOAD " << getName() << std::endl;
     loaded = true;
+    disk_resource_loaded_count++;
 
     callReloadWatchers();
+    return true;
 }
 
 void DiskResource::loadForeground (void)
 {
+    FRAME_PROFILER_ZONE("DiskResource::loadForeground");
     if (disk_resource_foreground_warnings)
         CLOG << "WARNING: Resource loaded in rendering thread: " << getName() << std::endl;
     load();
@@ -173,11 +226,11 @@ void DiskResource::loadForeground (void)
 void DiskResource::decrement (void)
 {
     APP_ASSERT(users > 0);
-    users--;
+    int now = --users;
     if (disk_resource_verbose_incs)
-        CVERB << "-- " << getName() << "(now " << users << ")" << std::endl;
+        CVERB << "-- " << getName() << "(now " << now << ")" << std::endl;
     // Maybe reclaim now / later
-    if (users == 0) {
+    if (now == 0) {
         bgl->finishedWith(this);
     }
 }
@@ -194,7 +247,18 @@ void DiskResource::unload (void)
     }
     dependencies.clear();
     unloadImpl();
+    setHostRAM(0);
     loaded = false;
+    disk_resource_loaded_count--;
+}
+
+void DiskResource::setHostRAM (size_t bytes)
+{
+    if (!isGPUResource()) {
+        host_ram_bytes += bytes;
+        host_ram_bytes -= hostRAM;
+    }
+    hostRAM = bytes;
 }
 
 double host_ram_available (void)
@@ -204,6 +268,17 @@ double host_ram_available (void)
 
 double host_ram_used (void)
 {
-    // TODO: Implement this by requiring each DiskReosurce to specify its in-memory size.
-    return 0;
+    return host_ram_bytes / 1024.0 / 1024.0;
+}
+
+std::map<std::string, double> host_ram_used_by_type (void)
+{
+    std::map<std::string, double> r;
+    const DiskResources all = disk_resource_registry.getAll();
+    for (DiskResources::const_iterator i=all.begin(), i_=all.end() ; i != i_ ; ++i) {
+        DiskResource *dr = *i;
+        if (!dr->isLoaded()) continue;
+        r[dr->getTypeName()] += dr->getHostRAM() / 1024.0 / 1024.0;
+    }
+    return r;
 }
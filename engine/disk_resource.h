@@ -29,10 +29,17 @@ typedef std::vector<DiskResource*> DiskResources;
 #ifndef DiskResource_h
 #define DiskResource_h
 
+#include <atomic>
+#include <map>
+#include <mutex>
 #include <string>
 
 #include <centralised_log.h>
 
+#include "lru_queue.h"
+
+struct AssetView;
+
 
 /** \file
  *
@@ -72,7 +79,7 @@ DiskResources disk_resource_all (void);
 DiskResources disk_resource_all_loaded (void);
 
 /** Either retrieve the disk resource of the given name, or create a new one.
- * The disk resource will begin life unloaded.
+ * The disk resource will begin life unloaded.  Thread safe.
  */
 DiskResource *disk_resource_get_or_make (const std::string &rn);
 
@@ -84,9 +91,33 @@ bool disk_resource_has (const std::string &rn);
  */
 double host_ram_available (void);
 
-/** How many MB of host RAM have been used by disk resources. */
+/** How many MB of host RAM have been used by disk resources.  This only counts resources that
+ * are not GPU resources, since those are budgeted by gfx_gpu_ram_available() instead, and is
+ * therefore what core_option(CORE_RAM) limits. */
 double host_ram_used (void);
 
+/** How many MB of host RAM are used by loaded disk resources, by type (as given by
+ * DiskResource::getTypeName).  Unlike host_ram_used, GPU resources are included. */
+std::map<std::string, double> host_ram_used_by_type (void);
+
+/** Construct a disk resource of the appropriate subclass for the given name, which is not checked
+ * for duplicates or registered.  This is internal, use disk_resource_get_or_make. */
+DiskResource *disk_resource_make (const std::string &rn);
+
+/** Ogre's resource managers are not thread safe, so code that may run on a background loader
+ * thread holds this while calling them.  Do not hold it while loading another disk resource, as
+ * that resource may need it. */
+extern std::mutex disk_resource_ogre_lock;
+
+/** Open a file (an absolute Grit path) for reading.  If the file is in a mounted asset archive
+ * (see asset_archive.h), the stream reads directly from the mapped archive, otherwise it comes
+ * from disk via Ogre.  Throws an exception if the file does not exist. */
+Ogre::DataStreamPtr disk_resource_open (const std::string &name);
+
+/** As above, but also sets view to the file's bytes if it is in a mounted asset archive, so callers
+ * can read it in place without finding it again.  Otherwise view.data is left NULL. */
+Ogre::DataStreamPtr disk_resource_open (const std::string &name, AssetView &view);
+
 /** Represents some data on disk that must be loaded before use.
  *
  * Subclasses of DiskResource define different kinds of data, such as audio,
@@ -123,12 +154,18 @@ class DiskResource {
     };
 
     /** Do not use this, call the disk_resource_get function instead. */
-    DiskResource (void) : loaded(false), users(0) { }
+    DiskResource (void) : loaded(false), users(0), hostRAM(0) { }
 
     /** The filename, as an absolute unix-style path from the root of the
      * game directory. */
     virtual const std::string &getName (void) const = 0;
 
+    /** A short name for the kind of resource, e.g. for statistics. */
+    virtual const char *getTypeName (void) const = 0;
+
+    /** Bytes of host memory used by the loaded resource, 0 if unloaded. */
+    size_t getHostRAM (void) const { return hostRAM; }
+
     /** Is the resource loaded and therefore ready for use? */
     bool isLoaded (void) const { return loaded; }
 
@@ -165,19 +202,22 @@ class DiskResource {
      * */
     void increment (void)
     {
-        users++;
+        int now = ++users;
         if (disk_resource_verbose_incs)
-            CVERB << "++ " << getName() << " (now at " << users << ")" << std::endl;
+            CVERB << "++ " << getName() << " (now at " << now << ")" << std::endl;
     }
 
-    /** Inform that you are no-longer using this resource. */
+    /** Inform that you are no-longer using this resource.  Main thread only, unlike increment,
+     * which loader threads also call when adding dependencies. */
     void decrement (void);
 
     /** Update internal state from disk.  The resource is never actually unloaded at any point. */
     void reload (void);
 
-    /** Load from disk. */
-    void load (void);
+    /** Load from disk.  Several threads may call this concurrently, in which case one of them
+     * does the loading and the others wait for it to finish.  A no-op if already loaded.  Returns
+     * whether this call did the loading. */
+    bool load (void);
 
     /** Load from disk. */
     void loadForeground (void);
@@ -213,16 +253,31 @@ class DiskResource {
     /** Subclasses override to implement unloading. */
     virtual void unloadImpl (void) { }
 
+    /** Subclasses call this from loadImpl (or reloadImpl) to report how many bytes of host
+     * memory they are using.  It is reset to 0 automatically on unload. */
+    void setHostRAM (size_t bytes);
+
     private:
 
     /** The dependencies of this disk resource that must be loaded when it is. */
     DiskResources dependencies;
 
-    /** Store loaded state. */
-    bool loaded;
+    /** Store loaded state.  Loader threads set it while the main thread reads it. */
+    std::atomic<bool> loaded;
+
+    /** Held while loading, so that concurrent loader threads do not both load. */
+    std::mutex loadLock;
+
+    /** As reported by the subclass, from whichever thread loaded it. */
+    std::atomic<size_t> hostRAM;
+
+    /** For when we are on one of the background loader's death rows. */
+    LRUQueueLinks<DiskResource> lruLinks;
+    friend class LRUQueue<DiskResource>;
 
-    /** Store number of users (like a reference counter). */
-    int users;
+    /** Store number of users (like a reference counter).  Atomic as loader threads increment it
+     * when adding dependencies. */
+    std::atomic<int> users;
 
     /** Type for storage of reload callbacks. */
     typedef std::set<ReloadWatcher*> ReloadWatcherSet;
@@ -0,0 +1,105 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* The parts of the disk resource subsystem that know about the concrete kinds of resource, and
+ * where their files come from.  Standalone tools that link the rest of the subsystem can provide
+ * their own versions of these functions instead.
+ */
+
+#include "asset_archive.h"
+#include "disk_resource.h"
+
+#include "gfx/gfx_disk_resource.h"
+
+#include "audio/audio_disk_resource.h"
+#include "physics/collision_mesh.h"
+
+static bool ends_with (const std::string &str, const std::string &snippet)
+{
+    if (snippet.length() > str.length()) return false;
+    return str.substr(str.length() - snippet.length()) == snippet;
+}
+
+DiskResource *disk_resource_make (const std::string &rn)
+{
+    size_t pos = rn.rfind('.');
+    if (pos == rn.npos) {
+        EXCEPT << "Disk resource \"" << rn << "\" does not have a file extension." << ENDL;
+    }
+    std::string suffix(rn, pos + 1);
+
+    const char *texture_formats[] = { "jpg", "png", "tga", "tiff", "hdr", "dds" };
+    unsigned num_texture_formats = sizeof(texture_formats)/sizeof(*texture_formats);
+
+    DiskResource *dr = nullptr;
+    if (suffix == "mesh") {
+        dr = new GfxMeshDiskResource(rn);
+    } else if (suffix == "tcol" || suffix == "gcol" || suffix == "bcol") {
+        dr = new CollisionMesh(rn);
+    } else if (suffix == "wav" || suffix == "ogg" || suffix == "mp3") {
+        dr = new AudioDiskResource(rn);
+    } else if (ends_with(rn, ".envcube.tiff")) {
+        dr = new GfxEnvCubeDiskResource(rn);
+    } else if (ends_with(rn, ".lut.png")) {
+        dr = new GfxColourGradeLUTDiskResource(rn);
+    } else if (ends_with(rn, ".lut.tiff")) {
+        dr = new GfxColourGradeLUTDiskResource(rn);
+    } else {
+        for (unsigned i=0 ; i<num_texture_formats ; ++i) {
+            if (suffix == texture_formats[i]) {
+                dr = new GfxTextureDiskResource(rn);
+                break;
+            }
+        }
+    }
+    if (dr == NULL) {
+        std::stringstream ss;
+        for (unsigned i=0 ; i<num_texture_formats ; ++i) {
+            if (i>0) ss << ", ";
+            ss << texture_formats[i];
+        }
+        GRIT_EXCEPT("Ignoring resource \"" + rn + "\" as "
+                    "its file extension was not recognised.  Recognised extensions: " + ss.str());
+    }
+    return dr;
+}
+
+Ogre::DataStreamPtr disk_resource_open (const std::string &name)
+{
+    AssetView view;
+    return disk_resource_open(name, view);
+}
+
+Ogre::DataStreamPtr disk_resource_open (const std::string &name, AssetView &view)
+{
+    if (asset_archive_find(name, view)) {
+        // Read only, and not freed on close, so the const_cast is safe.
+        void *data = const_cast<uint8_t*>(view.data);
+        return Ogre::DataStreamPtr(
+            OGRE_NEW Ogre::MemoryDataStream(name, data, view.length, false, true));
+    }
+    try {
+        std::lock_guard<std::mutex> guard(disk_resource_ogre_lock);
+        return Ogre::ResourceGroupManager::getSingleton().openResource(name.substr(1), "GRIT");
+    } catch (Ogre::Exception &e) {
+        GRIT_EXCEPT(e.getDescription());
+    }
+}
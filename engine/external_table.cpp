@@ -23,32 +23,79 @@
 #include "grit_lua_util.h"
 #include "lua_wrappers_primitives.h"
 
+ExternalTable &ExternalTable::operator= (const ExternalTable &other)
+{
+    if (this == &other) return *this;
+    fields.clear();
+    fields.reserve(other.fields.size());
+    for (const Field &f : other.fields) {
+        Field copy;
+        copy.hash = f.hash;
+        copy.key = f.key;
+        copy.value.reset(new Value(*f.value));
+        fields.push_back(std::move(copy));
+    }
+    array.clear();
+    array.reserve(other.array.size());
+    for (const std::unique_ptr<Value> &v : other.array) {
+        array.emplace_back(v ? new Value(*v) : NULL);
+    }
+    elements.clear();
+    for (const auto &pair : other.elements) {
+        elements[pair.first].reset(new Value(*pair.second));
+    }
+    return *this;
+}
+
 void ExternalTable::destroy (lua_State *L)
 {
     clear(L);
 }
 
-void ExternalTable::clear (lua_State *L)
+static void destroy_value (lua_State *L, ExternalTable::Value &v)
 {
-    for (StringMap::iterator i=fields.begin(), i_=fields.end() ; i != i_ ; ++i) {
-        Value &v = i->second;
-        if (v.type == 8) {
-            v.func.setNil(L);
-        } else if (v.type == 5) {
-            v.t->destroy(L);
-        }
+    if (v.type == 8) {
+        v.func.setNil(L);
+    } else if (v.type == 5) {
+        v.t->destroy(L);
     }
-    for (NumberMap::iterator i=elements.begin(), i_=elements.end() ; i != i_ ; ++i) {
-        Value &v = i->second;
-        if (v.type == 8) {
-            v.func.setNil(L);
-        } else if (v.type == 5) {
-            v.t->destroy(L);
-        }
+}
+
+void ExternalTable::clear (lua_State *L)
+{
+    for (Field &f : fields) destroy_value(L, *f.value);
+    for (std::unique_ptr<Value> &v : array) {
+        if (v) destroy_value(L, *v);
     }
+    for (auto &pair : elements) destroy_value(L, *pair.second);
     fields.clear();
+    array.clear();
     elements.clear();
 }
+
+ExternalTable::Value &ExternalTable::slot (lua_Number key)
+{
+    size_t i;
+    if (arrayIndex(key, i) && i <= array.size()) {
+        if (i < array.size()) {
+            if (!array[i]) array[i].reset(new Value());
+            return *array[i];
+        }
+        array.emplace_back(new Value());
+        // Keys that follow on from the new end move from elements to the array.
+        while (true) {
+            NumberMap::iterator it = elements.find(lua_Number(array.size() + 1));
+            if (it == elements.end()) break;
+            array.push_back(std::move(it->second));
+            elements.erase(it);
+        }
+        return *array[i];
+    }
+    std::unique_ptr<Value> &v = elements[key];
+    if (!v) v.reset(new Value());
+    return *v;
+}
+
 const char *ExternalTable::luaGet (lua_State *L) const
 {
     if (lua_type(L, -1) == LUA_TSTRING) {
@@ -102,25 +149,30 @@ static void push (lua_State *L, const ExternalTable::Value &v)
     }
 }
 
-const char *ExternalTable::luaGet (lua_State *L, const std::string &key) const
+static void push_or_nil (lua_State *L, const ExternalTable::Value *v)
 {
-    auto it = fields.find(key);
-    if (it == fields.end()) {
+    if (v == NULL) {
         lua_pushnil(L);
     } else {
-        push(L, it->second);
+        push(L, *v);
     }
+}
+
+const char *ExternalTable::luaGet (lua_State *L, const std::string &key) const
+{
+    push_or_nil(L, find(key));
+    return NULL;
+}
+
+const char *ExternalTable::luaGet (lua_State *L, const ExternalTableKey &key) const
+{
+    push_or_nil(L, find(key));
     return NULL;
 }
 
 const char *ExternalTable::luaGet (lua_State *L, lua_Number key) const
 {
-    auto it = elements.find(key);
-    if (it == elements.end()) {
-        lua_pushnil(L);
-    } else {
-        push(L, it->second);
-    }
+    push_or_nil(L, find(key));
     return NULL;
 }
 
@@ -136,7 +188,7 @@ const char *ExternalTable::luaSet (lua_State *L)
     return "key was not a string or number";
 }
 
-const char *ExternalTable::luaSet (lua_State *L, const std::string &key)
+template<class K> const char *ExternalTable::luaSetImpl (lua_State *L, const K &key)
 {
     if (lua_type(L, -1) == LUA_TNIL) {
         unset(key);
@@ -166,7 +218,7 @@ const char *ExternalTable::luaSet (lua_State *L, const std::string &key)
         self->takeTableFromLuaStack(L, lua_gettop(L));
         set(key, self);
     } else if (lua_type(L, -1) == LUA_TFUNCTION) {
-        Value &v = fields[key];
+        Value &v = slot(key);
         v.func.setNoPop(L);
         v.type = 8;
     } else if (lua_type(L, -1) == LUA_TVECTOR2) {
@@ -181,66 +233,38 @@ const char *ExternalTable::luaSet (lua_State *L, const std::string &key)
     return NULL;
 }
 
+const char *ExternalTable::luaSet (lua_State *L, const std::string &key)
+{
+    // Intern the key once, rather than in each set().
+    return luaSetImpl(L, ExternalTableKey(key));
+}
+
+const char *ExternalTable::luaSet (lua_State *L, const ExternalTableKey &key)
+{
+    return luaSetImpl(L, key);
+}
+
 const char *ExternalTable::luaSet (lua_State *L, lua_Number key)
 {
-    if (lua_type(L, -1) == LUA_TNIL) {
-        unset(key);
-    } else if (lua_type(L, -1) == LUA_TSTRING) {
-        std::string val = lua_tostring(L, -1);
-        set(key, val);
-    } else if (lua_type(L, -1) == LUA_TNUMBER) {
-        lua_Number val = luaL_checknumber(L, -1);
-        set(key, val);
-    } else if (lua_type(L, -1) == LUA_TBOOLEAN) {
-        bool val = check_bool(L, -1);
-        set(key, val);
-    } else if (lua_type(L, -1) == LUA_TVECTOR3) {
-        Vector3 val = check_v3(L, -1);
-        set(key, val);
-    } else if (lua_type(L, -1) == LUA_TQUAT) {
-        Quaternion val = check_quat(L, -1);
-        set(key, val);
-    } else if (is_userdata(L, -1, PLOT_TAG)) {
-        GET_UD_MACRO(Plot, self, -1, PLOT_TAG);
-        set(key, self);
-    } else if (is_userdata(L, -1, PLOT_V3_TAG)) {
-        GET_UD_MACRO(PlotV3, self, -1, PLOT_V3_TAG);
-        set(key, self);
-    } else if (lua_type(L, -1) == LUA_TTABLE) {
-        SharedPtr<ExternalTable> self = SharedPtr<ExternalTable>(new ExternalTable());
-        self->takeTableFromLuaStack(L, -1);
-        set(key, self);
-    } else if (lua_type(L, -1) == LUA_TFUNCTION) {
-        Value &v = elements[key];
-        v.func.setNoPop(L);
-        v.type = 8;
-    } else if (lua_type(L, -1) == LUA_TVECTOR2) {
-        Vector2 val = check_v2(L, -1);
-        set(key, val);
-    } else if (lua_type(L, -1) == LUA_TVECTOR4) {
-        Vector4 val = check_v4(L, -1);
-        set(key, val);
-    } else {
-        return "type not supported";
-    }
-    return NULL;
+    return luaSetImpl(L, key);
 }
 
 void ExternalTable::dump (lua_State *L) const
 {
-    lua_createtable(L, elements.size(), fields.size());
-    for (StringMap::const_iterator i=fields.begin(), i_=fields.end() ; i != i_ ; ++i) {
-        const std::string &key = i->first;
-        const Value &v = i->second;
-        lua_pushstring(L, key.c_str());
-        push(L, v);
+    lua_createtable(L, array.size(), fields.size() + elements.size());
+    for (const Field &f : fields) {
+        lua_pushstring(L, f.key.str().c_str());
+        push(L, *f.value);
         lua_rawset(L, -3);
     }
-    for (NumberMap::const_iterator i=elements.begin(), i_=elements.end() ; i != i_ ; ++i) {
-        lua_Number key = i->first;
-        const Value &v = i->second;
-        lua_pushnumber(L, key);
-        push(L, v);
+    for (size_t i=0 ; i<array.size() ; ++i) {
+        if (!array[i]) continue;
+        push(L, *array[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    for (const auto &pair : elements) {
+        lua_pushnumber(L, pair.first);
+        push(L, *pair.second);
         lua_rawset(L, -3);
     }
 }
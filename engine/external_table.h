@@ -25,8 +25,14 @@ class ExternalTable;
 #ifndef ExternalTable_h
 #define ExternalTable_h
 
+#include <cmath>
+
+#include <algorithm>
 #include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 extern "C" {
     #include <lua.h>
@@ -41,405 +47,329 @@ extern "C" {
 #include "shared_ptr.h"
 
 
+/** An interned string, used as the key of an ExternalTable field.  Equal strings always give the
+ * same key, so keys compare by address and carry a precomputed hash.  Making a key from a string
+ * costs a hash table lookup, so code that uses the same key over and over should keep it around.
+ * Keys are never freed.  Like the Lua state, this is only to be used from the main thread.
+ */
+class ExternalTableKey {
+
+    // The string, and its hash.  Nodes of an unordered_map do not move, so we can point at them.
+    typedef std::unordered_map<std::string, size_t> Pool;
+
+    static Pool &pool (void)
+    {
+        static Pool p;
+        return p;
+    }
+
+    const Pool::value_type *entry;
+
+    public:
+
+    /** An invalid key, only to be assigned to. */
+    ExternalTableKey (void) : entry(NULL) { }
+
+    explicit ExternalTableKey (const std::string &s)
+    {
+        Pool &p = pool();
+        Pool::iterator it = p.find(s);
+        if (it == p.end()) it = p.insert(Pool::value_type(s, std::hash<std::string>()(s))).first;
+        entry = &*it;
+    }
+
+    /** Look up the key for the given string, without interning it.  Returns false if there is
+     * none, in which case the string cannot be in any table. */
+    static bool find (const std::string &s, ExternalTableKey &k)
+    {
+        Pool &p = pool();
+        Pool::iterator it = p.find(s);
+        if (it == p.end()) return false;
+        k.entry = &*it;
+        return true;
+    }
+
+    const std::string &str (void) const { return entry->first; }
+
+    size_t hash (void) const { return entry->second; }
+
+    bool operator== (const ExternalTableKey &other) const { return entry == other.entry; }
+    bool operator!= (const ExternalTableKey &other) const { return entry != other.entry; }
+
+    /** For using keys in hashed containers. */
+    struct Hash {
+        size_t operator() (const ExternalTableKey &k) const { return k.hash(); }
+    };
+
+    /** An arbitrary order (not alphabetical) that is the same from run to run. */
+    bool operator< (const ExternalTableKey &other) const
+    {
+        if (hash() != other.hash()) return hash() < other.hash();
+        return entry < other.entry;
+    }
+};
+
+
 // Purpose of this class is to store lua data outside of lua so as to avoid
 // putting stress on the garbage collector.  Only certain kinds of primitive data
 // are supported.
+//
+// String keys are interned and kept in a vector sorted by key, so a lookup is a binary search over
+// contiguous memory.  Integer keys 1..n are kept in a vector like the array part of a Lua table,
+// any other numeric keys go in a map.  Values are boxed, as LuaPtr must not be copied around when
+// the vectors grow.
 
 class ExternalTable {
 
     public:
 
+    struct Value {
+        int type;
+        std::string str;
+        lua_Number real;
+        Vector3 v3;
+        Quaternion q;
+        bool b;
+        SharedPtr<ExternalTable> t;
+        Plot plot;
+        PlotV3 plot_v3;
+        // TODO(dcunnin): This is not destroyed properly, as setNil() is not called.
+        LuaPtr func;
+        Vector2 v2;
+        Vector4 v4;
+    };
+
+    struct Field {
+        size_t hash;  // key.hash(), kept here so the search does not follow the key
+        ExternalTableKey key;
+        std::unique_ptr<Value> value;
+    };
+
+    typedef std::vector<Field> Fields;
+    typedef std::vector<std::unique_ptr<Value>> Array;
+    typedef std::map<lua_Number, std::unique_ptr<Value>> NumberMap;
+
     ExternalTable (void) { }
 
-    void destroy (lua_State *L);
+    ExternalTable (const ExternalTable &other) { *this = other; }
 
-    bool has (const std::string &key) const { return fields.find(key) != fields.end(); }
-    bool has (lua_Number key) const { return elements.find(key) != elements.end(); }
+    ExternalTable &operator= (const ExternalTable &other);
 
-    template<class U> void get (const std::string &key, U &val, const U &def) const
-    {
-        if (!get(key, val)) val = def;
-        
-    }
+    void destroy (lua_State *L);
 
-    template<class U> void get (lua_Number key, U &val, const U &def) const
+    template<class K> bool has (const K &key) const { return find(key) != NULL; }
+
+    template<class K, class U> void get (const K &key, U &val, const U &def) const
     {
         if (!get(key, val)) val = def;
         
     }
 
-    template<class U, typename ...Args>
-    void getOrExcf (const std::string &key, U &val, const std::string &msgf, Args... args) const
+    template<class K, class U, typename ...Args>
+    void getOrExcf (const K &key, U &val, const std::string &msgf, Args... args) const
     {
         if (!get(key, val)) EXCEPTF(msgf, args...);
     }
 
-    template<class U, typename ...Args>
-    void getOrExcf (lua_Number key, U &val, const std::string &msgf, Args... args) const
-    {
-        if (!get(key, val)) EXCEPTF(msgf, args...);
-    }
+    // The key can be a std::string, ExternalTableKey, or number.
 
-    bool get (const std::string &key, lua_Number &v) const
-    {
-        auto it = fields.find(key);
-        if (it == fields.end()) return false;
-        if (it->second.type != 0) return false;
-        v = it->second.real;
-        return true;
-    }
+    template<class K> bool get (const K &key, lua_Number &v) const
+    { return extract(find(key), 0, &Value::real, v); }
 
-    bool get (const std::string &key, std::string &v) const
-    {
-        auto it = fields.find(key);
-        if (it == fields.end()) return false;
-        if (it->second.type != 1) return false;
-        v = it->second.str;
-        return true;
-    }
+    template<class K> bool get (const K &key, std::string &v) const
+    { return extract(find(key), 1, &Value::str, v); }
 
-    bool get (const std::string &key, Vector3 &v) const
-    {
-        auto it = fields.find(key);
-        if (it == fields.end()) return false;
-        if (it->second.type != 2) return false;
-        v = it->second.v3 ;
-        return true;
-    }
+    template<class K> bool get (const K &key, Vector3 &v) const
+    { return extract(find(key), 2, &Value::v3, v); }
 
-    bool get (const std::string &key, Quaternion &v) const
-    {
-        auto it = fields.find(key);
-        if (it == fields.end()) return false;
-        if (it->second.type != 3) return false;
-        v = it->second.q;
-        return true;
-    }
+    template<class K> bool get (const K &key, Quaternion &v) const
+    { return extract(find(key), 3, &Value::q, v); }
 
-    bool get (const std::string &key, bool &v) const
-    {
-        auto it = fields.find(key);
-        if (it == fields.end()) return false;
-        if (it->second.type != 4) return false;
-        v = it->second.b;
-        return true;
-    }
+    template<class K> bool get (const K &key, bool &v) const
+    { return extract(find(key), 4, &Value::b, v); }
 
-    bool get (const std::string &key, SharedPtr<ExternalTable> &v) const
-    {
-        auto it = fields.find(key);
-        if (it == fields.end()) return false;
-        if (it->second.type != 5) return false;
-        v = it->second.t;
-        return true;
-    }
+    template<class K> bool get (const K &key, SharedPtr<ExternalTable> &v) const
+    { return extract(find(key), 5, &Value::t, v); }
 
-    bool get (const std::string &key, Plot &v) const
-    {
-        auto it = fields.find(key);
-        if (it == fields.end()) return false;
-        if (it->second.type != 6) return false;
-        v = it->second.plot;
-        return true;
-    }
+    template<class K> bool get (const K &key, Plot &v) const
+    { return extract(find(key), 6, &Value::plot, v); }
 
-    bool get (const std::string &key, PlotV3 &v) const
-    {
-        auto it = fields.find(key);
-        if (it == fields.end()) return false;
-        if (it->second.type != 7) return false;
-        v = it->second.plot_v3;
-        return true;
-    }
+    template<class K> bool get (const K &key, PlotV3 &v) const
+    { return extract(find(key), 7, &Value::plot_v3, v); }
 
-    bool get (const std::string &key, Vector2 &v) const
-    {
-        auto it = fields.find(key);
-        if (it == fields.end()) return false;
-        if (it->second.type != 9) return false;
-        v = it->second.v2;
-        return true;
-    }
+    template<class K> bool get (const K &key, Vector2 &v) const
+    { return extract(find(key), 9, &Value::v2, v); }
 
-    bool get (const std::string &key, Vector4 &v) const
-    {
-        auto it = fields.find(key);
-        if (it == fields.end()) return false;
-        if (it->second.type != 10) return false;
-        v = it->second.v4;
-        return true;
-    }
+    template<class K> bool get (const K &key, Vector4 &v) const
+    { return extract(find(key), 10, &Value::v4, v); }
 
-    bool get (lua_Number key, lua_Number &v) const
-    {
-        auto it = elements.find(key);
-        if (it == elements.end()) return false;
-        if (it->second.type != 0) return false;
-        v = it->second.real;
-        return true;
-    }
+    template<class K> void set (const K &key, const lua_Number r)
+    { assign(slot(key), 0, &Value::real, r); }
 
-    bool get (lua_Number key, std::string &v) const
-    {
-        auto it = elements.find(key);
-        if (it == elements.end()) return false;
-        if (it->second.type != 1) return false;
-        v = it->second.str;
-        return true;
-    }
+    template<class K> void set (const K &key, const std::string &s)
+    { assign(slot(key), 1, &Value::str, s); }
 
-    bool get (lua_Number key, Vector3 &v) const
-    {
-        auto it = elements.find(key);
-        if (it == elements.end()) return false;
-        if (it->second.type != 2) return false;
-        v = it->second.v3 ;
-        return true;
-    }
+    template<class K> void set (const K &key, const Vector3 &v3)
+    { assign(slot(key), 2, &Value::v3, v3); }
 
-    bool get (lua_Number key, Quaternion &v) const
-    {
-        auto it = elements.find(key);
-        if (it == elements.end()) return false;
-        if (it->second.type != 3) return false;
-        v = it->second.q;
-        return true;
-    }
+    template<class K> void set (const K &key, const Quaternion &q)
+    { assign(slot(key), 3, &Value::q, q); }
 
-    bool get (lua_Number key, bool &v) const
-    {
-        auto it = elements.find(key);
-        if (it == elements.end()) return false;
-        if (it->second.type != 4) return false;
-        v = it->second.b;
-        return true;
-    }
+    template<class K> void set (const K &key, bool b)
+    { assign(slot(key), 4, &Value::b, b); }
 
-    bool get (lua_Number key, SharedPtr<ExternalTable> &v) const
-    {
-        auto it = elements.find(key);
-        if (it == elements.end()) return false;
-        if (it->second.type != 5) return false;
-        v = it->second.t;
-        return true;
-    }
+    template<class K> void set (const K &key, const SharedPtr<ExternalTable> &t)
+    { assign(slot(key), 5, &Value::t, t); }
 
-    bool get (lua_Number key, Plot &v) const
-    {
-        auto it = elements.find(key);
-        if (it == elements.end()) return false;
-        if (it->second.type != 6) return false;
-        v = it->second.plot;
-        return true;
-    }
+    template<class K> void set (const K &key, const Plot &plot)
+    { assign(slot(key), 6, &Value::plot, plot); }
 
-    bool get (lua_Number key, PlotV3 &v) const
-    {
-        auto it = elements.find(key);
-        if (it == elements.end()) return false;
-        if (it->second.type != 7) return false;
-        v = it->second.plot_v3;
-        return true;
-    }
+    template<class K> void set (const K &key, const PlotV3 &plot_v3)
+    { assign(slot(key), 7, &Value::plot_v3, plot_v3); }
 
-    bool get (lua_Number key, Vector2 &v) const
-    {
-        auto it = elements.find(key);
-        if (it == elements.end()) return false;
-        if (it->second.type != 9) return false;
-        v = it->second.v2;
-        return true;
-    }
+    template<class K> void set (const K &key, const Vector2 &v2)
+    { assign(slot(key), 9, &Value::v2, v2); }
 
-    bool get (lua_Number key, Vector4 &v) const
-    {
-        auto it = elements.find(key);
-        if (it == elements.end()) return false;
-        if (it->second.type != 10) return false;
-        v = it->second.v4;
-        return true;
-    }
+    template<class K> void set (const K &key, const Vector4 &v4)
+    { assign(slot(key), 10, &Value::v4, v4); }
 
+    const char *luaGet (lua_State *L) const;
+    const char *luaSet (lua_State *L);
 
-    void set (const std::string &key, const lua_Number r)
-    {
-        fields[key].type = 0;
-        fields[key].real = r;
-    }
+    const char *luaGet (lua_State *L, const std::string &key) const;
+    const char *luaSet (lua_State *L, const std::string &key);
 
-    void set (const std::string &key, const std::string &s)
-    {
-        fields[key].type = 1;
-        fields[key].str = s;
-    }
+    const char *luaGet (lua_State *L, const ExternalTableKey &key) const;
+    const char *luaSet (lua_State *L, const ExternalTableKey &key);
 
-    void set (const std::string &key, const Vector3 &v3)
-    {
-        fields[key].type = 2;
-        fields[key].v3 = v3;
-    }
+    const char *luaGet (lua_State *L, lua_Number key) const;
+    const char *luaSet (lua_State *L, lua_Number key);
 
-    void set (const std::string &key, const Quaternion &q)
+    void unset (const std::string &key)
     {
-        fields[key].type = 3;
-        fields[key].q = q;
+        ExternalTableKey k;
+        if (ExternalTableKey::find(key, k)) unset(k);
     }
 
-    void set (const std::string &key, bool b)
+    void unset (const ExternalTableKey &key)
     {
-        fields[key].type = 4;
-        fields[key].b = b;
+        Fields::iterator it = lowerBound(key);
+        if (it != fields.end() && it->key == key) fields.erase(it);
     }
 
-    void set (const std::string &key, const SharedPtr<ExternalTable> &t)
+    void unset (lua_Number key)
     {
-        fields[key].type = 5;
-        fields[key].t = t;
+        size_t i;
+        if (arrayIndex(key, i) && i < array.size()) {
+            array[i].reset();
+            while (array.size() > 0 && !array.back()) array.pop_back();
+            return;
+        }
+        elements.erase(key);
     }
 
-    void set (const std::string &key, Plot plot)
-    {
-        fields[key].type = 6;
-        fields[key].plot = plot;
-    }
+    void clear (lua_State *L);
 
-    void set (const std::string &key, PlotV3 plot_v3)
-    {
-        fields[key].type = 7;
-        fields[key].plot_v3 = plot_v3;
-    }
+    void dump (lua_State *L) const;
+    void takeTableFromLuaStack (lua_State *L, int tab);
 
-    void set (const std::string &key, const Vector2 &v2)
-    {
-        fields[key].type = 9;
-        fields[key].v2 = v2;
-    }
+    /** Iterates over the string keys, in no particular order. */
+    typedef Fields::iterator KeyIterator;
+    KeyIterator begin (void) { return fields.begin(); }
+    KeyIterator end (void) { return fields.end(); }
 
-    void set (const std::string &key, const Vector4 &v4)
-    {
-        fields[key].type = 10;
-        fields[key].v4 = v4;
-    }
+    typedef Fields::const_iterator ConstKeyIterator;
+    ConstKeyIterator begin (void) const { return fields.begin(); }
+    ConstKeyIterator end (void) const { return fields.end(); }
 
-    void set (lua_Number key, const lua_Number r)
+    protected:
+
+    template<class T> static bool extract (const Value *val, int type, T Value::*member, T &v)
     {
-        elements[key].type = 0;
-        elements[key].real = r;
+        if (val == NULL || val->type != type) return false;
+        v = val->*member;
+        return true;
     }
 
-    void set (lua_Number key, const std::string &s)
+    template<class T> static void assign (Value &val, int type, T Value::*member, const T &v)
     {
-        elements[key].type = 1;
-        elements[key].str = s;
+        val.type = type;
+        val.*member = v;
     }
 
-    void set (lua_Number key, const Vector3 &v3)
+    static bool fieldLess (const Field &a, const ExternalTableKey &b)
     {
-        elements[key].type = 2;
-        elements[key].v3 = v3;
+        if (a.hash != b.hash()) return a.hash < b.hash();
+        return a.key < b;
     }
 
-    void set (lua_Number &key, const Quaternion &q)
+    Fields::iterator lowerBound (const ExternalTableKey &key)
     {
-        elements[key].type = 3;
-        elements[key].q = q;
+        return std::lower_bound(fields.begin(), fields.end(), key, fieldLess);
     }
 
-    void set (lua_Number &key, bool b)
+    Fields::const_iterator lowerBound (const ExternalTableKey &key) const
     {
-        elements[key].type = 4;
-        elements[key].b = b;
+        return std::lower_bound(fields.begin(), fields.end(), key, fieldLess);
     }
 
-    void set (lua_Number &key, const SharedPtr<ExternalTable> &t)
+    /** If the key is a positive integer, the corresponding index into the array.  It may be beyond
+     * the end, in which case the key is in elements, if anywhere. */
+    static bool arrayIndex (lua_Number key, size_t &i)
     {
-        elements[key].type = 5;
-        elements[key].t = t;
+        if (!(key >= 1) || key != std::floor(key) || key > lua_Number(1 << 30)) return false;
+        i = size_t(key) - 1;
+        return true;
     }
 
-    void set (lua_Number &key, const Plot &plot)
+    const Value *find (const ExternalTableKey &key) const
     {
-        elements[key].type = 6;
-        elements[key].plot = plot;
+        Fields::const_iterator it = lowerBound(key);
+        if (it == fields.end() || it->key != key) return NULL;
+        return it->value.get();
     }
 
-    void set (lua_Number &key, const PlotV3 &plot_v3)
+    const Value *find (const std::string &key) const
     {
-        elements[key].type = 7;
-        elements[key].plot_v3 = plot_v3;
+        ExternalTableKey k;
+        if (!ExternalTableKey::find(key, k)) return NULL;
+        return find(k);
     }
 
-    void set (lua_Number &key, const Vector2 &v2)
+    const Value *find (lua_Number key) const
     {
-        elements[key].type = 9;
-        elements[key].v2 = v2;
+        size_t i;
+        if (arrayIndex(key, i) && i < array.size()) return array[i].get();
+        NumberMap::const_iterator it = elements.find(key);
+        return it == elements.end() ? NULL : it->second.get();
     }
 
-    void set (lua_Number &key, const Vector4 &v4)
+    /** The value for the key, created if it was not there. */
+    Value &slot (const ExternalTableKey &key)
     {
-        elements[key].type = 10;
-        elements[key].v4 = v4;
+        Fields::iterator it = lowerBound(key);
+        if (it == fields.end() || it->key != key) {
+            Field f;
+            f.hash = key.hash();
+            f.key = key;
+            f.value.reset(new Value());
+            it = fields.insert(it, std::move(f));
+        }
+        return *it->value;
     }
 
-    const char *luaGet (lua_State *L) const;
-    const char *luaSet (lua_State *L);
-
-    const char *luaGet (lua_State *L, const std::string &key) const;
-    const char *luaSet (lua_State *L, const std::string &key);
-
-    const char *luaGet (lua_State *L, lua_Number key) const;
-    const char *luaSet (lua_State *L, lua_Number key);
-
-    void unset (const std::string &key) { fields.erase(key); }
-    void unset (lua_Number key) { elements.erase(key); }
-
-    void clear (lua_State *L);
-
-    void dump (lua_State *L) const;
-    void takeTableFromLuaStack (lua_State *L, int tab);
-
-    template<typename T> class UniquePtr {
-        T *ptr;
-        public:
-        UniquePtr () : ptr(NULL) { }
-        ~UniquePtr (void) { delete ptr; }
-        T *operator-> (void) const { return ptr; }
-        T &operator* (void) const { return *ptr; }
-        T *operator= (T *ptr_) { delete ptr; return ptr=ptr_; }
-    };
-
-    struct Value {
-        int type;
-        std::string str;
-        lua_Number real;
-        Vector3 v3;
-        Quaternion q;
-        bool b;
-        SharedPtr<ExternalTable> t;
-        Plot plot;
-        PlotV3 plot_v3;
-        // TODO(dcunnin): This is not destroyed properly, as setNil() is not called.
-        LuaPtr func;
-        Vector2 v2;
-        Vector4 v4;
-    };
+    Value &slot (const std::string &key) { return slot(ExternalTableKey(key)); }
 
-    typedef std::map<std::string, Value> StringMap;
+    Value &slot (lua_Number key);
 
-    typedef StringMap::iterator KeyIterator;
-    KeyIterator begin (void) { return fields.begin(); }
-    KeyIterator end (void) { return fields.end(); }
+    template<class K> const char *luaSetImpl (lua_State *L, const K &key);
 
-    typedef StringMap::const_iterator ConstKeyIterator;
-    ConstKeyIterator begin (void) const { return fields.begin(); }
-    ConstKeyIterator end (void) const { return fields.end(); }
-
-    typedef std::map<lua_Number, Value> NumberMap;
-
-    protected:
+    Fields fields;
 
-    StringMap fields;
+    /** Keys 1 to array.size(), with NULL for holes.  The last one is never NULL. */
+    Array array;
 
+    /** Numeric keys that do not belong in the array. */
     NumberMap elements;
 
 };
@@ -0,0 +1,205 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Scratch memory for containers that only live for part of a frame, such as the lists of objects
+ * found by a range query.  Allocation bumps a pointer and freeing does nothing (except for the
+ * most recent allocation, so a growing vector can reuse its space), then all of the memory is
+ * reclaimed at once when the arena is reset at the end of the frame.  When a frame needs more
+ * than the arena has, another block is taken from the heap, and at the next reset the blocks are
+ * merged into one big enough for the whole frame.  After that, the arena does not touch the heap.
+ *
+ * Each thread has its own arena.  A container using FrameAllocator must be destroyed before the
+ * frame ends, and only used by the thread that created it.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <new>
+#include <vector>
+
+#ifndef FrameArena_h
+#define FrameArena_h
+
+struct FrameArenaStats {
+    uint64_t allocations;       // Since the last reset.
+    uint64_t bytes;             // Since the last reset, including padding.
+    uint64_t live;              // Allocations not yet freed.
+    uint64_t lastAllocations;   // Between the last two resets.
+    uint64_t lastBytes;         // Between the last two resets.
+    uint64_t capacity;          // Size of the blocks held.
+    uint64_t peakBytes;         // The most bytes used in any frame.
+    uint64_t heapAllocations;   // Blocks ever taken from the heap.
+    uint64_t resets;
+    uint64_t deferredResets;    // Resets that did nothing because allocations were live.
+    FrameArenaStats (void)
+      : allocations(0), bytes(0), live(0), lastAllocations(0), lastBytes(0), capacity(0),
+        peakBytes(0), heapAllocations(0), resets(0), deferredResets(0)
+    { }
+};
+
+class FrameArena {
+
+    struct Block {
+        Block *prev;
+        size_t size;  // Including this header.
+    };
+
+    public:
+
+    static const size_t INITIAL_SIZE = 64 * 1024;
+
+    FrameArena (void) : blocks(NULL), top(0), end(0) { }
+
+    ~FrameArena (void) { releaseBlocks(); }
+
+    void *allocate (size_t bytes, size_t align)
+    {
+        uintptr_t p = (top + align - 1) & ~uintptr_t(align - 1);
+        if (blocks == NULL || p + bytes > end) return allocateSlow(bytes, align);
+        stats.allocations++;
+        stats.bytes += p + bytes - top;
+        stats.live++;
+        top = p + bytes;
+        return reinterpret_cast<void*>(p);
+    }
+
+    void deallocate (void *ptr, size_t bytes)
+    {
+        stats.live--;
+        uintptr_t p = reinterpret_cast<uintptr_t>(ptr);
+        if (p + bytes == top) top = p;
+    }
+
+    /** Reclaim everything.  Does nothing and returns false if anything is still allocated. */
+    bool reset (void)
+    {
+        if (stats.live > 0) {
+            stats.deferredResets++;
+            return false;
+        }
+        if (stats.bytes > stats.peakBytes) stats.peakBytes = stats.bytes;
+        stats.lastAllocations = stats.allocations;
+        stats.lastBytes = stats.bytes;
+        stats.allocations = 0;
+        stats.bytes = 0;
+        stats.resets++;
+        if (blocks != NULL && blocks->prev != NULL) {
+            // Outgrew the arena this frame, make one block that would have been enough.
+            size_t size = size_t(stats.capacity);
+            releaseBlocks();
+            addBlock(size);
+        }
+        if (blocks != NULL) {
+            top = reinterpret_cast<uintptr_t>(blocks + 1);
+            end = reinterpret_cast<uintptr_t>(blocks) + blocks->size;
+        }
+        return true;
+    }
+
+    const FrameArenaStats &getStats (void) const { return stats; }
+
+    private:
+
+    void *allocateSlow (size_t bytes, size_t align)
+    {
+        size_t size = blocks == NULL ? INITIAL_SIZE : 2 * blocks->size;
+        while (size < sizeof(Block) + bytes + align) size *= 2;
+        addBlock(size);
+        return allocate(bytes, align);
+    }
+
+    void addBlock (size_t size)
+    {
+        Block *b = static_cast<Block*>(std::malloc(size));
+        if (b == NULL) throw std::bad_alloc();
+        b->prev = blocks;
+        b->size = size;
+        blocks = b;
+        top = reinterpret_cast<uintptr_t>(b + 1);
+        end = reinterpret_cast<uintptr_t>(b) + size;
+        stats.capacity += size;
+        stats.heapAllocations++;
+    }
+
+    void releaseBlocks (void)
+    {
+        while (blocks != NULL) {
+            Block *prev = blocks->prev;
+            std::free(blocks);
+            blocks = prev;
+        }
+        stats.capacity = 0;
+        top = end = 0;
+    }
+
+    Block *blocks;  // The one being allocated from, linked to the earlier ones.
+    uintptr_t top, end;
+    FrameArenaStats stats;
+};
+
+/** The calling thread's arena. */
+FrameArena &frame_arena (void);
+
+/** Reset the calling thread's arena, to be called once per frame when no scratch containers
+ * exist.  If some do (e.g. a Lua callback ended the frame from inside a query), nothing happens
+ * and the memory is reclaimed at the next reset. */
+void frame_arena_reset (void);
+
+/** An STL allocator using a frame arena, by default the calling thread's. */
+template<class T> class FrameAllocator {
+
+    public:
+
+    typedef T value_type;
+
+    FrameAllocator (void) : arena(&frame_arena()) { }
+
+    explicit FrameAllocator (FrameArena &arena) : arena(&arena) { }
+
+    template<class U> FrameAllocator (const FrameAllocator<U> &other) : arena(other.arena) { }
+
+    T *allocate (size_t n)
+    {
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate (T *p, size_t n)
+    {
+        arena->deallocate(p, n * sizeof(T));
+    }
+
+    FrameArena *arena;
+};
+
+template<class T, class U>
+bool operator== (const FrameAllocator<T> &a, const FrameAllocator<U> &b)
+{ return a.arena == b.arena; }
+
+template<class T, class U>
+bool operator!= (const FrameAllocator<T> &a, const FrameAllocator<U> &b)
+{ return a.arena != b.arena; }
+
+/** A vector for use within a frame. */
+template<class T> using FrameVector = std::vector<T, FrameAllocator<T> >;
+
+#endif
@@ -0,0 +1,243 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <cstdio>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include <centralised_log.h>
+
+#include "frame_profiler.h"
+
+namespace {
+
+    typedef std::chrono::steady_clock Clock;
+
+    const Clock::time_point epoch = Clock::now();
+
+    uint64_t now (void)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count();
+    }
+
+    // Written by the owning thread and read by frame_profiler_dump, so the fields are atomic
+    // (relaxed, so ordinary loads and stores on the usual platforms).
+    struct Event {
+        std::atomic<const char*> name;
+        std::atomic<uint64_t> start, duration;
+    };
+
+    // The most recent zones of one thread.
+    struct ThreadBuffer {
+        static const uint64_t CAPACITY = 1 << 15;
+        static const unsigned MAX_DEPTH = 64;
+
+        unsigned tid;
+        std::string name;  // Protected by buffers_lock.
+
+        // The number of events ever written, event i is in events[i % CAPACITY].
+        std::atomic<uint64_t> head;
+        Event events[CAPACITY];
+
+        // Events before this one were cleared.  Protected by buffers_lock.
+        uint64_t cleared;
+
+        // Zones that have been opened but not closed, only touched by the owning thread.
+        struct Open { const char *name; uint64_t start; } open[MAX_DEPTH];
+        unsigned depth;  // May exceed MAX_DEPTH, in which case the deepest zones are lost.
+
+        ThreadBuffer (unsigned tid) : tid(tid), head(0), cleared(0), depth(0) { }
+
+        void write (const char *name, uint64_t start, uint64_t duration)
+        {
+            uint64_t h = head.load(std::memory_order_relaxed);
+            Event &e = events[h % CAPACITY];
+            e.name.store(name, std::memory_order_relaxed);
+            e.start.store(start, std::memory_order_relaxed);
+            e.duration.store(duration, std::memory_order_relaxed);
+            head.store(h + 1, std::memory_order_release);
+        }
+    };
+
+    std::atomic<bool> recording(false);
+
+    // Threads register their buffer the first time they record something.  Buffers are never
+    // freed, so the zones of threads that have finished can still be dumped.
+    std::mutex buffers_lock;
+    std::vector<ThreadBuffer*> buffers;
+    thread_local ThreadBuffer *my_buffer = nullptr;
+    thread_local std::string my_name;
+
+    std::mutex names_lock;
+    std::set<std::string> names;
+
+    ThreadBuffer *get_buffer (void)
+    {
+        if (my_buffer == nullptr) {
+            std::lock_guard<std::mutex> _lock(buffers_lock);
+            my_buffer = new ThreadBuffer(buffers.size() + 1);
+            my_buffer->name = my_name;
+            buffers.push_back(my_buffer);
+        }
+        return my_buffer;
+    }
+
+    void write_json_string (std::ostream &out, const std::string &s)
+    {
+        out << '"';
+        for (char c : s) {
+            switch (c) {
+                case '"': out << "\\\""; break;
+                case '\\': out << "\\\\"; break;
+                case '\n': out << "\\n"; break;
+                case '\t': out << "\\t"; break;
+                default:
+                if ((unsigned char)c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof buf, "\\u%04x", (unsigned char)c);
+                    out << buf;
+                } else {
+                    out << c;
+                }
+            }
+        }
+        out << '"';
+    }
+
+}
+
+void frame_profiler_enable (bool v)
+{
+    recording.store(v, std::memory_order_relaxed);
+}
+
+bool frame_profiler_enabled (void)
+{
+    return recording.load(std::memory_order_relaxed);
+}
+
+void frame_profiler_thread_name (const std::string &name)
+{
+    my_name = name;
+    if (my_buffer != nullptr) {
+        std::lock_guard<std::mutex> _lock(buffers_lock);
+        my_buffer->name = name;
+    }
+}
+
+bool frame_profiler_begin (const char *name)
+{
+    if (!recording.load(std::memory_order_relaxed)) return false;
+    ThreadBuffer *b = get_buffer();
+    if (b->depth < ThreadBuffer::MAX_DEPTH) {
+        b->open[b->depth].name = name;
+        b->open[b->depth].start = now();
+    }
+    b->depth++;
+    return true;
+}
+
+void frame_profiler_end (void)
+{
+    ThreadBuffer *b = my_buffer;
+    if (b == nullptr || b->depth == 0) return;
+    b->depth--;
+    if (b->depth < ThreadBuffer::MAX_DEPTH) {
+        const ThreadBuffer::Open &o = b->open[b->depth];
+        b->write(o.name, o.start, now() - o.start);
+    }
+}
+
+const char *frame_profiler_intern (const std::string &name)
+{
+    std::lock_guard<std::mutex> _lock(names_lock);
+    return names.insert(name).first->c_str();
+}
+
+void frame_profiler_clear (void)
+{
+    // Only moves the start of what is dumped, so need not synchronise with the writers.
+    std::lock_guard<std::mutex> _lock(buffers_lock);
+    for (ThreadBuffer *b : buffers) {
+        b->cleared = b->head.load(std::memory_order_acquire);
+    }
+}
+
+void frame_profiler_dump (const std::string &filename)
+{
+    std::ofstream out(filename.c_str());
+    if (!out.good())
+        EXCEPT << "Could not open for writing: \"" << filename << "\"" << ENDL;
+
+    std::lock_guard<std::mutex> _lock(buffers_lock);
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (ThreadBuffer *b : buffers) {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b->tid
+            << ",\"args\":{\"name\":";
+        write_json_string(out, b->name.empty() ? "thread " + std::to_string(b->tid) : b->name);
+        out << "}}";
+
+        // The owning thread may be writing while we read.  Copy out the last CAPACITY events,
+        // then discard any that were overwritten in the meantime.
+        uint64_t head = b->head.load(std::memory_order_acquire);
+        uint64_t begin = head > ThreadBuffer::CAPACITY ? head - ThreadBuffer::CAPACITY : 0;
+        begin = std::max(begin, std::min(b->cleared, head));
+        struct Copy { const char *name; uint64_t start, duration; };
+        std::vector<Copy> copies;
+        copies.reserve(head - begin);
+        for (uint64_t i=begin ; i<head ; ++i) {
+            const Event &e = b->events[i % ThreadBuffer::CAPACITY];
+            Copy c = { e.name.load(std::memory_order_relaxed),
+                       e.start.load(std::memory_order_relaxed),
+                       e.duration.load(std::memory_order_relaxed) };
+            copies.push_back(c);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t head2 = b->head.load(std::memory_order_relaxed);
+        // The writer may also be part way through event head2, which replaces head2 - CAPACITY.
+        uint64_t valid = head2 >= ThreadBuffer::CAPACITY ? head2 - ThreadBuffer::CAPACITY + 1 : 0;
+
+        for (uint64_t i=std::max(begin, valid) ; i<head ; ++i) {
+            const Copy &c = copies[i - begin];
+            out << ",\n{\"name\":";
+            write_json_string(out, c.name);
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << b->tid
+                << ",\"ts\":" << c.start / 1000.0 << ",\"dur\":" << c.duration / 1000.0 << "}";
+        }
+    }
+    out << "\n]}\n";
+
+    out.close();
+    if (!out.good())
+        EXCEPT << "Error writing: \"" << filename << "\"" << ENDL;
+}
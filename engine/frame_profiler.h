@@ -0,0 +1,79 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* A timeline of what each thread was doing, for finding frame spikes, loader stalls and the like.
+ * Code marks zones (scopes) by name, and while recording, each thread writes the zones it
+ * completes into its own ring buffer without taking any locks.  The most recent zones of every
+ * thread can then be written out in the Chrome trace event format (load it in chrome://tracing or
+ * https://ui.perfetto.dev).  Nested zones show up as a hierarchy.
+ *
+ * When not recording, a zone costs a relaxed atomic load.
+ */
+
+#include <cstdint>
+
+#include <string>
+
+#ifndef FrameProfiler_h
+#define FrameProfiler_h
+
+/** Start or stop recording.  Zones already open when recording starts are not recorded. */
+void frame_profiler_enable (bool v);
+
+/** Is it recording? */
+bool frame_profiler_enabled (void);
+
+/** Name the calling thread in the trace. */
+void frame_profiler_thread_name (const std::string &name);
+
+/** Open a zone on the calling thread.  The name must outlive the profiler, i.e. be a literal or
+ * come from frame_profiler_intern.  Returns whether the zone is being recorded. */
+bool frame_profiler_begin (const char *name);
+
+/** Close the innermost zone of the calling thread, if there is one. */
+void frame_profiler_end (void);
+
+/** A permanent copy of the name, for zones whose names are not literals (e.g. from Lua). */
+const char *frame_profiler_intern (const std::string &name);
+
+/** Forget all recorded zones. */
+void frame_profiler_clear (void);
+
+/** Write the recorded zones of all threads to the file as Chrome trace event JSON.  Can be called
+ * while recording, in which case zones being written at the time may be missing.  Throws an
+ * exception if the file cannot be written. */
+void frame_profiler_dump (const std::string &filename);
+
+/** Records the enclosing scope as a zone. */
+class FrameProfilerZone {
+    bool active;
+    public:
+    FrameProfilerZone (const char *name) : active(frame_profiler_begin(name)) { }
+    ~FrameProfilerZone (void) { if (active) frame_profiler_end(); }
+};
+
+#define FRAME_PROFILER_ZONE_CAT2(a, b) a##b
+#define FRAME_PROFILER_ZONE_CAT(a, b) FRAME_PROFILER_ZONE_CAT2(a, b)
+#define FRAME_PROFILER_ZONE(name) \
+    FrameProfilerZone FRAME_PROFILER_ZONE_CAT(frame_profiler_zone_, __LINE__)(name)
+
+#endif
@@ -400,7 +400,7 @@ class RangedClutter : public Ogre::MovableObject, public StreamerCallback {
     Ogre::AxisAlignedBox mBoundingBox;
     Ogre::Real mBoundingRadius;
     ClutterBuffer mClutter;
-    typedef CacheFriendlyRangeSpace<Item*> RS;
+    typedef CacheFriendlyRangeSpaceSIMD<Item*> RS;
     typedef RS::Cargo Cargo;
     RS mSpace;
     Items items;
@@ -22,15 +22,20 @@
 
 #include <sleep.h>
 
+#include <OgreDefaultHardwareBufferManager.h>
+
 #include "../path_util.h"
 #include "../main.h"
 #include "../clipboard.h"
+#include "../frame_arena.h"
+#include "../frame_profiler.h"
 
 #include "clutter.h"
 #include "gfx_body.h"
 #include "gfx_debug.h"
 #include "gfx_decal.h"
 #include "gfx_gl3_plus.h"
+#include "gfx_headless.h"
 #include "hud.h"
 #include "gfx_internal.h"
 #include "gfx_light.h"
@@ -75,6 +80,15 @@ bool use_hwgamma = false; //getenv("GRIT_NOHWGAMMA")==NULL;
 
 static bool reset_frame_buffer_on_next_render = false;
 
+// No window, render system, or GPU.  Stand-ins for the Ogre managers that need a render system.
+static bool headless = false;
+static Ogre::HardwareBufferManager *headless_buffer_manager = NULL;
+static Ogre::TextureManager *headless_texture_manager = NULL;
+// What a window would have been, for code that positions things on the screen.
+static const Vector2 headless_window_size(1024, 768);
+// Time spent on the CPU side of the last frame.
+static GfxLastRenderStats headless_stats;
+
 // For default parameters of functions that take GfxStringMap
 const GfxStringMap gfx_empty_string_map;
 
@@ -541,6 +555,10 @@ void gfx_window_events_pump (void)
 
 void gfx_render (float elapsed, const Vector3 &cam_pos, const Quaternion &cam_dir)
 {
+    FRAME_PROFILER_ZONE("gfx_render");
+    unsigned long long micros_before = micros();
+    // Rendering is once per frame, so scratch space used since the last render is finished with.
+    frame_arena_reset();
     time_since_started_rendering += elapsed;
     anim_time = fmodf(anim_time+elapsed, ANIM_TIME_MAX);
 
@@ -568,6 +586,14 @@ void gfx_render (float elapsed, const Vector3 &cam_pos, const Quaternion &cam_di
             sb->update();
     }
 
+    if (headless) {
+        ftcv->setValue(elapsed);
+        ftcv->setElapsedTime(time_since_started_rendering);
+        ogre_root->setNextFrameNumber(ogre_root->getNextFrameNumber()+1);
+        headless_stats.micros = micros() - micros_before;
+        return;
+    }
+
     try {
         if (reset_frame_buffer_on_next_render) {
             reset_frame_buffer_on_next_render = false;
@@ -662,6 +688,7 @@ void gfx_render (float elapsed, const Vector3 &cam_pos, const Quaternion &cam_di
 void gfx_bake_env_cube (const std::string &filename, unsigned size, const Vector3 &cam_pos,
                         float saturation, const Vector3 &ambient)
 {
+    if (headless) GRIT_EXCEPT("Cannot bake env cubes in headless mode.");
     if ((size & (size-1)) != 0) GRIT_EXCEPT("Can only bake env cubes with power of 2 size");
 
     // make texture
@@ -743,15 +770,21 @@ void gfx_bake_env_cube (const std::string &filename, unsigned size, const Vector
 }
 
 
-void gfx_screenshot (const std::string &filename) { ogre_win->writeContentsToFile(filename); }
+void gfx_screenshot (const std::string &filename)
+{
+    if (headless) GRIT_EXCEPT("Cannot take a screenshot in headless mode.");
+    ogre_win->writeContentsToFile(filename);
+}
 
 bool gfx_window_active (void)
 {
+    if (headless) return true;
     return ogre_win->isActive();
 }
 
 Vector2 gfx_window_size (void)
 {
+    if (headless) return headless_window_size;
     return Vector2(ogre_win->getWidth(), ogre_win->getHeight());
 }
 
@@ -773,8 +806,9 @@ Vector3 gfx_world_to_screen (const Vector3 &cam_pos, const Quaternion &cam_dir,
                                    to_ogre(cam_dir*Quaternion(Degree(90),Vector3(1,0,0))),
                                    nullptr);
 
-    float w = ogre_win->getWidth();
-    float h = ogre_win->getHeight();
+    Vector2 win_size = gfx_window_size();
+    float w = win_size.x;
+    float h = win_size.y;
 
     Ogre::Frustum frustum;
     // Ogre cameras point towards Z whereas in Grit the convention
@@ -799,8 +833,9 @@ Vector3 gfx_screen_to_world (const Vector3 &cam_pos, const Quaternion &cam_dir,
                                    to_ogre(cam_dir*Quaternion(Degree(90),Vector3(1,0,0))),
                                    nullptr);
 
-    float w = ogre_win->getWidth();
-    float h = ogre_win->getHeight();
+    Vector2 win_size = gfx_window_size();
+    float w = win_size.x;
+    float h = win_size.y;
 
     Ogre::Frustum frustum;
     // Ogre cameras point towards Z whereas in Grit the convention
@@ -833,6 +868,12 @@ GfxLastFrameStats gfx_last_frame_stats (void)
 {
     GfxLastFrameStats r;
 
+    if (headless) {
+        // Nothing is submitted, so there are no batches or triangles to count.
+        r.left_gbuffer = headless_stats;
+        return r;
+    }
+
     r.left_deferred = eye_left->getDeferredStats();
     r.left_gbuffer = eye_left->getGBufferStats();
 
@@ -882,6 +923,54 @@ struct MeshSerializerListener : Ogre::MeshSerializerListener {
     }
 } mesh_serializer_listener;
 
+// The resource this thread is in gfx_prepare_resource for, and the bytes of the files opened so far.
+static thread_local const Ogre::Resource *prepared_stream_resource = NULL;
+static thread_local size_t prepared_stream_bytes = 0;
+
+struct ResourceLoadingListener : Ogre::ResourceLoadingListener {
+    Ogre::DataStreamPtr resourceLoading (const Ogre::String &name, const Ogre::String &group,
+                                         Ogre::Resource *resource)
+    {
+        // Files of anything but the resource this thread is preparing are opened as usual.
+        if (resource == NULL || resource != prepared_stream_resource) return Ogre::DataStreamPtr();
+
+        // Only finding the file needs the lock, reading and decoding it happens in the caller.
+        // This calls back here with no resource, so Ogre opens it.
+        Ogre::DataStreamPtr stream;
+        {
+            std::lock_guard<std::mutex> guard(disk_resource_ogre_lock);
+            stream = Ogre::ResourceGroupManager::getSingleton().openResource(name, group);
+        }
+        prepared_stream_bytes += stream->size();
+        return stream;
+    }
+
+    void resourceStreamOpened (const Ogre::String &, const Ogre::String &, Ogre::Resource *,
+                               Ogre::DataStreamPtr &)
+    {
+    }
+
+    bool resourceCollision (Ogre::Resource *, Ogre::ResourceManager *)
+    {
+        // Not resolved, Ogre raises its usual error.
+        return false;
+    }
+} resource_loading_listener;
+
+size_t gfx_prepare_resource (Ogre::Resource &r)
+{
+    prepared_stream_resource = &r;
+    prepared_stream_bytes = 0;
+    try {
+        r.prepare();
+    } catch (...) {
+        prepared_stream_resource = NULL;
+        throw;
+    }
+    prepared_stream_resource = NULL;
+    return prepared_stream_bytes;
+}
+
 struct WindowEventListener : Ogre::WindowEventListener {
 
     void windowResized(Ogre::RenderWindow *rw)
@@ -984,10 +1073,16 @@ bool gfx_d3d9 (void)
     return d3d9;
 }
 
-size_t gfx_init (GfxCallback &cb_)
+bool gfx_headless (void)
+{
+    return headless;
+}
+
+size_t gfx_init (GfxCallback &cb_, bool headless_)
 {
     try {
         gfx_cb = &cb_;
+        headless = headless_;
 
         Ogre::LogManager *lmgr = OGRE_NEW Ogre::LogManager();
         Ogre::Log *ogre_log = OGRE_NEW Ogre::Log("",false,true);
@@ -1003,66 +1098,78 @@ size_t gfx_init (GfxCallback &cb_)
         cg = OGRE_NEW Ogre::CgPlugin();
         ogre_root->installPlugin(cg);
 
-        if (d3d9) {
-            #ifdef WIN32
-            ogre_rs = OGRE_NEW Ogre::D3D9RenderSystem(GetModuleHandle(NULL));
-            ogre_rs->setConfigOption("Allow NVPerfHUD", "Yes");
-            ogre_rs->setConfigOption("Floating-point mode", "Consistent");
-            ogre_rs->setConfigOption("Video Mode", "1024 x 768 @ 32-bit colour");
-            #endif
+        size_t winid = 0;
+        if (headless) {
+            // Ogre has no null render system, so provide the managers that would have come with
+            // one, and do the parts of Root::initialise that do not need a window.
+            headless_buffer_manager = OGRE_NEW Ogre::DefaultHardwareBufferManager();
+            headless_texture_manager = gfx_headless_texture_manager_make();
+            Ogre::MaterialManager::getSingleton().initialise();
+            Ogre::MeshManager::getSingleton()._initialise();
         } else {
-            ogre_rs = gfx_gl3_plus_get_render_system();
-            ogre_rs->setConfigOption("RTT Preferred Mode", "FBO");
-            ogre_rs->setConfigOption("Video Mode", "1024 x 768");
-        }
-        ogre_rs->setConfigOption("sRGB Gamma Conversion", use_hwgamma ? "Yes" : "No");
-        ogre_rs->setConfigOption("Full Screen", "No");
-        ogre_rs->setConfigOption("VSync", "Yes");
-
-        Ogre::ConfigOptionMap &config_opts = ogre_rs->getConfigOptions();
-        CLOG << "Rendersystem options:" << std::endl;
-        for (Ogre::ConfigOptionMap::iterator i=config_opts.begin(),i_=config_opts.end() ; i!=i_ ; ++i) {
-            const Ogre::StringVector &sv = i->second.possibleValues;
-            CLOG << "    " << i->second.name << " (" << (i->second.immutable ? "immutable" : "mutable") << ")  {";
-            for (unsigned j=0 ; j<sv.size() ; ++j) {
-                CLOG << (j==0?" ":", ") << sv[j];
+            if (d3d9) {
+                #ifdef WIN32
+                ogre_rs = OGRE_NEW Ogre::D3D9RenderSystem(GetModuleHandle(NULL));
+                ogre_rs->setConfigOption("Allow NVPerfHUD", "Yes");
+                ogre_rs->setConfigOption("Floating-point mode", "Consistent");
+                ogre_rs->setConfigOption("Video Mode", "1024 x 768 @ 32-bit colour");
+                #endif
+            } else {
+                ogre_rs = gfx_gl3_plus_get_render_system();
+                ogre_rs->setConfigOption("RTT Preferred Mode", "FBO");
+                ogre_rs->setConfigOption("Video Mode", "1024 x 768");
             }
-            CLOG << " }" << std::endl;
-        }
-        ogre_root->setRenderSystem(ogre_rs);
+            ogre_rs->setConfigOption("sRGB Gamma Conversion", use_hwgamma ? "Yes" : "No");
+            ogre_rs->setConfigOption("Full Screen", "No");
+            ogre_rs->setConfigOption("VSync", "Yes");
+
+            Ogre::ConfigOptionMap &config_opts = ogre_rs->getConfigOptions();
+            CLOG << "Rendersystem options:" << std::endl;
+            for (Ogre::ConfigOptionMap::iterator i=config_opts.begin(),i_=config_opts.end() ; i!=i_ ; ++i) {
+                const Ogre::StringVector &sv = i->second.possibleValues;
+                CLOG << "    " << i->second.name << " (" << (i->second.immutable ? "immutable" : "mutable") << ")  {";
+                for (unsigned j=0 ; j<sv.size() ; ++j) {
+                    CLOG << (j==0?" ":", ") << sv[j];
+                }
+                CLOG << " }" << std::endl;
+            }
+            ogre_root->setRenderSystem(ogre_rs);
 
-        ogre_root->initialise(true,"Grit Game Window");
+            ogre_root->initialise(true,"Grit Game Window");
 
-        ogre_win = ogre_root->getAutoCreatedWindow();
+            ogre_win = ogre_root->getAutoCreatedWindow();
 
-        size_t winid;
-        ogre_win->getCustomAttribute("WINDOW", &winid);
-        #ifdef WIN32
-        HMODULE mod = GetModuleHandle(NULL);
-        HICON icon_big = (HICON)LoadImage(mod, MAKEINTRESOURCE(118), IMAGE_ICON,
-                                          0, 0, LR_DEFAULTSIZE|LR_SHARED);
-        HICON icon_small = (HICON)LoadImage(mod,MAKEINTRESOURCE(118), IMAGE_ICON,
-                                          16, 16, LR_DEFAULTSIZE|LR_SHARED);
-        SendMessage((HWND)winid, (UINT)WM_SETICON, (WPARAM) ICON_BIG, (LPARAM) icon_big);
-        SendMessage((HWND)winid, (UINT)WM_SETICON, (WPARAM) ICON_SMALL, (LPARAM) icon_small);
-        #endif
+            ogre_win->getCustomAttribute("WINDOW", &winid);
+            #ifdef WIN32
+            HMODULE mod = GetModuleHandle(NULL);
+            HICON icon_big = (HICON)LoadImage(mod, MAKEINTRESOURCE(118), IMAGE_ICON,
+                                              0, 0, LR_DEFAULTSIZE|LR_SHARED);
+            HICON icon_small = (HICON)LoadImage(mod,MAKEINTRESOURCE(118), IMAGE_ICON,
+                                              16, 16, LR_DEFAULTSIZE|LR_SHARED);
+            SendMessage((HWND)winid, (UINT)WM_SETICON, (WPARAM) ICON_BIG, (LPARAM) icon_big);
+            SendMessage((HWND)winid, (UINT)WM_SETICON, (WPARAM) ICON_SMALL, (LPARAM) icon_small);
+            #endif
 
-        ogre_win->setDeactivateOnFocusChange(false);
+            ogre_win->setDeactivateOnFocusChange(false);
+            Ogre::WindowEventUtilities::addWindowEventListener(ogre_win, &window_event_listener);
+            Ogre::GpuProgramManager::getSingleton().setSaveMicrocodesToCache(false);
+        }
 
         Ogre::TextureManager::getSingleton().setVerbose(false);
         Ogre::MeshManager::getSingleton().setVerbose(false);
 
         Ogre::MeshManager::getSingleton().setListener(&mesh_serializer_listener);
-        Ogre::WindowEventUtilities::addWindowEventListener(ogre_win, &window_event_listener);
+        Ogre::ResourceGroupManager::getSingleton().setLoadingListener(&resource_loading_listener);
         Ogre::ResourceGroupManager::getSingleton().addResourceLocation(".", "FileSystem", RESGRP, true);
         Ogre::ResourceGroupManager::getSingleton().initialiseAllResourceGroups();
 
-        Ogre::GpuProgramManager::getSingleton().setSaveMicrocodesToCache(false);
-        
         ftcv = Ogre::ControllerManager::getSingleton().getFrameTimeSource().dynamicCast<Ogre::FrameTimeControllerValue>();
         if (ftcv.isNull()) {
             CERR << "While initialising Grit, Ogre::FrameControllerValue could not be found!" << std::endl;
         }
+        // The scene manager is kept when headless: bodies and lights still need scene nodes to
+        // hold their transforms, and it does not touch the (missing) render system until
+        // something is rendered.
         ogre_sm = static_cast<Ogre::OctreeSceneManager*>(ogre_root->createSceneManager("OctreeSceneManager"));
         ogre_sm->addListener(&ogre_sm_listener);
         ogre_root_node = ogre_sm->getRootSceneNode();
@@ -1071,16 +1178,21 @@ size_t gfx_init (GfxCallback &cb_)
         ogre_sun = ogre_sm->createLight("Sun");
         ogre_sun->setType(Ogre::Light::LT_DIRECTIONAL);
 
+        // Shaders and materials are only type-checked here (headless skips building the Ogre
+        // passes), so they are set up either way.  The rest allocate hardware buffers that
+        // would never be drawn.
         gfx_shader_init();
         gfx_material_init();
         gfx_sky_material_init();
-        gfx_pipeline_init();
+        if (!headless) gfx_pipeline_init();
         gfx_option_init();
-        gfx_particle_init();
-        gfx_tracer_body_init();
         hud_init();
-        gfx_decal_init();
-        gfx_debug_init();
+        if (!headless) {
+            gfx_particle_init();
+            gfx_tracer_body_init();
+            gfx_decal_init();
+            gfx_debug_init();
+        }
  
         gfx_env_cube(0, DiskResourcePtr<GfxEnvCubeDiskResource>());
         gfx_env_cube(1, DiskResourcePtr<GfxEnvCubeDiskResource>());
@@ -1089,6 +1201,11 @@ size_t gfx_init (GfxCallback &cb_)
 
         shader_scene_env.shadowFactor = 5000;  // See uber.cgh also
 
+        if (headless) {
+            CLOG << "Graphics running headless, nothing will be rendered." << std::endl;
+            return winid;
+        }
+
         CVERB << "Ogre::RSC_RTT_MAIN_DEPTHBUFFER_ATTACHABLE = " << ogre_rs->getCapabilities()->hasCapability(Ogre::RSC_RTT_SEPARATE_DEPTHBUFFER) << std::endl;
         CVERB << "Ogre::RSC_RTT_SEPARATE_DEPTHBUFFER = " << ogre_rs->getCapabilities()->hasCapability(Ogre::RSC_RTT_SEPARATE_DEPTHBUFFER) << std::endl;
         CVERB << "Ogre::RSC_RTT_DEPTHBUFFER_RESOLUTION_LESSEQUAL = " << ogre_rs->getCapabilities()->hasCapability(Ogre::RSC_RTT_DEPTHBUFFER_RESOLUTION_LESSEQUAL) << std::endl;
@@ -1148,7 +1265,10 @@ void gfx_shutdown (void)
         gfx_shader_shutdown();
         ftcv.setNull();
         if (ogre_sm && ogre_root) ogre_root->destroySceneManager(ogre_sm);
+        if (headless_texture_manager) OGRE_DELETE headless_texture_manager;
         if (ogre_root) OGRE_DELETE ogre_root; // internally deletes ogre_rs
+        // Meshes free their buffers when the root goes.
+        if (headless_buffer_manager) OGRE_DELETE headless_buffer_manager;
         OGRE_DELETE octree;
         OGRE_DELETE cg;
     } catch (Ogre::Exception &e) {
@@ -75,7 +75,15 @@ struct GfxCallback {
 bool gfx_d3d9 (void);
 bool gfx_gl3 (void);
 
-size_t gfx_init (GfxCallback &cb);
+/** Initialise the graphics subsystem, returning the window handle.
+ *
+ * In headless mode there is no window (0 is returned) and no render system.  Bodies, lights,
+ * particles, the HUD, etc. keep all their state and can be used from Lua as usual, but nothing
+ * is ever submitted to a GPU.  gfx_render then only advances time and updates the scene.
+ */
+size_t gfx_init (GfxCallback &cb, bool headless);
+
+bool gfx_headless (void);
 
 void gfx_window_events_pump (void);
 
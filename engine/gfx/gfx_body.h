@@ -19,10 +19,10 @@
  * THE SOFTWARE.
  */
 
-#include "../shared_ptr.h"
+#include "../intrusive_ptr.h"
 
 class GfxBody;
-typedef SharedPtr<GfxBody> GfxBodyPtr;
+typedef IntrusivePtr<GfxBody> GfxBodyPtr;
 
 #ifndef GfxBody_h
 #define GfxBody_h
@@ -206,7 +206,7 @@ class GfxBody : public GfxFertileNode, public Ogre::MovableObject {
 
     std::string getMeshName (void) const;
 
-    friend class SharedPtr<GfxBody>;
+    friend class IntrusivePtr<GfxBody>;
     friend class GfxMeshDiskResource;
 };
 
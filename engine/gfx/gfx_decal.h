@@ -20,7 +20,7 @@
  */
 
 class GfxDecal;
-typedef SharedPtr<GfxDecal> GfxDecalPtr;
+typedef IntrusivePtr<GfxDecal> GfxDecalPtr;
 
 #ifndef GFX_DECAL_H
 #define GFX_DECAL_H
@@ -60,7 +60,7 @@ class GfxDecal : public GfxNode {
 
     void destroy (void);
 
-    friend class SharedPtr<GfxDecal>;
+    friend class IntrusivePtr<GfxDecal>;
 };
 
 // called every frame
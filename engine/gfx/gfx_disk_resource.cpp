@@ -49,6 +49,7 @@ GfxMeshDiskResource::GfxMeshDiskResource (const std::string &name)
 {
     try {
         std::string ogre_name = name.substr(1);
+        std::lock_guard<std::mutex> guard(disk_resource_ogre_lock);
         Ogre::HardwareBuffer::Usage u = Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY;
         auto result = Ogre::MeshManager::getSingleton()
                 .createOrRetrieve(ogre_name,RESGRP, false,0, 0, u, u, false, false);
@@ -182,14 +183,16 @@ void GfxMeshDiskResource::loadImpl (void)
             // do as much as we can, given that this is a background thread
             if (gfx_disk_resource_verbose_loads)
                 CVERB << "Preparing an Ogre::Resource: " << rp->getName() << std::endl;
-            rp->prepare();
+            std::vector<std::string> mat_names;
+            gfx_prepare_resource(*rp);
 
             // for meshes, scan the bytes from disk to extract materials, then work out
             // what textures we are depending on...
             Ogre::DataStreamPtr mesh_data = MyMeshHack::getData(rp);
-            std::vector<std::string> mat_names;
             MyMeshDeserializer mmd(mesh_data, Ogre::MeshManager::getSingleton().getListener());
             mmd.importMatNames(rp, mat_names);
+            // The prepared bytes stay in host memory until the mesh is loaded onto the GPU.
+            setHostRAM(mesh_data->size());
 
             GFX_MAT_SYNC;
             if (gfx_disk_resource_verbose_loads) {
@@ -259,6 +262,7 @@ GfxTextureDiskResource::GfxTextureDiskResource (const std::string &name)
 {
     try {
         std::string ogre_name = name.substr(1);
+        std::lock_guard<std::mutex> guard(disk_resource_ogre_lock);
         auto result = Ogre::TextureManager::getSingleton().createOrRetrieve(ogre_name,RESGRP);
         rp = result.first.staticCast<Ogre::Texture>();
     } catch (Ogre::Exception &e) { 
@@ -274,7 +278,8 @@ void GfxTextureDiskResource::loadImpl (void)
             // do as much as we can, given that this is a background thread
             if (gfx_disk_resource_verbose_loads)
                 CVERB << "Preparing an Ogre::Resource: " << rp->getName() << std::endl;
-            rp->prepare();
+            // Ogre does not expose the prepared data, but it is the contents of the files.
+            setHostRAM(gfx_prepare_resource(*rp));
 
         } else {
             CVERB << "Internal warning: Loaded in OGRE, unloaded in GRIT: \"" << getName() << "\"" << std::endl;
@@ -309,12 +314,26 @@ void GfxTextureDiskResource::unloadImpl(void)
 
 
 
+// Like Ogre::Image::load(name, group), but only holds disk_resource_ogre_lock while finding the
+// file, not while decoding it.
+static void load_image (Ogre::Image &img, const std::string &ogre_name)
+{
+    Ogre::DataStreamPtr encoded;
+    {
+        std::lock_guard<std::mutex> guard(disk_resource_ogre_lock);
+        encoded = Ogre::ResourceGroupManager::getSingleton().openResource(ogre_name, RESGRP);
+    }
+    std::string::size_type dot = ogre_name.rfind('.');
+    img.load(encoded, dot == std::string::npos ? "" : ogre_name.substr(dot + 1));
+}
+
 GfxEnvCubeDiskResource::GfxEnvCubeDiskResource (const std::string &name)
     : GfxBaseTextureDiskResource(name)
 {
     APP_ASSERT(name.length()>0 && name[0]=='/');
     try {
         std::string ogre_name = name.substr(1);
+        std::lock_guard<std::mutex> guard(disk_resource_ogre_lock);
         rp = Ogre::TextureManager::getSingleton().createManual(ogre_name, RESGRP, Ogre::TEX_TYPE_CUBE_MAP, 512, 512, Ogre::MIP_DEFAULT, Ogre::PF_UNKNOWN);
     } catch (Ogre::Exception &e) { 
         GRIT_EXCEPT("Couldn't create an env cube: "+e.getFullDescription());
@@ -346,13 +365,16 @@ void GfxEnvCubeDiskResource::loadImpl (void)
         if (gfx_disk_resource_verbose_loads)
             CVERB << "Loading env cube: " << ogre_name << std::endl;
 
-        if (rp->isLoaded()) {
-            CERR << "WARNING: env cube "<<ogre_name<<" should not be loaded in Ogre" << std::endl;
-            rp->unload();
+        {
+            std::lock_guard<std::mutex> guard(disk_resource_ogre_lock);
+            if (rp->isLoaded()) {
+                CERR << "WARNING: env cube "<<ogre_name<<" should not be loaded in Ogre" << std::endl;
+                rp->unload();
+            }
         }
 
         Ogre::Image disk;
-        disk.load (ogre_name, RESGRP);
+        load_image(disk, ogre_name);
         if (disk.getWidth() != disk.getHeight()*6) {
             GRIT_EXCEPT("Environment map has incorrect dimensions: "+ogre_name);
         }
@@ -376,7 +398,13 @@ void GfxEnvCubeDiskResource::loadImpl (void)
         }
 
 
-        rp->loadImage(img);
+        {
+            std::lock_guard<std::mutex> guard(disk_resource_ogre_lock);
+            rp->loadImage(img);
+        }
+
+        // The converted faces are the host copy Ogre uploads from.
+        setHostRAM(img.getSize());
 
     } catch (Ogre::Exception &e) {
 
@@ -404,6 +432,7 @@ GfxColourGradeLUTDiskResource::GfxColourGradeLUTDiskResource (const std::string
     APP_ASSERT(name.length()>0 && name[0]=='/');
     try {
         std::string ogre_name = name.substr(1);
+        std::lock_guard<std::mutex> guard(disk_resource_ogre_lock);
         rp = Ogre::TextureManager::getSingleton().createManual(ogre_name, RESGRP, Ogre::TEX_TYPE_3D, 32, 32, 32, 0, Ogre::PF_UNKNOWN);
     } catch (Ogre::Exception &e) { 
         GRIT_EXCEPT("Couldn't create a LUT texture: "+e.getFullDescription());
@@ -420,13 +449,16 @@ void GfxColourGradeLUTDiskResource::loadImpl (void)
         if (gfx_disk_resource_verbose_loads)
             CVERB << "Loading colour grade LUT: " << ogre_name << std::endl;
 
-        if (rp->isLoaded()) {
-            CERR << "Colour grade "<<ogre_name<<" should not be 'loaded' in Ogre" << std::endl;
-            rp->unload();
+        {
+            std::lock_guard<std::mutex> guard(disk_resource_ogre_lock);
+            if (rp->isLoaded()) {
+                CERR << "Colour grade "<<ogre_name<<" should not be 'loaded' in Ogre" << std::endl;
+                rp->unload();
+            }
         }
 
         Ogre::Image disk;
-        disk.load (ogre_name, RESGRP);
+        load_image(disk, ogre_name);
         unsigned sz = disk.getHeight();
         if (sz != 32) {
             GRIT_EXCEPT("Colour grade LUT does not have dimensions 1024x32: "+ogre_name);
@@ -451,7 +483,11 @@ void GfxColourGradeLUTDiskResource::loadImpl (void)
             }
         }
 
-        rp->loadImage(img);
+        {
+            std::lock_guard<std::mutex> guard(disk_resource_ogre_lock);
+            rp->loadImage(img);
+        }
+        setHostRAM(img.getSize());
 
     } catch (Ogre::Exception &e) {
 
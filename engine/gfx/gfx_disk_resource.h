@@ -101,6 +101,8 @@ class GfxTextureDiskResource : public GfxBaseTextureDiskResource {
     /** Use disk_resource_get_or_make to create a new disk resource. */
     GfxTextureDiskResource (const std::string &name);
 
+    virtual const char *getTypeName (void) const { return "Texture"; }
+
   protected:
 
     /** Load via Ogre (i.e. prepare it in Ogre terminology). */
@@ -125,6 +127,8 @@ class GfxMeshDiskResource : public GfxGPUDiskResource {
     /** Use disk_resource_get_or_make to create a new disk resource. */
     GfxMeshDiskResource (const std::string &name);
 
+    virtual const char *getTypeName (void) const { return "Mesh"; }
+
     /** Return the internal Ogre object. */
     const Ogre::MeshPtr &getOgreMeshPtr (void) { return rp; }
 
@@ -149,6 +153,8 @@ class GfxEnvCubeDiskResource : public GfxBaseTextureDiskResource {
     /** Use disk_resource_get_or_make to create a new disk resource. */
     GfxEnvCubeDiskResource (const std::string &name);
 
+    virtual const char *getTypeName (void) const { return "EnvCube"; }
+
   private:
 
     /** Load via Ogre (i.e. prepare it in Ogre terminology). */
@@ -166,6 +172,8 @@ class GfxColourGradeLUTDiskResource : public GfxBaseTextureDiskResource {
     /** Use disk_resource_get_or_make to create a new disk resource. */
     GfxColourGradeLUTDiskResource (const std::string &name);
 
+    virtual const char *getTypeName (void) const { return "ColourGradeLUT"; }
+
     /** Look up a single colour in the LUT.  The resource must be loaded (onto the GPU). */
     Vector3 lookUp (const Vector3 &v) const;
 
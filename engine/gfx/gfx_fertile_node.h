@@ -19,10 +19,10 @@
  * THE SOFTWARE.
  */
 
-#include "../shared_ptr.h"
+#include "../intrusive_ptr.h"
 
 class GfxFertileNode;
-typedef SharedPtr<GfxFertileNode> GfxNodePtr;
+typedef IntrusivePtr<GfxFertileNode> GfxNodePtr;
 
 #ifndef GfxNode_h
 #define GfxNode_h
@@ -56,7 +56,7 @@ class GfxFertileNode : public GfxNode {
 
     virtual bool hasGraphics (void) const { return false; }
 
-    friend class SharedPtr<GfxFertileNode>;
+    friend class IntrusivePtr<GfxFertileNode>;
 };
 
 #endif
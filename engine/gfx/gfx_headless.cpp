@@ -0,0 +1,122 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <OgreResourceGroupManager.h>
+#include <OgreTexture.h>
+
+#include "gfx_headless.h"
+
+namespace {
+
+    class HeadlessTexture : public Ogre::Texture {
+
+        public:
+
+        HeadlessTexture (Ogre::ResourceManager *creator, const Ogre::String &name,
+                         Ogre::ResourceHandle handle, const Ogre::String &group, bool is_manual,
+                         Ogre::ManualResourceLoader *loader)
+          : Ogre::Texture(creator, name, handle, group, is_manual, loader)
+        { }
+
+        ~HeadlessTexture (void)
+        {
+            // The manager unloads everything before it goes away, so this cannot call back into a
+            // deleted manager.
+            if (isLoaded()) unload();
+        }
+
+        Ogre::HardwarePixelBufferSharedPtr getBuffer (size_t face, size_t mipmap)
+        {
+            (void) face;
+            (void) mipmap;
+            return Ogre::HardwarePixelBufferSharedPtr();
+        }
+
+        // Procedural textures (env cubes, colour grade LUTs) are loaded from images.  Keep the
+        // dimensions so they can still be described, and drop the pixels.
+        void _loadImages (const Ogre::ConstImagePtrList &images)
+        {
+            if (images.empty()) return;
+            const Ogre::Image &img = *images[0];
+            mSrcWidth = mWidth = img.getWidth();
+            mSrcHeight = mHeight = img.getHeight();
+            mSrcDepth = mDepth = img.getDepth();
+            mSrcFormat = mFormat = img.getFormat();
+        }
+
+        protected:
+
+        void loadImpl (void) { }
+        void createInternalResourcesImpl (void) { }
+        void freeInternalResourcesImpl (void) { }
+    };
+
+    class HeadlessTextureManager : public Ogre::TextureManager {
+
+        public:
+
+        HeadlessTextureManager (void)
+        {
+            Ogre::ResourceGroupManager::getSingleton()._registerResourceManager(mResourceType, this);
+        }
+
+        ~HeadlessTextureManager (void)
+        {
+            unloadAll();
+            removeAll();
+            Ogre::ResourceGroupManager::getSingleton()._unregisterResourceManager(mResourceType);
+        }
+
+        Ogre::PixelFormat getNativeFormat (Ogre::TextureType type, Ogre::PixelFormat format,
+                                           int usage)
+        {
+            (void) type;
+            (void) usage;
+            return format;
+        }
+
+        bool isHardwareFilteringSupported (Ogre::TextureType type, Ogre::PixelFormat format,
+                                           int usage, bool precise_format_only)
+        {
+            (void) type;
+            (void) format;
+            (void) usage;
+            (void) precise_format_only;
+            return true;
+        }
+
+        protected:
+
+        Ogre::Resource *createImpl (const Ogre::String &name, Ogre::ResourceHandle handle,
+                                    const Ogre::String &group, bool is_manual,
+                                    Ogre::ManualResourceLoader *loader,
+                                    const Ogre::NameValuePairList *params)
+        {
+            (void) params;
+            return OGRE_NEW HeadlessTexture(this, name, handle, group, is_manual, loader);
+        }
+    };
+
+}
+
+Ogre::TextureManager *gfx_headless_texture_manager_make (void)
+{
+    return OGRE_NEW HeadlessTextureManager();
+}
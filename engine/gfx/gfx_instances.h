@@ -19,10 +19,10 @@
  * THE SOFTWARE.
  */
 
-#include "../shared_ptr.h"
+#include "../intrusive_ptr.h"
 
 class GfxInstances;
-typedef SharedPtr<GfxInstances> GfxInstancesPtr;
+typedef IntrusivePtr<GfxInstances> GfxInstancesPtr;
 
 
 #ifndef GFX_INSTANCES_H
@@ -120,7 +120,7 @@ class GfxInstances : public GfxNode, public Ogre::MovableObject {
 
     std::string getMeshName (void) const;
 
-    friend class SharedPtr<GfxInstances>;
+    friend class IntrusivePtr<GfxInstances>;
 };
 
 #endif
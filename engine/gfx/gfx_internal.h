@@ -65,6 +65,12 @@ extern DiskResourcePtr<GfxTextureDiskResource> fade_dither_map;
 extern DiskResourcePtr<GfxTextureDiskResource> corona_map;
 extern DiskResourcePtr<GfxTextureDiskResource> shadow_pcf_noise_map;
 
+// Prepare the resource on a loader thread.  Ogre finds each of its files while holding
+// disk_resource_ogre_lock, but reads and decodes them without it, so several loader threads can do
+// so at once.  Returns the size of the files, which stay in host memory until the resource is
+// loaded onto the GPU.
+size_t gfx_prepare_resource (Ogre::Resource &r);
+
 static inline bool stereoscopic (void)
 { return gfx_option(GFX_CROSS_EYE) || gfx_option(GFX_ANAGLYPH); }
 
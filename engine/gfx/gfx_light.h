@@ -20,7 +20,7 @@
  */
 
 class GfxLight;
-typedef SharedPtr<GfxLight> GfxLightPtr;
+typedef IntrusivePtr<GfxLight> GfxLightPtr;
 
 #ifndef GFX_LIGHT_H
 #define GFX_LIGHT_H
@@ -90,7 +90,7 @@ class GfxLight : public GfxNode {
 
     void destroy (void);
 
-    friend class SharedPtr<GfxLight>;
+    friend class IntrusivePtr<GfxLight>;
 };
 
 #endif
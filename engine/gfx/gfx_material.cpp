@@ -120,6 +120,9 @@ void GfxMaterial::buildOgreMaterials (void)
     shader->populateMeshEnv(false, boneBlendWeights, meshEnv);
     shader->populateMeshEnv(true, boneBlendWeights, meshEnvInstanced);
 
+    // Nothing will be rendered, and there is no render system to compile shaders for.
+    if (gfx_headless()) return;
+
     // TODO: wireframe for instanced geometry?
     p = create_or_reset_material(name + ":wireframe");
     shader->initPass(p, GFX_GSL_PURPOSE_WIREFRAME, matEnv, meshEnv, textures, bindings);
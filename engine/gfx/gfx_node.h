@@ -19,11 +19,11 @@
  * THE SOFTWARE.
  */
 
-#include "../shared_ptr.h"
+#include "../intrusive_ptr.h"
 
 class GfxNode;
 class GfxFertileNode;
-typedef SharedPtr<GfxFertileNode> GfxNodePtr;
+typedef IntrusivePtr<GfxFertileNode> GfxNodePtr;
 
 #ifndef GfxLeaf_h
 #define GfxLeaf_h
@@ -45,7 +45,7 @@ typedef SharedPtr<GfxFertileNode> GfxNodePtr;
  * scenegraph uses the Grit Transform struct which has correct handling of non-uniform scaling
  * (where !(x == y == z)).
  */
-class GfxNode : public fast_erase_index {
+class GfxNode : public fast_erase_index, public RefCounted {
     protected:
     static const std::string className;
     Vector3 localPos, localScale;
@@ -340,7 +340,7 @@ static void options_update (bool flush)
             reset_shadows = true;
             break;
             case GFX_VSYNC:
-            ogre_win->setVSyncEnabled(v_new);
+            if (!gfx_headless()) ogre_win->setVSyncEnabled(v_new);
             break;
             case GFX_FULLSCREEN:
             reset_fullscreen = true;
@@ -531,6 +531,9 @@ static void options_update (bool flush)
         }
     }
 
+    // No window or frame buffer to reconfigure.
+    if (gfx_headless()) reset_fullscreen = reset_framebuffer = false;
+
     if (reset_fullscreen) {
         unsigned width = gfx_option(GFX_FULLSCREEN_WIDTH);
         unsigned height = gfx_option(GFX_FULLSCREEN_HEIGHT);
@@ -19,10 +19,10 @@
  * THE SOFTWARE.
  */
 
-#include "../shared_ptr.h"
+#include "../intrusive_ptr.h"
 
 class GfxRangedInstances;
-typedef SharedPtr<GfxRangedInstances> GfxRangedInstancesPtr;
+typedef IntrusivePtr<GfxRangedInstances> GfxRangedInstancesPtr;
 
 
 #ifndef GFX_RANGED_INSTANCES_H
@@ -67,7 +67,7 @@ class GfxRangedInstances : public GfxInstances, public StreamerCallback {
     };
     typedef std::vector<Item> Items;
 
-    typedef CacheFriendlyRangeSpace<Item*> RS;
+    typedef CacheFriendlyRangeSpaceSIMD<Item*> RS;
     typedef RS::Cargo Cargo;
     RS mSpace;
     Items items;
@@ -102,7 +102,7 @@ class GfxRangedInstances : public GfxInstances, public StreamerCallback {
         return className;
     }
 
-    friend class SharedPtr<GfxRangedInstances>;
+    friend class IntrusivePtr<GfxRangedInstances>;
 };
 
 #endif
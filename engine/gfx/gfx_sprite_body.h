@@ -20,7 +20,7 @@
  */
 
 class GfxSpriteBody;
-typedef SharedPtr<GfxSpriteBody> GfxSpriteBodyPtr;
+typedef IntrusivePtr<GfxSpriteBody> GfxSpriteBodyPtr;
 
 #ifndef GFX_SPRITE_BODY_H
 #define GFX_SPRITE_BODY_H
@@ -77,7 +77,7 @@ class GfxSpriteBody : public GfxNode {
 
     void destroy (void);
 
-    friend class SharedPtr<GfxSpriteBody>;
+    friend class IntrusivePtr<GfxSpriteBody>;
 };
 
 #endif
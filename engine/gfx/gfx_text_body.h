@@ -19,10 +19,10 @@
  * THE SOFTWARE.
  */
 
-#include "../shared_ptr.h"
+#include "../intrusive_ptr.h"
 
 class GfxTextBody;
-typedef SharedPtr<GfxTextBody> GfxTextBodyPtr;
+typedef IntrusivePtr<GfxTextBody> GfxTextBodyPtr;
 
 #ifndef GfxTextBody_h
 #define GfxTextBody_h
@@ -150,7 +150,7 @@ class GfxTextBody : public GfxFertileNode, public Ogre::MovableObject {
 
     bool hasGraphics (void) const { return true; }
 
-    friend class SharedPtr<GfxTextBody>;
+    friend class IntrusivePtr<GfxTextBody>;
 };
 
 #endif
@@ -29,7 +29,7 @@ class GfxPipeline;
 #include <math_util.h>
 
 #include "../vect_util.h"
-#include "../shared_ptr.h"
+#include "../intrusive_ptr.h"
 
 #include "gfx.h"
 #include "gfx_disk_resource.h"
@@ -117,8 +117,8 @@ class GfxTracerBody : public GfxNode {
     ~GfxTracerBody (void);
 
     public:
-    static SharedPtr<GfxTracerBody> make (const GfxNodePtr &par_=GfxNodePtr(NULL))
-    { return SharedPtr<GfxTracerBody>(new GfxTracerBody(par_)); }
+    static IntrusivePtr<GfxTracerBody> make (const GfxNodePtr &par_=GfxNodePtr(NULL))
+    { return IntrusivePtr<GfxTracerBody>(new GfxTracerBody(par_)); }
 
     bool isEnabled (void) const;
     void setEnabled (bool v);
@@ -152,7 +152,7 @@ class GfxTracerBody : public GfxNode {
 
     void assertAlive (void) const;
 
-    friend class SharedPtr<GfxTracerBody>;
+    friend class IntrusivePtr<GfxTracerBody>;
 };
 
 // Called every frame.
@@ -1022,58 +1022,7 @@ static unsigned cornered_quad_vdecl_size;
 
 void hud_init (void)
 {
-    win_size = Vector2(ogre_win->getWidth(), ogre_win->getHeight());
-
-    // Prepare vertex buffers
-    quad_vdata = OGRE_NEW Ogre::VertexData();
-    quad_vdata->vertexStart = 0;
-    quad_vdata->vertexCount = 6;
-    quad_vdecl_size = 0;
-    quad_vdecl_size += quad_vdata->vertexDeclaration->addElement(0, quad_vdecl_size, Ogre::VET_FLOAT2, Ogre::VES_POSITION).getSize();
-    quad_vdecl_size += quad_vdata->vertexDeclaration->addElement(0, quad_vdecl_size, Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES,0).getSize();
-    quad_vbuf =
-        Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
-            quad_vdecl_size, 6, Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
-    quad_vdata->vertexBufferBinding->setBinding(0, quad_vbuf);
-
-    cornered_quad_vdata = OGRE_NEW Ogre::VertexData();
-    cornered_quad_vdata->vertexStart = 0;
-    cornered_quad_vdata->vertexCount = 16;
-    cornered_quad_vdecl_size = 0;
-    cornered_quad_vdecl_size += cornered_quad_vdata->vertexDeclaration->addElement(0, cornered_quad_vdecl_size, Ogre::VET_FLOAT2, Ogre::VES_POSITION).getSize();
-    cornered_quad_vdecl_size += cornered_quad_vdata->vertexDeclaration->addElement(0, cornered_quad_vdecl_size, Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES,0).getSize();
-    cornered_quad_vbuf =
-        Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
-            cornered_quad_vdecl_size, 16, Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
-    cornered_quad_vdata->vertexBufferBinding->setBinding(0, cornered_quad_vbuf);
-
-    unsigned cornered_quad_indexes = 6*9;
-    cornered_quad_ibuf =
-        Ogre::HardwareBufferManager::getSingleton().createIndexBuffer(
-            Ogre::HardwareIndexBuffer::IT_16BIT,
-            cornered_quad_indexes,
-            Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY);
-
-    cornered_quad_idata = OGRE_NEW Ogre::IndexData();
-    cornered_quad_idata->indexStart = 0;
-    cornered_quad_idata->indexCount = cornered_quad_indexes;
-    cornered_quad_idata->indexBuffer = cornered_quad_ibuf;
-
-    /* c d e f
-     * 8 9 a b
-     * 4 5 6 7    d c
-     * 0 1 2 3    a b
-     */
-    #define QUAD(a,b,c,d) a, b, d,  c, d, b
-    uint16_t cornered_quad_idata_raw[] = {
-        QUAD( 0, 1, 5, 4), QUAD( 1, 2, 6, 5), QUAD( 2, 3, 7, 6),
-        QUAD( 4, 5, 9, 8), QUAD( 5, 6,10, 9), QUAD( 6, 7,11,10),
-        QUAD( 8, 9,13,12), QUAD( 9,10,14,13), QUAD(10,11,15,14),
-    };
-    #undef QUAD
-
-    cornered_quad_ibuf->writeData(
-        0, cornered_quad_indexes*sizeof(uint16_t), &cornered_quad_idata_raw[0], true);
+    win_size = gfx_window_size();
 
     GfxGslRunParams shader_rect_params = {
         {"colour", GfxGslParam::float3(1, 1, 1)},
@@ -1126,6 +1075,60 @@ void hud_init (void)
     shader_text = gfx_shader_make_or_reset(
         "/system/HudText", vertex_code, "", text_colour_code, shader_text_params, false);
 
+    // Hud objects still need their shaders to build material environments, but nothing is
+    // drawn headless, so there is no point allocating the quad buffers.
+    if (gfx_headless()) return;
+
+    // Prepare vertex buffers
+    quad_vdata = OGRE_NEW Ogre::VertexData();
+    quad_vdata->vertexStart = 0;
+    quad_vdata->vertexCount = 6;
+    quad_vdecl_size = 0;
+    quad_vdecl_size += quad_vdata->vertexDeclaration->addElement(0, quad_vdecl_size, Ogre::VET_FLOAT2, Ogre::VES_POSITION).getSize();
+    quad_vdecl_size += quad_vdata->vertexDeclaration->addElement(0, quad_vdecl_size, Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES,0).getSize();
+    quad_vbuf =
+        Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
+            quad_vdecl_size, 6, Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
+    quad_vdata->vertexBufferBinding->setBinding(0, quad_vbuf);
+
+    cornered_quad_vdata = OGRE_NEW Ogre::VertexData();
+    cornered_quad_vdata->vertexStart = 0;
+    cornered_quad_vdata->vertexCount = 16;
+    cornered_quad_vdecl_size = 0;
+    cornered_quad_vdecl_size += cornered_quad_vdata->vertexDeclaration->addElement(0, cornered_quad_vdecl_size, Ogre::VET_FLOAT2, Ogre::VES_POSITION).getSize();
+    cornered_quad_vdecl_size += cornered_quad_vdata->vertexDeclaration->addElement(0, cornered_quad_vdecl_size, Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES,0).getSize();
+    cornered_quad_vbuf =
+        Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
+            cornered_quad_vdecl_size, 16, Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
+    cornered_quad_vdata->vertexBufferBinding->setBinding(0, cornered_quad_vbuf);
+
+    unsigned cornered_quad_indexes = 6*9;
+    cornered_quad_ibuf =
+        Ogre::HardwareBufferManager::getSingleton().createIndexBuffer(
+            Ogre::HardwareIndexBuffer::IT_16BIT,
+            cornered_quad_indexes,
+            Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY);
+
+    cornered_quad_idata = OGRE_NEW Ogre::IndexData();
+    cornered_quad_idata->indexStart = 0;
+    cornered_quad_idata->indexCount = cornered_quad_indexes;
+    cornered_quad_idata->indexBuffer = cornered_quad_ibuf;
+
+    /* c d e f
+     * 8 9 a b
+     * 4 5 6 7    d c
+     * 0 1 2 3    a b
+     */
+    #define QUAD(a,b,c,d) a, b, d,  c, d, b
+    uint16_t cornered_quad_idata_raw[] = {
+        QUAD( 0, 1, 5, 4), QUAD( 1, 2, 6, 5), QUAD( 2, 3, 7, 6),
+        QUAD( 4, 5, 9, 8), QUAD( 5, 6,10, 9), QUAD( 6, 7,11,10),
+        QUAD( 8, 9,13,12), QUAD( 9,10,14,13), QUAD(10,11,15,14),
+    };
+    #undef QUAD
+
+    cornered_quad_ibuf->writeData(
+        0, cornered_quad_indexes*sizeof(uint16_t), &cornered_quad_idata_raw[0], true);
 }
 
 void hud_shutdown (lua_State *L)
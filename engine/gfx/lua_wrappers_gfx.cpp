@@ -630,6 +630,7 @@ TRY_START
     check_args(L,2);
     GET_UD_MACRO(GfxBodyPtr,self,1,GFXBODY_TAG);
     const char *key = luaL_checkstring(L,2);
+    LUA_BINDING_ARGS_DONE;
     if (!::strcmp(key,"localPosition")) {
         push_v3(L, self->getLocalPosition());
     } else if (!::strcmp(key,"localOrientation")) {
@@ -771,6 +772,7 @@ TRY_START
     check_args(L,3);
     GET_UD_MACRO(GfxBodyPtr,self,1,GFXBODY_TAG);
     const char *key = luaL_checkstring(L,2);
+    LUA_BINDING_ARGS_DONE;
     if (!::strcmp(key,"localPosition")) {
         Vector3 v = check_v3(L,3);
         self->setLocalPosition(v);
@@ -1120,21 +1122,21 @@ MT_MACRO_NEWINDEX(gfxdecal);
 
 // GFXTRACERBODY ============================================================== {{{
 
-void push_gfxtracerbody (lua_State *L, const SharedPtr<GfxTracerBody> &self)
+void push_gfxtracerbody (lua_State *L, const IntrusivePtr<GfxTracerBody> &self)
 {
     if (self.isNull())
         lua_pushnil(L);
     else
-        push(L,new SharedPtr<GfxTracerBody>(self),GFXTRACERBODY_TAG);
+        push(L,new IntrusivePtr<GfxTracerBody>(self),GFXTRACERBODY_TAG);
 }
 
-GC_MACRO(SharedPtr<GfxTracerBody>,gfxtracerbody,GFXTRACERBODY_TAG)
+GC_MACRO(IntrusivePtr<GfxTracerBody>,gfxtracerbody,GFXTRACERBODY_TAG)
 
 static int gfxtracerbody_pump (lua_State *L)
 {
 TRY_START
     check_args(L,1);
-    GET_UD_MACRO(SharedPtr<GfxTracerBody>,self,1,GFXTRACERBODY_TAG);
+    GET_UD_MACRO(IntrusivePtr<GfxTracerBody>,self,1,GFXTRACERBODY_TAG);
     self->pump();
     return 0;
 TRY_END
@@ -1144,19 +1146,19 @@ static int gfxtracerbody_destroy (lua_State *L)
 {
 TRY_START
     check_args(L,1);
-    GET_UD_MACRO(SharedPtr<GfxTracerBody>,self,1,GFXTRACERBODY_TAG);
+    GET_UD_MACRO(IntrusivePtr<GfxTracerBody>,self,1,GFXTRACERBODY_TAG);
     self->destroy();
     return 0;
 TRY_END
 }
 
-TOSTRING_SMART_PTR_MACRO (gfxtracerbody,SharedPtr<GfxTracerBody>,GFXTRACERBODY_TAG)
+TOSTRING_SMART_PTR_MACRO (gfxtracerbody,IntrusivePtr<GfxTracerBody>,GFXTRACERBODY_TAG)
 
 static int gfxtracerbody_index (lua_State *L)
 {
 TRY_START
     check_args(L,2);
-    GET_UD_MACRO(SharedPtr<GfxTracerBody>,self,1,GFXTRACERBODY_TAG);
+    GET_UD_MACRO(IntrusivePtr<GfxTracerBody>,self,1,GFXTRACERBODY_TAG);
     const char *key = luaL_checkstring(L,2);
     if (!::strcmp(key,"localPosition")) {
         push_v3(L, self->getLocalPosition());
@@ -1208,7 +1210,7 @@ static int gfxtracerbody_newindex (lua_State *L)
 {
 TRY_START
     check_args(L,3);
-    GET_UD_MACRO(SharedPtr<GfxTracerBody>,self,1,GFXTRACERBODY_TAG);
+    GET_UD_MACRO(IntrusivePtr<GfxTracerBody>,self,1,GFXTRACERBODY_TAG);
     const char *key = luaL_checkstring(L,2);
     if (!::strcmp(key,"localPosition")) {
         Vector3 v = check_v3(L,3);
@@ -1263,7 +1265,7 @@ TRY_START
 TRY_END
 }
 
-EQ_MACRO(SharedPtr<GfxTracerBody>,gfxtracerbody,GFXTRACERBODY_TAG)
+EQ_MACRO(IntrusivePtr<GfxTracerBody>,gfxtracerbody,GFXTRACERBODY_TAG)
 
 MT_MACRO_NEWINDEX(gfxtracerbody);
 
@@ -4996,7 +4998,7 @@ TRY_START
 
     typedef ExternalTable::KeyIterator KI;
     for (KI i=t.begin(), i_=t.end() ; i!=i_ ; ++i) {
-        const std::string &key = i->first;
+        const std::string &key = i->key.str();
         if (key == "vertexCode") continue;
         if (key == "dangsCode") continue;
         if (key == "additionalCode") continue;
@@ -5128,6 +5130,15 @@ TRY_START
 TRY_END
 }
 
+static int global_gfx_headless (lua_State *L)
+{
+TRY_START
+    check_args(L,0);
+    lua_pushboolean(L, gfx_headless());
+    return 1;
+TRY_END
+}
+
 static int global_gfx_describe_texture (lua_State *L)
 {
 TRY_START
@@ -5194,6 +5205,7 @@ TRY_END
 static const luaL_reg global[] = {
 
     {"gfx_d3d9", global_gfx_d3d9},
+    {"gfx_headless", global_gfx_headless},
 
     {"gfx_render", global_gfx_render},
     {"gfx_bake_env_cube", global_gfx_bake_env_cube},
@@ -50,7 +50,7 @@ void push_gfxtextbody (lua_State *L, const GfxTextBodyPtr &self);
 void push_gfxdecal (lua_State *L, const GfxDecalPtr &self);
 
 #define GFXTRACERBODY_TAG "Grit/TracerBody"
-void push_gfxtracerbody (lua_State *L, const SharedPtr<GfxTracerBody> &self);
+void push_gfxtracerbody (lua_State *L, const IntrusivePtr<GfxTracerBody> &self);
 
 #define GFXINSTANCES_TAG "Grit/GfxInstances"
 void push_gfxinstances (lua_State *L, const GfxInstancesPtr &self);
@@ -61,6 +61,12 @@ void push_gfxlight (lua_State *L, const GfxLightPtr &self);
 #define GFXNODE_TAG "Grit/GfxFertileNode"
 void push_gfxnode (lua_State *L, const GfxNodePtr &self);
 
+/** Accepts a GfxFertileNode or GfxBody. */
+GfxNodePtr check_gfx_node (lua_State *L, int idx);
+
+/** Pushes the node as its most derived type, or nil. */
+void push_gfx_node_concrete (lua_State *L, const GfxNodePtr &np);
+
 #define GFXRANGEDINSTANCES_TAG "Grit/GfxRangedInstances"
 void push_gfxrangedinstances (lua_State *L, const GfxRangedInstancesPtr &self);
 
@@ -23,22 +23,33 @@ COL_CONV_CPP_SRCS= \
 
 
 COL_CONV_STANDALONE_CPP_SRCS = \
+	physics/bcol_bake.cpp \
 	physics/grit_col_conv.cpp \
 	$(COL_CONV_CPP_SRCS) \
 
 
+PACK_STANDALONE_CPP_SRCS = \
+	grit_pack.cpp \
+
+
 ENGINE_CPP_SRCS=\
+	asset_archive.cpp \
 	background_loader.cpp \
 	bullet_debug_drawer.cpp \
 	core_option.cpp \
 	dense_index_map.cpp \
 	disk_resource.cpp \
+	disk_resource_types.cpp \
 	external_table.cpp \
+	frame_arena.cpp \
+	frame_profiler.cpp \
 	grit_class.cpp \
 	grit_lua_util.cpp \
 	grit_object.cpp \
 	input_filter.cpp \
+	job_system.cpp \
 	ldbglue.cpp \
+	lua_binding_stats.cpp \
 	lua_wrappers_core.cpp \
 	lua_wrappers_disk_resource.cpp \
 	lua_wrappers_gritobj.cpp \
@@ -60,6 +71,7 @@ ENGINE_CPP_SRCS=\
 	gfx/gfx_fertile_node.cpp \
 	gfx/gfx_font.cpp \
 	gfx/gfx_gl3_plus.cpp \
+	gfx/gfx_headless.cpp \
 	gfx/gfx_instances.cpp \
 	gfx/gfx_light.cpp \
 	gfx/gfx_material.cpp \
@@ -101,8 +113,27 @@ ENGINE_CPP_SRCS=\
 	 \
 	physics/collision_mesh.cpp \
 	physics/lua_wrappers_physics.cpp \
+	physics/parallel_dynamics_world.cpp \
 	physics/physical_material.cpp \
 	physics/physics_world.cpp \
 	$(COL_CONV_CPP_SRCS) \
 	$(GSL_CPP_SRCS) \
 
+
+
+# Standalone micro-benchmarks, each one builds to bench_<name>.
+ENGINE_BENCHMARK_CPP_SRCS= \
+	benchmarks/external_table.cpp \
+	benchmarks/frame_arena.cpp \
+	benchmarks/lru_queue.cpp \
+	benchmarks/physics.cpp \
+	benchmarks/range_space.cpp \
+	benchmarks/refcount.cpp \
+
+# The parts of the engine linked into bench_physics.
+PHYSICS_BENCHMARK_CPP_SRCS= \
+	frame_arena.cpp \
+	frame_profiler.cpp \
+	job_system.cpp \
+	physics/parallel_dynamics_world.cpp \
+
@@ -23,10 +23,59 @@
 
 static GritClassMap classes;
 
+// Bumped whenever a class is added or redefined, as its parent may be used by other classes.
+static unsigned long class_cache_generation = 0;
+
+void GritClass::flushCache (lua_State *L)
+{
+    for (Cache::iterator i=cache.begin(), i_=cache.end() ; i != i_ ; ++i) {
+        i->second.value.setNil(L);
+    }
+    cache.clear();
+    cacheGeneration = class_cache_generation;
+}
+
+const GritClass::Resolved &GritClass::resolve (lua_State *L, const ExternalTableKey &key)
+{
+    if (cacheGeneration != class_cache_generation) flushCache(L);
+    Cache::iterator i = cache.find(key);
+    if (i != cache.end()) return i->second;
+
+    // Only add to the cache once the lookup has succeeded.
+    get(L, key.str());
+    Resolved &r = cache[key];
+    r.type = lua_type(L, -1);
+    r.copied = (r.type == LUA_TTABLE || r.type == LUA_TUSERDATA) && table.has(key);
+    r.number = r.type == LUA_TNUMBER ? lua_tonumber(L, -1) : 0;
+    if (r.type != LUA_TNIL && r.type != LUA_TNUMBER && !r.copied) {
+        r.value.set(L);
+    } else {
+        lua_pop(L, 1);
+    }
+    return r;
+}
+
+void GritClass::getCached (lua_State *L, const ExternalTableKey &key)
+{
+    const Resolved &r = resolve(L, key);
+    if (r.type == LUA_TNIL) {
+        lua_pushnil(L);
+    } else if (r.type == LUA_TNUMBER) {
+        lua_pushnumber(L, r.number);
+    } else if (r.copied) {
+        // Tables are copied out of the ExternalTable each time, as get() does.
+        const char *err = table.luaGet(L, key);
+        if (err) my_lua_error(L, err);
+    } else {
+        r.value.push(L);
+    }
+}
+
 GritClass *class_add (lua_State *L, const std::string& name)
 {
     GritClass *gcp;
     GritClassMap::iterator i = classes.find(name);
+    class_cache_generation++;
     
     if (i!=classes.end()) {
         gcp = i->second;
@@ -86,3 +135,8 @@ size_t class_count (void)
 {
     return classes.size();
 }
+
+void class_invalidate_caches (void)
+{
+    class_cache_generation++;
+}
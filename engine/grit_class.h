@@ -21,6 +21,7 @@
 
 #include <string>
 #include <map>
+#include <unordered_map>
 
 class GritClass;
 typedef std::map<std::string, GritClass*> GritClassMap;
@@ -52,6 +53,14 @@ extern "C" {
  * is used whenever the class itself does not provide a mapping for a given
  * key.  For its own mappings, the class uses an ExternalTable to store data
  * without pressurising the Lua garbage collector.
+ *
+ * The engine reads the same few keys (callbacks, renderingDistance) for every
+ * object, so the class also caches them as resolved through the parent.  The
+ * cache is flushed when the class's own mappings change, and every class's
+ * cache is flushed when any class is added or redefined, which is when parents
+ * get replaced.  Changes made in place to a parent's Lua table are not seen
+ * until then, call class_invalidate_caches() after making them.  Lua code
+ * reading the class always sees the live values.
  */
 class GritClass {
 
@@ -59,7 +68,7 @@ class GritClass {
 
     /** Create a class using class_add, this function is internal. */
     GritClass (lua_State *L, const std::string &name_)
-          : name(name_), refCount(1)
+          : name(name_), refCount(1), cacheGeneration(0)
     {
         int index = lua_gettop(L);
         for (lua_pushnil(L) ; lua_next(L, index)!=0 ; lua_pop(L, 1)) {
@@ -74,6 +83,7 @@ class GritClass {
     void setParent (lua_State *L)
     {
         parentClass.set(L);
+        flushCache(L);
     }
 
     /** Push the parent to the top of the Lua stack. */
@@ -97,11 +107,33 @@ class GritClass {
         }
     }
 
+    /** Like get, but through the cache, so after the first time neither the class's table nor
+     * the parent is consulted.  Use this for keys that the engine reads for every object. */
+    void getCached (lua_State *L, const ExternalTableKey &key);
+
+    /** The Lua type (e.g. LUA_TNIL) of the value for the given key, via the cache.  Only touches
+     * the Lua stack the first time. */
+    int getCachedType (lua_State *L, const ExternalTableKey &key)
+    {
+        return resolve(L, key).type;
+    }
+
+    /** If the value for the given key is a number, set v to it, via the cache.  Only touches the
+     * Lua stack the first time. */
+    bool getCachedNumber (lua_State *L, const ExternalTableKey &key, lua_Number &v)
+    {
+        const Resolved &r = resolve(L, key);
+        if (r.type != LUA_TNUMBER) return false;
+        v = r.number;
+        return true;
+    }
+
     /** Set the given key to the value at the top of the Lua stack. */
     void set (lua_State *L, const std::string &key)
     {
         const char *err = table.luaSet(L, key);
         if (err) my_lua_error(L, err);
+        flushCache(L);
     }
 
     /** Set the key at Lua stack position -2 to the value at Lua stack position -1. */
@@ -109,6 +141,7 @@ class GritClass {
     {
         const char *err = table.luaSet(L);
         if (err) my_lua_error(L, err);
+        flushCache(L);
     }
 
     /** Push a table to the stack containing the key/value mappings in this class. */
@@ -133,6 +166,7 @@ class GritClass {
     {
         refCount--;
         if (refCount>0) return;
+        flushCache(L);
         table.destroy(L);
         parentClass.setNil(L);
         delete this;
@@ -156,6 +190,30 @@ class GritClass {
     /** The class's key/value mappings. */
     ExternalTable table;
 
+    /** A key as seen through the parent. */
+    struct Resolved {
+        /** The Lua type, LUA_TNIL if unbound. */
+        int type;
+        /** Whether it is a table or userdata from our own table, which is copied out each time. */
+        bool copied;
+        /** The value, if it is a number. */
+        lua_Number number;
+        /** The value, unless nil, a number, or copied. */
+        LuaPtr value;
+    };
+
+    typedef std::unordered_map<ExternalTableKey, Resolved, ExternalTableKey::Hash> Cache;
+
+    /** Keys resolved since the cache was last flushed. */
+    Cache cache;
+
+    /** Compared with the global generation, to flush after a class is added or redefined. */
+    unsigned long cacheGeneration;
+
+    const Resolved &resolve (lua_State *L, const ExternalTableKey &key);
+
+    void flushCache (lua_State *L);
+
 };
 
 /** Create a new class or replace the existing class with the given name.  Uses
@@ -184,5 +242,9 @@ void class_all (GritClassMap::iterator &begin, GritClassMap::iterator &end);
 /** Return the number of classes currently in the system. */
 size_t class_count (void);
 
+/** Forget everything that classes have cached from their parents, e.g. because the parent tables
+ * have been modified in place.  The caches are refilled lazily. */
+void class_invalidate_caches (void);
+
 
 #endif
@@ -31,13 +31,17 @@ extern "C" {
 #include <lua_util.h>
 #include <lua_wrappers_common.h>
 
+#include "lua_binding_stats.h"
 
-#define TRY_START try {
+
+#define TRY_START LUA_BINDING_PROBE try {
 #define TRY_END } catch (Ogre::Exception &e) { \
     std::string msg = e.getFullDescription(); \
+    LUA_BINDING_ERROR; \
     my_lua_error(L,msg); \
     return 0; \
 } catch (Exception &e) { \
+    LUA_BINDING_ERROR; \
     my_lua_error(L,e.msg); \
     return 0; \
 }
@@ -19,8 +19,10 @@
  * THE SOFTWARE.
  */
 
+#include <algorithm>
 #include <cmath>
 
+#include "frame_profiler.h"
 #include "main.h"
 #include "grit_object.h"
 #include "grit_class.h"
@@ -29,9 +31,149 @@
 #include "lua_wrappers_gritobj.h"
 
 
+namespace {
+
+    /** A dense list of objects, each of which remembers its index so it can be removed in O(1).
+     * While the list is being swept, removal only forgets the index, and additions are queued, so
+     * the sweep never copies the list and references into it stay valid while Lua runs.  The list
+     * is compacted when the sweep finishes. */
+    class CallbackList {
+
+        public:
+
+        typedef int (GritObject::*GetIndex) (void) const;
+        typedef void (GritObject::*SetIndex) (int);
+
+        CallbackList (GetIndex get_index, SetIndex set_index)
+          : getIndex(get_index), setIndex(set_index), sweeping(false), dirty(false)
+        { }
+
+        void add (const GritObjectPtr &o)
+        {
+            if (sweeping) {
+                ((*o).*setIndex)(slots.size() + pending.size());
+                pending.push_back(o);
+            } else {
+                ((*o).*setIndex)(slots.size());
+                slots.push_back(o);
+            }
+        }
+
+        void remove (const GritObjectPtr &o)
+        {
+            size_t index = ((*o).*getIndex)();
+            ((*o).*setIndex)(-1);
+            if (sweeping) {
+                dirty = true;
+                return;
+            }
+            // Keep the object alive until we are done, the caller may be holding it via the list.
+            GritObjectPtr last = slots.back();
+            slots.pop_back();
+            if (index == slots.size()) return;
+            slots[index] = last;
+            ((*last).*setIndex)(index);
+        }
+
+        /** Call the named callback on everything in the list, and remove objects that do not
+         * have one or whose callback raised an error.  Objects added during the sweep are not
+         * visited until the next one.
+         *
+         * The callbacks are resolved a batch at a time, onto the Lua stack, before any of that
+         * batch is run.  The lookups then run back to back instead of being interleaved with the
+         * Lua calls.  The catch is that a callback replaced by an earlier one in the same batch
+         * is only picked up on the next sweep. */
+        void sweep (lua_State *L, float elapsed, const ExternalTableKey &key)
+        {
+            push_cfunction(L, my_lua_error_handler);
+            int error_handler = lua_gettop(L);
+            // Room for the batch, plus a callback's arguments and an error message.
+            lua_checkstack(L, BATCH + 4);
+            sweeping = true;
+            try {
+                for (size_t b=0 ; b<slots.size() ; b+=BATCH) {
+                    size_t e = std::min(b + BATCH, slots.size());
+                    for (size_t i=b ; i<e ; ++i) {
+                        const GritObjectPtr &o = slots[i];
+                        // Removed during this sweep.
+                        if (((*o).*getIndex)() != int(i)) {
+                            lua_pushnil(L);
+                            continue;
+                        }
+                        o->getField(L, key);
+                    }
+                    //stack: err, callback[b] ... callback[e-1]
+                    for (size_t i=b ; i<e ; ++i) {
+                        const GritObjectPtr &o = slots[i];
+                        // Removed during this sweep, possibly by an earlier callback.
+                        if (((*o).*getIndex)() != int(i)) continue;
+                        lua_pushvalue(L, error_handler + 1 + int(i - b));
+                        if (!o->callCallback(L, o, elapsed, error_handler)
+                            && ((*o).*getIndex)() == int(i)) {
+                            ((*o).*setIndex)(-1);
+                            dirty = true;
+                        }
+                    }
+                    lua_settop(L, error_handler);
+                }
+            } catch (...) {
+                finishSweep(L, error_handler);
+                throw;
+            }
+            finishSweep(L, error_handler);
+        }
+
+        private:
+
+        static const size_t BATCH = 64;
+
+        void finishSweep (lua_State *L, int error_handler)
+        {
+            // The error handler, and any callbacks left over from an interrupted batch.
+            lua_settop(L, error_handler - 1);
+            sweeping = false;
+            if (dirty || pending.size() > 0) compact();
+        }
+
+        void compact (void)
+        {
+            size_t swept = slots.size();
+            size_t j = 0;
+            for (size_t i=0 ; i<swept ; ++i) {
+                if (((*slots[i]).*getIndex)() != int(i)) continue;
+                if (i != j) {
+                    slots[j] = slots[i];
+                    ((*slots[j]).*setIndex)(j);
+                }
+                j++;
+            }
+            slots.resize(j);
+            for (size_t i=0 ; i<pending.size() ; ++i) {
+                const GritObjectPtr &o = pending[i];
+                // Removed again before the sweep finished.
+                if (((*o).*getIndex)() != int(swept + i)) continue;
+                ((*o).*setIndex)(slots.size());
+                slots.push_back(o);
+            }
+            pending.clear();
+            dirty = false;
+        }
+
+        const GetIndex getIndex;
+        const SetIndex setIndex;
+        GObjPtrs slots;
+        GObjPtrs pending;
+        bool sweeping;
+        bool dirty;
+    };
+
+}
+
 static GObjMap objs;
-static GObjSet objs_needing_frame_callbacks;
-static GObjSet objs_needing_step_callbacks;
+static CallbackList objs_needing_frame_callbacks(&GritObject::getFrameCallbackIndex,
+                                                 &GritObject::updateFrameCallbackIndex);
+static CallbackList objs_needing_step_callbacks(&GritObject::getStepCallbackIndex,
+                                                &GritObject::updateStepCallbackIndex);
 static GObjPtrs loaded;
 static unsigned long long name_generation_counter;
 
@@ -41,8 +183,11 @@ GritObject::GritObject (const std::string &name_,
     anonymous(false),
     gritClass(gritClass_),
     lua(LUA_NOREF),
-    needsFrameCallbacks(false),
-    needsStepCallbacks(false),
+    prefetching(false),
+    index(-1),
+    activatedIndex(-1),
+    frameCallbackIndex(-1),
+    stepCallbackIndex(-1),
     demandRegistered(false),
     imposedFarFade(1.0),
     lastFade(-1)
@@ -53,11 +198,11 @@ GritObject::GritObject (const std::string &name_,
 void GritObject::destroy (lua_State *L, const GritObjectPtr &self)
 {
     if (gritClass==NULL) return;;
-    if (needsFrameCallbacks) {
-        objs_needing_frame_callbacks.erase(self);
+    if (frameCallbackIndex != -1) {
+        objs_needing_frame_callbacks.remove(self);
     }
-    if (needsStepCallbacks) {
-        objs_needing_step_callbacks.erase(self);
+    if (stepCallbackIndex != -1) {
+        objs_needing_step_callbacks.remove(self);
     }
     setNearObj(self, GritObjectPtr());
     setFarObj(self, GritObjectPtr());
@@ -89,7 +234,8 @@ void GritObject::notifyFade (lua_State *L,
 
     // call into lua...
     //stack: err
-    getField(L, "setFade");
+    static const ExternalTableKey key("setFade");
+    getField(L, key);
     //stack: err, class, callback
     if (lua_isnil(L, -1)) {
         // TODO(dcunnin): We should add needsFadeCallbacks.
@@ -161,7 +307,8 @@ void GritObject::activate (lua_State *L,
     //stack: err
 
     //stack: err
-    getField(L, "activate");
+    static const ExternalTableKey key("activate");
+    getField(L, key);
     //stack: err, callback
     if (lua_isnil(L, -1)) {
         // don't activate it as class does not have activate function
@@ -283,7 +430,8 @@ bool GritObject::deactivate (lua_State *L, const GritObjectPtr &self)
     //stack: err
 
     //stack: err
-    getField(L, "deactivate");
+    static const ExternalTableKey key("deactivate");
+    getField(L, key);
     //stack: err, callback
     if (lua_isnil(L, -1)) {
         lua_pop(L, 2);
@@ -345,7 +493,8 @@ void GritObject::init (lua_State *L, const GritObjectPtr &self)
     //stack: err
 
     //stack: err
-    getField(L, "init");
+    static const ExternalTableKey key("init");
+    getField(L, key);
     //stack: err, callback
     if (lua_isnil(L, -1)) {
         lua_pop(L, 2);
@@ -383,89 +532,33 @@ void GritObject::init (lua_State *L, const GritObjectPtr &self)
 
 }
 
-bool GritObject::frameCallback (lua_State *L, const GritObjectPtr &self, float elapsed)
+bool GritObject::callCallback (lua_State *L, const GritObjectPtr &self, float elapsed,
+                               int error_handler)
 {
-    if (gritClass==NULL) GRIT_EXCEPT("Object destroyed");
-
     STACK_BASE;
-    //stack is empty
-
-    push_cfunction(L, my_lua_error_handler);
-    int error_handler = lua_gettop(L);
-
-    //stack: err
-    getField(L, "frameCallback");
-    //stack: err, callback
+    //stack: err, ..., callback
     if (lua_isnil(L, -1)) {
-        lua_pop(L, 2);
-        //stack is empty
-        STACK_CHECK;
-        return false;
-    }
-
-    // Call the callback.
-
-    lua_checkstack(L, 2);
-    push_gritobj(L, self); // persistent grit obj
-    lua_pushnumber(L, elapsed); // time since last frame
-    //stack: err, callback, instance, elapsed
-    int status = lua_pcall(L, 2, 0, error_handler);
-    if (status) {
-        //stack: err, msg
-        // pop the error message since the error handler will
-        // have already printed it out
         lua_pop(L, 1);
-        //stack: err
-    }
-    //stack: err
-
-    lua_pop(L, 1);
-    //stack is empty
-    STACK_CHECK;
-
-    return status == 0;
-}
-
-bool GritObject::stepCallback (lua_State *L, const GritObjectPtr &self, float elapsed)
-{
-    if (gritClass==NULL) GRIT_EXCEPT("Object destroyed");
-
-    STACK_BASE;
-    //stack is empty
-
-    push_cfunction(L, my_lua_error_handler);
-    int error_handler = lua_gettop(L);
-
-    //stack: err
-
-    getField(L, "stepCallback");
-    //stack: err, callback
-    if (lua_isnil(L, -1)) {
-        lua_pop(L, 2);
-        //stack is empty
-        STACK_CHECK;
+        //stack: err, ...
+        STACK_CHECK_N(-1);
         return false;
     }
 
     // Call the callback.
 
-    lua_checkstack(L, 2);
     push_gritobj(L, self); // persistent grit obj
-    lua_pushnumber(L, elapsed); // time since last frame
-    //stack: err, callback, instance, elapsed
+    lua_pushnumber(L, elapsed); // time since last frame or step
+    //stack: err, ..., callback, instance, elapsed
     int status = lua_pcall(L, 2, 0, error_handler);
     if (status) {
-        //stack: err, msg
+        //stack: err, ..., msg
         // pop the error message since the error handler will
         // have already printed it out
         lua_pop(L, 1);
-        //stack: err
+        //stack: err, ...
     }
-    //stack: err
-
-    lua_pop(L, 1);
-    //stack is empty
-    STACK_CHECK;
+    //stack: err, ...
+    STACK_CHECK_N(-1);
 
     return status == 0;
 }
@@ -476,6 +569,7 @@ void GritObject::updateSphere (const Vector3 &pos_, float r_)
     pos = pos_;
     r = r_;
     streamer_update_sphere(index, pos, r);
+    if (activatedIndex != -1) streamer_update_activated_sphere(activatedIndex, pos, r);
 }
 
 void GritObject::updateSphere (const Vector3 &pos_)
@@ -491,26 +585,24 @@ void GritObject::updateSphere (float r_)
 void GritObject::setNeedsFrameCallbacks (const GritObjectPtr &self, bool v)
 {
     if (gritClass==NULL) GRIT_EXCEPT("Object destroyed");
-    if (v == needsFrameCallbacks) return;
-    needsFrameCallbacks = v;
+    if (v == getNeedsFrameCallbacks()) return;
 
     if (!v) {
-        objs_needing_frame_callbacks.erase(self);
+        objs_needing_frame_callbacks.remove(self);
     } else {
-        objs_needing_frame_callbacks.insert(self);
+        objs_needing_frame_callbacks.add(self);
     }
 }
 
 void GritObject::setNeedsStepCallbacks (const GritObjectPtr &self, bool v)
 {
     if (gritClass==NULL) GRIT_EXCEPT("Object destroyed");
-    if (v == needsStepCallbacks) return;
-    needsStepCallbacks = v;
+    if (v == getNeedsStepCallbacks()) return;
 
     if (!v) {
-        objs_needing_step_callbacks.erase(self);
+        objs_needing_step_callbacks.remove(self);
     } else {
-        objs_needing_step_callbacks.insert(self);
+        objs_needing_step_callbacks.add(self);
     }
 }
 
@@ -526,31 +618,59 @@ void GritObject::getField (lua_State *L, const std::string &f) const
     gritClass->get(L, f);
 }
 
+void GritObject::getField (lua_State *L, const ExternalTableKey &f) const
+{
+    if (gritClass==NULL) GRIT_EXCEPT("Object destroyed");
+
+    const char *err = userValues.luaGet(L, f);
+    if (err) my_lua_error(L, err);
+    if (!lua_isnil(L, -1)) return;
+    lua_pop(L, 1);
+    gritClass->getCached(L, f);
+}
+
 
 
 
 
+/** Set name to Unnamed:<class>:<n> for the next unused n.  Maps can have hundreds of thousands of
+ * anonymous objects, so this avoids a stringstream per object. */
+static void object_anonymous_name (std::string &name, GritClass *grit_class)
+{
+    name = "Unnamed:";
+    name += grit_class->name;
+    name += ':';
+    size_t prefix = name.length();
+    do {
+        char digits[24];
+        char *p = digits + sizeof digits;
+        unsigned long long n = name_generation_counter++;
+        do {
+            *--p = '0' + n % 10;
+            n /= 10;
+        } while (n > 0);
+        name.resize(prefix);
+        name.append(p, digits + sizeof digits - p);
+    } while (objs.find(name) != objs.end());
+}
+
 GritObjectPtr object_add (lua_State *L, std::string name, GritClass *grit_class)
 {
     bool anonymous = false;
     if (name=="") {
         anonymous = true;
-        do {
-            std::stringstream ss;
-            ss << "Unnamed:" << grit_class->name
-               << ":" << name_generation_counter++;
-            name = ss.str();
-        } while (objs.find(name) != objs.end());
-    }
-
-    GObjMap::iterator i = objs.find(name);
-
-    if (i != objs.end()) {
-        object_del(L, i->second);
+        object_anonymous_name(name, grit_class);
+    } else {
+        GObjMap::iterator i = objs.find(name);
+        if (i != objs.end()) {
+            object_del(L, i->second);
+        }
     }
 
     GritObjectPtr self = GritObjectPtr(new GritObject(name, grit_class));
     self->anonymous = anonymous;
+    // Assigned rather than inserted: the destroy callbacks of a replaced object may have
+    // created another object with this name, and as before the newest one wins.
     objs[name] = self;
     streamer_list(self);
 
@@ -566,7 +686,7 @@ void object_del (lua_State *L, const GritObjectPtr &o)
     // Since object deactivation can trigger other objects to be destroyed,
     // sometimes when quitting, due to the order in which the objects are destroyed,
     // we destroy an object that is already dead...
-    if (i != objs.end()) objs.erase(o->name);
+    if (i != objs.end()) objs.erase(i);
 }
 
 const GritObjectPtr &object_get (const std::string &name)
@@ -584,17 +704,53 @@ bool object_has (const std::string &name)
 }
 
 
-void object_all (GObjMap::iterator &begin, GObjMap::iterator &end)
+static bool object_name_less (const GritObjectPtr &a, const GritObjectPtr &b)
+{
+    return a->name < b->name;
+}
+
+void object_all (GObjPtrs &all)
+{
+    all.clear();
+    all.reserve(objs.size());
+    for (GObjMap::iterator i=objs.begin(), i_=objs.end() ; i != i_ ; ++i) {
+        all.push_back(i->second);
+    }
+}
+
+/** Does the object exist and belong to the named class? */
+static bool object_is_of_class (const GritObjectPtr &o, const std::string &cls)
+{
+    GritClass *oc = o->getClass();
+    if (oc == NULL) return false; // object destroyed
+    return oc->name == cls;
+}
+
+void object_all_of_class (GObjPtrs &all, const std::string &cls)
+{
+    all.clear();
+    for (GObjMap::iterator i=objs.begin(), i_=objs.end() ; i != i_ ; ++i) {
+        if (object_is_of_class(i->second, cls)) all.push_back(i->second);
+    }
+}
+
+size_t object_count_of_class (const std::string &cls)
 {
-    begin = objs.begin();
-    end = objs.end();
+    size_t counter = 0;
+    for (GObjMap::iterator i=objs.begin(), i_=objs.end() ; i != i_ ; ++i) {
+        if (object_is_of_class(i->second, cls)) counter++;
+    }
+    return counter;
 }
 
 void object_all_del (lua_State *L)
 {
-    GObjMap m = objs;
-    for (GObjMap::iterator i=m.begin(), i_=m.end() ; i != i_ ; ++i) {
-        object_del(L, i->second);
+    // Sorted so the destroy callbacks run in the same order whatever the name index's layout.
+    GObjPtrs all;
+    object_all(all);
+    std::sort(all.begin(), all.end(), object_name_less);
+    for (size_t i=0 ; i<all.size() ; ++i) {
+        object_del(L, all[i]);
     }
 }
 
@@ -602,24 +758,21 @@ int object_count (void) {
     return objs.size();
 }
 
+void object_reserve (size_t n)
+{
+    objs.reserve(n);
+}
+
 void object_do_frame_callbacks (lua_State *L, float elapsed)
 {
-    GObjSet victims = objs_needing_frame_callbacks;
-    typedef GObjSet::iterator I;
-    for (I i=victims.begin(), i_=victims.end() ; i != i_ ; ++i) {
-        if (!(*i)->frameCallback(L, *i, elapsed)) {
-            (*i)->setNeedsFrameCallbacks(*i, false);
-        }
-    }
+    FRAME_PROFILER_ZONE("object_do_frame_callbacks");
+    static const ExternalTableKey key("frameCallback");
+    objs_needing_frame_callbacks.sweep(L, elapsed, key);
 }
 
 void object_do_step_callbacks (lua_State *L, float elapsed)
 {
-    GObjSet victims = objs_needing_step_callbacks;
-    typedef GObjSet::iterator I;
-    for (I i=victims.begin(), i_=victims.end() ; i != i_ ; ++i) {
-        if (!(*i)->stepCallback(L, *i, elapsed)) {
-            (*i)->setNeedsStepCallbacks(*i, false);
-        }
-    }
+    FRAME_PROFILER_ZONE("object_do_step_callbacks");
+    static const ExternalTableKey key("stepCallback");
+    objs_needing_step_callbacks.sweep(L, elapsed, key);
 }
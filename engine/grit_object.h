@@ -19,16 +19,18 @@
  * THE SOFTWARE.
  */
 
+#include <algorithm>
 #include <map>
 #include <vector>
 #include <set>
 #include <string>
+#include <unordered_map>
 
-#include "shared_ptr.h"
+#include "intrusive_ptr.h"
 
 class GritObject;
-typedef SharedPtr<GritObject> GritObjectPtr;
-typedef std::map<std::string, GritObjectPtr> GObjMap;
+typedef IntrusivePtr<GritObject> GritObjectPtr;
+typedef std::unordered_map<std::string, GritObjectPtr> GObjMap;
 typedef std::vector<GritObjectPtr> GObjPtrs;
 typedef std::set<GritObjectPtr> GObjSet;
 
@@ -69,7 +71,7 @@ typedef std::set<GritObjectPtr> GObjSet;
  *
  * TODO: talk about lods
  */ 
-class GritObject {
+class GritObject : public RefCounted {
 
     public:
 
@@ -113,18 +115,15 @@ class GritObject {
         }
     }
 
-    /** Call the Lua per-frame callback, with the given elapsed time
-     * quantity.  A frame is a discrete unit of graphical display. */
-    bool frameCallback (lua_State *L,
-                        const GritObjectPtr &self,
-                        const float time);
-
-    /** Call the Lua per-game-tick callback, with the given elapsed time
-     * quantity.  A step is a unit of game logic, including rigid body motion
-     * calculations.*/
-    bool stepCallback (lua_State *L,
+    /** Call a Lua per-frame or per-step callback, with the given elapsed time
+     * quantity.  The callback (as resolved by getField, possibly nil) must be on
+     * top of the Lua stack, and is popped.  The error handler must already be on
+     * the Lua stack, at the given index.  Returns false if there was no callback
+     * or it raised an error. */
+    bool callCallback (lua_State *L,
                        const GritObjectPtr &self,
-                       const float time);
+                       const float time,
+                       int error_handler);
 
     /** Call the Lua fade callback. 
      *
@@ -161,6 +160,18 @@ class GritObject {
         return demand.requestLoad((cam_pos - pos).length2());
     }
 
+    /** Like requestLoad, but for an object that is not yet in range, only expected to be soon.
+     * Such requests are given a lower priority than those from objects that are in range. */
+    bool requestPrefetch (const Vector3 &cam_pos)
+    {
+        return demand.requestLoad(4 * (cam_pos - pos).length2());
+    }
+
+    /** Whether the streamer holds a prefetch request on our disk resources. */
+    bool isPrefetching (void) const { return prefetching; }
+    /** Whether the streamer holds a prefetch request on our disk resources. */
+    void setPrefetching (bool v) { prefetching = v; }
+
     /** Indicate that a previous request to load should now be cancelled,
      * and that the resources are no-longer needed.  They may be unloaded if system
      * resource pressure requires it.
@@ -202,15 +213,34 @@ class GritObject {
     float getFade (void) const { return lastFade; }
 
     /** Whether or not this object should have its frame callback invoked every frame. */
-    bool getNeedsFrameCallbacks (void) const { return needsFrameCallbacks; }
+    bool getNeedsFrameCallbacks (void) const { return frameCallbackIndex != -1; }
     /** Whether or not this object should have its frame callback invoked every frame. */
     void setNeedsFrameCallbacks (const GritObjectPtr &self, bool v);
 
     /** Whether or not this object should have its step callback invoked every frame. */
-    bool getNeedsStepCallbacks (void) const { return needsStepCallbacks; }
+    bool getNeedsStepCallbacks (void) const { return stepCallbackIndex != -1; }
     /** Whether or not this object should have its step callback invoked every frame. */
     void setNeedsStepCallbacks (const GritObjectPtr &self, bool v);
 
+    /** The list of objects needing frame callbacks requires the object to remember its index
+     * within that list (-1 if not in it). */
+    inline void updateFrameCallbackIndex (int index_)
+    {
+        frameCallbackIndex = index_;
+    }
+
+    /** The index within the list of objects needing frame callbacks, or -1. */
+    int getFrameCallbackIndex (void) const { return frameCallbackIndex; }
+
+    /** As updateFrameCallbackIndex, for step callbacks. */
+    inline void updateStepCallbackIndex (int index_)
+    {
+        stepCallbackIndex = index_;
+    }
+
+    /** The index within the list of objects needing step callbacks, or -1. */
+    int getStepCallbackIndex (void) const { return stepCallbackIndex; }
+
     /** The object's name. */
     const std::string name;
 
@@ -222,6 +252,19 @@ class GritObject {
         index = index_;
     }
 
+    /** The index within the RangeSpace, or -1. */
+    int getIndex (void) const { return index; }
+
+    /** Similarly, the streamer's list of activated objects requires the object to remember
+     * its index within that list (-1 if not activated). */
+    inline void updateActivatedIndex (int index_)
+    {
+        activatedIndex = index_;
+    }
+
+    /** The index within the streamer's list of activated objects, or -1. */
+    int getActivatedIndex (void) const { return activatedIndex; }
+
     /** Update the position and rendering distance of this object. */
     void updateSphere (const Vector3 &pos, float r_);
     /** Update just the position of this object. */
@@ -316,6 +359,19 @@ class GritObject {
         return (cam_pos - pos).length2() < rad*rad;
     }
 
+    /** Is the object within range of any point on the segment from a to b, using the given
+     * global scaling factor on rendering distances. */
+    bool withinRangeOfSegment (const Vector3 &a, const Vector3 &b, float factor) const
+    {
+        const Vector3 ab = b - a;
+        const Vector3 ap = pos - a;
+        const float len2 = ab.length2();
+        float t = len2 > 0 ? (ap.x*ab.x + ap.y*ab.y + ap.z*ab.z) / len2 : 0;
+        t = std::max(0.0f, std::min(1.0f, t));
+        const float rad = r*factor;
+        return (ap - ab*t).length2() < rad*rad;
+    }
+
     /** If you are the 'far' lod for this object, you must fade out by this
      * amount because you are transitioning with the 'near' lod. */
     float getImposedFarFade (void) const { return imposedFarFade; }
@@ -328,6 +384,9 @@ class GritObject {
 
     void getField (lua_State *L, const std::string &f) const;
 
+    /** As getField, but using the class's cache.  For keys the engine looks up itself. */
+    void getField (lua_State *L, const ExternalTableKey &f) const;
+
     protected:
 
     /** Current position of the object. */
@@ -344,14 +403,22 @@ class GritObject {
      * registry. */
     int lua;
 
+    /** Whether the streamer holds a prefetch request on our disk resources. */
+    bool prefetching;
+
     /** The index of the object within the range space. */
     int index;
 
-    /** Whether or not the callbacks should be called. */
-    bool needsFrameCallbacks;
+    /** The index of the object within the streamer's list of activated objects. */
+    int activatedIndex;
+
+    /** The index within the list of objects needing frame callbacks, or -1 if they should not
+     * be called. */
+    int frameCallbackIndex;
 
-    /** Whether or not the callbacks should be called. */
-    bool needsStepCallbacks;
+    /** The index within the list of objects needing step callbacks, or -1 if they should not
+     * be called. */
+    int stepCallbackIndex;
 
     /** The lod companion that should be activated when the player is closer to the object. */
     GritObjectPtr nearObj;
@@ -389,15 +456,25 @@ const GritObjectPtr &object_get (const std::string &name);
 /** Does an object exist with this name? */
 bool object_has (const std::string &name);
     
-/** Return all objects, via the two iterator 'byref' params. */
-void object_all (GObjMap::iterator &begin, GObjMap::iterator &end);
+/** Return all objects, in no particular order. */
+void object_all (GObjPtrs &all);
 
-/** Clear all objects from the game map. */
+/** Return all objects of the named class, in no particular order. */
+void object_all_of_class (GObjPtrs &all, const std::string &cls);
+
+/** Return the number of objects of the named class. */
+size_t object_count_of_class (const std::string &cls);
+
+/** Clear all objects from the game map, in name order. */
 void object_all_del (lua_State *L);
 
 /** Return the number of objects that currently exist. */
 int object_count (void);
 
+/** Make room for the given total number of objects, so that adding many at once (e.g. when
+ * loading a map) does not repeatedly grow the name index. */
+void object_reserve (size_t n);
+
 /** Call the frame callbacks for all objects, providing the given elapsed time quantity. */
 void object_do_frame_callbacks (lua_State *L, float elapsed);
 
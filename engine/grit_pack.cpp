@@ -0,0 +1,261 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef WIN32
+#  include <windows.h>
+#else
+#  include <dirent.h>
+#  include <sys/stat.h>
+#endif
+
+#include "asset_archive.h"
+
+#define VERSION "1.0"
+
+const char *info =
+"grit_pack (c) The Grit Game Engine authors 2016  (version: " VERSION ")\n"
+"I pack a directory tree into an archive that Grit can mount, or list an archive.\n\n";
+
+const char *usage =
+"Usage: grit_pack <dir> <archive>     pack everything under <dir>\n"
+"       grit_pack -l <archive>        list the contents of <archive>\n\n"
+"Files are named in the archive as Grit would name them with <dir> as the root,\n"
+"e.g. <dir>/system/init.lua becomes /system/init.lua\n";
+
+struct Entry {
+    std::string name;  // as seen by Grit, e.g. /system/init.lua
+    std::string path;  // on disk
+    uint64_t offset;
+    uint64_t length;
+    uint32_t nameOffset;
+    bool operator< (const Entry &o) const { return name < o.name; }
+};
+
+// Appends all the files under dir (a path on disk) to entries.  prefix is the Grit name of dir.
+static bool walk (const std::string &dir, const std::string &prefix, std::vector<Entry> &entries)
+{
+    #ifdef WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &data);
+    if (h == INVALID_HANDLE_VALUE) {
+        std::cerr << "Cannot read directory: \"" << dir << "\"" << std::endl;
+        return false;
+    }
+    do {
+        std::string leaf = data.cFileName;
+        if (leaf == "." || leaf == "..") continue;
+        std::string path = dir + "\\" + leaf;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if (!walk(path, prefix + leaf + "/", entries)) {
+                FindClose(h);
+                return false;
+            }
+        } else {
+            Entry e;
+            e.name = prefix + leaf;
+            e.path = path;
+            entries.push_back(e);
+        }
+    } while (FindNextFileA(h, &data));
+    FindClose(h);
+    #else
+    DIR *d = opendir(dir.c_str());
+    if (d == NULL) {
+        std::cerr << "Cannot read directory: \"" << dir << "\" (" << strerror(errno) << ")"
+                  << std::endl;
+        return false;
+    }
+    while (struct dirent *ent = readdir(d)) {
+        std::string leaf = ent->d_name;
+        if (leaf == "." || leaf == "..") continue;
+        std::string path = dir + "/" + leaf;
+        struct stat st;
+        if (stat(path.c_str(), &st) == -1) {
+            std::cerr << "Cannot stat: \"" << path << "\" (" << strerror(errno) << ")" << std::endl;
+            closedir(d);
+            return false;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            if (!walk(path, prefix + leaf + "/", entries)) {
+                closedir(d);
+                return false;
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            Entry e;
+            e.name = prefix + leaf;
+            e.path = path;
+            entries.push_back(e);
+        }
+    }
+    closedir(d);
+    #endif
+    return true;
+}
+
+static void pad (std::ofstream &out, uint64_t &pos, uint64_t alignment)
+{
+    while (pos % alignment != 0) {
+        out.put(0);
+        pos++;
+    }
+}
+
+static int pack (const std::string &dir, const std::string &filename)
+{
+    std::vector<Entry> entries;
+    if (!walk(dir, "/", entries)) return EXIT_FAILURE;
+    // Deterministic output, and files in the same directory end up close together.
+    std::sort(entries.begin(), entries.end());
+
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    if (!out.good()) {
+        std::cerr << "Cannot open for writing: \"" << filename << "\"" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Written again at the end once the offsets are known.
+    AssetArchiveHeader header;
+    memset(&header, 0, sizeof header);
+    out.write(reinterpret_cast<const char*>(&header), sizeof header);
+    uint64_t pos = sizeof header;
+
+    std::vector<char> buf;
+    for (size_t i=0 ; i<entries.size() ; ++i) {
+        Entry &e = entries[i];
+        std::ifstream in(e.path.c_str(), std::ios::binary);
+        if (!in.good()) {
+            std::cerr << "Cannot open: \"" << e.path << "\"" << std::endl;
+            return EXIT_FAILURE;
+        }
+        buf.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        pad(out, pos, ASSET_ARCHIVE_ALIGNMENT);
+        e.offset = pos;
+        e.length = buf.size();
+        out.write(buf.data(), buf.size());
+        pos += buf.size();
+    }
+
+    header.namesOffset = pos;
+    uint64_t names_length = 0;
+    for (size_t i=0 ; i<entries.size() ; ++i) {
+        Entry &e = entries[i];
+        if (names_length + e.name.length() > 0xFFFFFFFFULL) {
+            std::cerr << "Too many files." << std::endl;
+            return EXIT_FAILURE;
+        }
+        e.nameOffset = uint32_t(names_length);
+        out.write(e.name.data(), e.name.length());
+        names_length += e.name.length();
+    }
+    pos += names_length;
+
+    // At most half full, so probe sequences are short and there is always an empty slot.
+    uint32_t num_slots = 1;
+    while (num_slots < 2 * entries.size()) num_slots *= 2;
+    std::vector<AssetArchiveSlot> slots(num_slots);
+    memset(slots.data(), 0, num_slots * sizeof(AssetArchiveSlot));
+    for (size_t i=0 ; i<entries.size() ; ++i) {
+        const Entry &e = entries[i];
+        uint64_t hash = asset_archive_hash(e.name.data(), e.name.length());
+        uint32_t j = hash & (num_slots - 1);
+        while (slots[j].nameLength != 0) j = (j + 1) & (num_slots - 1);
+        AssetArchiveSlot &slot = slots[j];
+        slot.hash = hash;
+        slot.offset = e.offset;
+        slot.length = e.length;
+        slot.nameOffset = e.nameOffset;
+        slot.nameLength = uint32_t(e.name.length());
+    }
+    pad(out, pos, alignof(AssetArchiveSlot));
+    header.slotsOffset = pos;
+    out.write(reinterpret_cast<const char*>(slots.data()), num_slots * sizeof(AssetArchiveSlot));
+
+    memcpy(header.magic, ASSET_ARCHIVE_MAGIC, sizeof header.magic);
+    header.version = ASSET_ARCHIVE_VERSION;
+    header.numSlots = num_slots;
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof header);
+
+    out.close();
+    if (!out.good()) {
+        std::cerr << "Error writing: \"" << filename << "\"" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Packed " << entries.size() << " files (" << header.namesOffset << " bytes) into \""
+              << filename << "\"" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+static int list (const std::string &filename)
+{
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    std::vector<char> buf((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    AssetArchiveHeader header;
+    if (buf.size() < sizeof header) {
+        std::cerr << "Not an archive: \"" << filename << "\"" << std::endl;
+        return EXIT_FAILURE;
+    }
+    memcpy(&header, buf.data(), sizeof header);
+    if (memcmp(header.magic, ASSET_ARCHIVE_MAGIC, sizeof header.magic) != 0
+        || header.version != ASSET_ARCHIVE_VERSION
+        || header.slotsOffset + uint64_t(header.numSlots) * sizeof(AssetArchiveSlot) > buf.size()) {
+        std::cerr << "Not a valid archive: \"" << filename << "\"" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<AssetArchiveSlot> slots(header.numSlots);
+    memcpy(slots.data(), &buf[header.slotsOffset], header.numSlots * sizeof(AssetArchiveSlot));
+    std::vector<Entry> entries;
+    for (size_t i=0 ; i<slots.size() ; ++i) {
+        const AssetArchiveSlot &slot = slots[i];
+        if (slot.nameLength == 0) continue;
+        Entry e;
+        e.name = std::string(&buf[header.namesOffset + slot.nameOffset], slot.nameLength);
+        e.offset = slot.offset;
+        e.length = slot.length;
+        entries.push_back(e);
+    }
+    std::sort(entries.begin(), entries.end());
+    for (size_t i=0 ; i<entries.size() ; ++i) {
+        std::cout << entries[i].length << "\t" << entries[i].name << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main (int argc, char **argv)
+{
+    if (argc != 3) {
+        std::cout << info << usage << std::endl;
+        return argc == 1 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    std::string a = argv[1], b = argv[2];
+    if (a == "-l" || a == "--list") return list(b);
+    return pack(a, b);
+}
@@ -0,0 +1,85 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+
+/* Input devices for when there is no window, e.g. dedicated servers and benchmarks.  They never
+ * produce any events.
+ */
+
+#ifndef HeadlessInput_h
+#define HeadlessInput_h
+
+#include "joystick.h"
+#include "keyboard.h"
+#include "mouse.h"
+
+class MouseHeadless : public Mouse {
+
+    public:
+
+    MouseHeadless (void) : hidden(false), grabbed(false) { }
+
+    bool getEvents (std::vector<int> *clicks, int *x, int *y, int *rel_x, int *rel_y)
+    {
+        if (clicks) clicks->clear();
+        if (x) *x = 0;
+        if (y) *y = 0;
+        if (rel_x) *rel_x = 0;
+        if (rel_y) *rel_y = 0;
+        return false;
+    }
+
+    void setPos (int x, int y) { (void) x; (void) y; }
+
+    void setHide (bool toggle) { hidden = toggle; }
+    bool getHide (void) { return hidden; }
+
+    void setGrab (bool toggle) { grabbed = toggle; }
+    bool getGrab (void) { return grabbed; }
+
+    protected:
+
+    bool hidden;
+    bool grabbed;
+};
+
+class KeyboardHeadless : public Keyboard {
+
+    public:
+
+    Presses getPresses (void) { return Presses(); }
+
+    bool hasFocus (void) { return false; }
+};
+
+class JoystickHeadless : public Joystick {
+
+    public:
+
+    bool getEvents (std::vector<signed char> *buttons, std::vector<signed char> *axes,
+                    std::vector<short int> *values)
+    {
+        if (buttons) buttons->clear();
+        if (axes) axes->clear();
+        if (values) values->clear();
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,186 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef IntrusivePtr_h
+#define IntrusivePtr_h
+
+#include <cstdlib>
+#include <atomic>
+#include <functional>
+
+/** Whether the RefCounted base used by the engine's handles (GritObjectPtr, GfxNodePtr, etc) has an
+ * atomic counter.  Atomic counts allow references to be made and dropped from background threads
+ * (e.g. the disk resource loader) at the cost of a locked instruction for each one.  Plain counts
+ * are enough while all handles stay in the main thread. */
+#ifndef GRIT_ATOMIC_REFCOUNT
+#define GRIT_ATOMIC_REFCOUNT 0
+#endif
+
+/** A base class that holds the reference count used by IntrusivePtr, so that unlike SharedPtr no
+ * separate counter has to be allocated, and the counter shares a cache line with the target.  The
+ * count is not copied when the object is, since references are to a particular object. */
+template<bool Atomic> class RefCountedBase;
+
+template<> class RefCountedBase<false> {
+
+    mutable unsigned int refs;
+
+    protected:
+
+    RefCountedBase (void) : refs(0) { }
+    RefCountedBase (const RefCountedBase &) : refs(0) { }
+    RefCountedBase &operator= (const RefCountedBase &) { return *this; }
+    ~RefCountedBase (void) { }
+
+    public:
+
+    /** Add a reference. */
+    void refInc (void) const { refs++; }
+
+    /** Remove a reference, returns true if that was the last one. */
+    bool refDec (void) const { return --refs == 0; }
+
+    /** The number of references. */
+    unsigned int refCount (void) const { return refs; }
+};
+
+template<> class RefCountedBase<true> {
+
+    mutable std::atomic<unsigned int> refs;
+
+    protected:
+
+    RefCountedBase (void) : refs(0) { }
+    RefCountedBase (const RefCountedBase &) : refs(0) { }
+    RefCountedBase &operator= (const RefCountedBase &) { return *this; }
+    ~RefCountedBase (void) { }
+
+    public:
+
+    /** Add a reference.  Taking a new reference requires an existing one, so nothing needs to be
+     * ordered with respect to it. */
+    void refInc (void) const { refs.fetch_add(1, std::memory_order_relaxed); }
+
+    /** Remove a reference, returns true if that was the last one.  The release / acquire ordering
+     * ensures writes made through other references are visible to whoever deletes the object. */
+    bool refDec (void) const { return refs.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+    /** The number of references (a snapshot if other threads hold references). */
+    unsigned int refCount (void) const { return refs.load(std::memory_order_relaxed); }
+};
+
+/** The base class for engine objects referenced through IntrusivePtr. */
+typedef RefCountedBase<GRIT_ATOMIC_REFCOUNT != 0> RefCounted;
+
+/** A smart pointer like SharedPtr (and with the same interface), but the counter lives in the
+ * target, which must inherit from RefCountedBase.  Creating one is therefore a single allocation,
+ * and any number of IntrusivePtr can be made from the same raw pointer.  When the last reference
+ * goes, the target is deleted through a T*, so T must either be the most derived type or have a
+ * virtual destructor.  Thread safety is that of the counter. */
+template<class T> class IntrusivePtr {
+
+    /** The target. */
+    T *ptr;
+
+    public:
+
+    /** Deference to the target. */
+    T& operator*() const { return *ptr; }
+
+    /** Deference to the target (-> form). */
+    T* operator->() const { return ptr; }
+
+    /** Is the target NULL? */
+    bool isNull (void) const { return ptr==NULL; }
+
+    /** Set the target to NULL. */
+    void setNull (void) {
+        if (isNull()) return;
+        T *ptr_ = ptr;
+        ptr = NULL;
+        if (ptr_->refDec()) delete ptr_;
+    }
+
+    /** Return the number of references to the target. */
+    unsigned int useCount (void) const { return ptr->refCount(); }
+
+    /** Create with a NULL target. */
+    IntrusivePtr (void) : ptr(NULL) { }
+
+    /** Create with a given raw pointer as a target. */
+    explicit IntrusivePtr (T *p) : ptr(p) { if (!isNull()) ptr->refInc(); }
+
+    /** Make a new reference to an existing IntrusivePtr (incrementing the reference counter). */
+    IntrusivePtr (const IntrusivePtr<T> &p) : ptr(p.ptr) { if (!isNull()) ptr->refInc(); }
+
+    /** Take over the reference of p, leaving it NULL. */
+    IntrusivePtr (IntrusivePtr<T> &&p) : ptr(p.ptr) { p.ptr = NULL; }
+
+    /** Destructor (decrements the reference counter). */
+    ~IntrusivePtr (void) { setNull(); }
+
+    /** Make this IntrusivePtr reference the target of IntrusivePtr p.
+     *
+     * This increments the reference counter.
+     */
+    IntrusivePtr &operator= (const IntrusivePtr<T> &p) {
+        // Take the new reference first, so that assigning to self does not free the target.
+        if (!p.isNull()) p.ptr->refInc();
+        T *ptr_ = p.ptr;
+        setNull();
+        ptr = ptr_;
+        return *this;
+    }
+
+    /** Take over the reference of p, leaving it NULL. */
+    IntrusivePtr &operator= (IntrusivePtr<T> &&p) {
+        if (&p == this) return *this;
+        T *ptr_ = p.ptr;
+        p.ptr = NULL;
+        setNull();
+        ptr = ptr_;
+        return *this;
+    }
+
+    /** Return an IntrusivePtr to the same object that has a supertype.
+     *
+     * Follows C++ static_cast rules.
+     */
+    template<class U> IntrusivePtr<U> staticCast (void) const
+    {
+        return IntrusivePtr<U>(static_cast<U*>(ptr));
+    }
+};
+
+/** Do the targets match? */
+template<class T, class U> inline bool operator==(IntrusivePtr<T> const& a, IntrusivePtr<U> const& b)
+{ return &*a == &*b; }
+
+/** Are the targets different? */
+template<class T, class U> inline bool operator!=(IntrusivePtr<T> const& a, IntrusivePtr<U> const& b)
+{ return ! (a==b); }
+
+/** Call std::less on the targets. */
+template<class T, class U> inline bool operator<(IntrusivePtr<T> const& a, IntrusivePtr<U> const& b)
+{ return std::less<const void*>()(&*a, &*b); }
+
+#endif
@@ -0,0 +1,331 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+#include <centralised_log.h>
+
+#include "frame_arena.h"
+#include "frame_profiler.h"
+#include "job_system.h"
+
+namespace {
+
+    struct Job {
+        std::function<void(void)> fn;
+        JobGroup *group;
+        const char *name;
+    };
+
+    // The main thread, and any other thread that is not a worker, shares slot 0.  Worker i has
+    // slot i + 1.
+    struct Slot {
+        std::mutex lock;
+        std::deque<Job> jobs;
+        std::thread *thread;
+        std::string name;
+        std::atomic<uint64_t> jobsRun, steals, busyMicros;
+        Slot (const std::string &name)
+          : thread(NULL), name(name), jobsRun(0), steals(0), busyMicros(0)
+        { }
+    };
+
+    Slot main_slot("main");
+    std::vector<Slot*> slots = { &main_slot };
+
+    thread_local unsigned my_slot = 0;
+
+    // Jobs in all the deques, so idle workers know whether to look for one.
+    std::atomic<unsigned> queued(0);
+
+    // Idle workers wait here.
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    std::atomic<unsigned> sleepers(0);
+    bool quit = false;  // Protected by sleep_lock.
+
+    void push (const Job &job)
+    {
+        Slot &s = *slots[my_slot];
+        {
+            std::lock_guard<std::mutex> _lock(s.lock);
+            s.jobs.push_back(job);
+        }
+        queued++;
+        // Both seq_cst, so either we see the sleeper or it sees the job before sleeping.
+        if (sleepers.load() > 0) {
+            std::lock_guard<std::mutex> _lock(sleep_lock);
+            wake.notify_one();
+        }
+    }
+
+    // Newest of our own, otherwise the oldest of someone else's.
+    bool take (Job &job, bool &stolen)
+    {
+        if (queued.load() == 0) return false;
+        {
+            Slot &s = *slots[my_slot];
+            std::lock_guard<std::mutex> _lock(s.lock);
+            if (!s.jobs.empty()) {
+                job = std::move(s.jobs.back());
+                s.jobs.pop_back();
+                queued--;
+                stolen = false;
+                return true;
+            }
+        }
+        for (unsigned i=1 ; i<slots.size() ; ++i) {
+            Slot &s = *slots[(my_slot + i) % slots.size()];
+            std::lock_guard<std::mutex> _lock(s.lock);
+            if (!s.jobs.empty()) {
+                job = std::move(s.jobs.front());
+                s.jobs.pop_front();
+                queued--;
+                stolen = true;
+                return true;
+            }
+        }
+        return false;
+    }
+
+}
+
+struct JobSystemRunner {
+    static void execute (Job &job, bool stolen)
+    {
+        Slot &s = *slots[my_slot];
+        auto before = std::chrono::steady_clock::now();
+        std::exception_ptr error;
+        {
+            FRAME_PROFILER_ZONE(job.name);
+            try {
+                job.fn();
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        auto after = std::chrono::steady_clock::now();
+        s.jobsRun.fetch_add(1, std::memory_order_relaxed);
+        if (stolen) s.steals.fetch_add(1, std::memory_order_relaxed);
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(after - before);
+        s.busyMicros.fetch_add(micros.count(), std::memory_order_relaxed);
+        // The group may be gone as soon as this returns.
+        job.group->finished(error);
+    }
+};
+
+namespace {
+
+    void worker_main (unsigned slot)
+    {
+        my_slot = slot;
+        frame_profiler_thread_name(slots[slot]->name);
+        while (true) {
+            Job job;
+            bool stolen;
+            if (take(job, stolen)) {
+                JobSystemRunner::execute(job, stolen);
+                // No containers from the job are alive any more.
+                frame_arena_reset();
+                continue;
+            }
+            std::unique_lock<std::mutex> _lock(sleep_lock);
+            sleepers++;
+            wake.wait(_lock, [] { return quit || queued.load() > 0; });
+            sleepers--;
+            if (quit) return;
+        }
+    }
+
+}
+
+void job_system_set_num_threads (unsigned n)
+{
+    if (n == slots.size() - 1) return;
+    job_system_shutdown();
+    {
+        std::lock_guard<std::mutex> _lock(sleep_lock);
+        quit = false;
+    }
+    for (unsigned i=0 ; i<n ; ++i) slots.push_back(new Slot("Job worker " + std::to_string(i)));
+    for (unsigned i=1 ; i<slots.size() ; ++i) slots[i]->thread = new std::thread(worker_main, i);
+}
+
+unsigned job_system_num_threads (void)
+{
+    return slots.size() - 1;
+}
+
+void job_system_shutdown (void)
+{
+    {
+        std::lock_guard<std::mutex> _lock(sleep_lock);
+        quit = true;
+        wake.notify_all();
+    }
+    for (unsigned i=1 ; i<slots.size() ; ++i) {
+        slots[i]->thread->join();
+        delete slots[i]->thread;
+        APP_ASSERT(slots[i]->jobs.empty());
+        delete slots[i];
+    }
+    slots.resize(1);
+}
+
+void job_system_stats (std::vector<JobWorkerStats> &stats)
+{
+    stats.clear();
+    for (unsigned i=0 ; i<slots.size() ; ++i) {
+        const Slot &s = *slots[i];
+        JobWorkerStats w;
+        w.name = s.name;
+        w.jobs = s.jobsRun.load(std::memory_order_relaxed);
+        w.steals = s.steals.load(std::memory_order_relaxed);
+        w.busyMicros = s.busyMicros.load(std::memory_order_relaxed);
+        stats.push_back(w);
+    }
+}
+
+
+JobGroup::~JobGroup (void)
+{
+    try {
+        wait();
+    } catch (...) {
+    }
+}
+
+void JobGroup::run (const std::function<void(void)> &fn, const char *name_)
+{
+    pending++;
+    push(Job { fn, this, name_ == NULL ? name : name_ });
+}
+
+void JobGroup::wait (void)
+{
+    while (pending.load(std::memory_order_acquire) > 0) {
+        Job job;
+        bool stolen;
+        if (take(job, stolen)) {
+            JobSystemRunner::execute(job, stolen);
+        } else {
+            // Another thread is running the last of our jobs.
+            std::this_thread::yield();
+        }
+    }
+    std::lock_guard<std::mutex> _lock(errorLock);
+    if (error) {
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+void JobGroup::finished (std::exception_ptr e)
+{
+    if (e) {
+        std::lock_guard<std::mutex> _lock(errorLock);
+        if (!error) error = e;
+    }
+    pending.fetch_sub(1, std::memory_order_release);
+}
+
+
+void parallel_for (size_t begin, size_t end, size_t grain,
+                   const std::function<void(size_t, size_t)> &fn, const char *name)
+{
+    if (end <= begin) return;
+    size_t n = end - begin;
+    if (grain == 0) grain = 1;
+    if (slots.size() == 1 || n <= grain) {
+        FRAME_PROFILER_ZONE(name);
+        fn(begin, end);
+        return;
+    }
+    // A few chunks per thread is enough to even out the load, more would just cost scheduling.
+    size_t chunks = std::min((n + grain - 1) / grain, 4 * slots.size());
+    size_t chunk = (n + chunks - 1) / chunks;
+    JobGroup group(name);
+    for (size_t i=begin+chunk ; i<end ; i+=chunk) {
+        size_t j = std::min(end, i + chunk);
+        group.run([&fn, i, j] { fn(i, j); });
+    }
+    {
+        FRAME_PROFILER_ZONE(name);
+        fn(begin, begin + chunk);
+    }
+    group.wait();
+}
+
+
+JobGraph::Task JobGraph::add (const char *name, const std::function<void(void)> &fn)
+{
+    Node n;
+    n.name = name;
+    n.fn = fn;
+    n.numPredecessors = 0;
+    nodes.push_back(n);
+    return nodes.size() - 1;
+}
+
+void JobGraph::depend (Task before, Task after)
+{
+    APP_ASSERT(before < nodes.size() && after < nodes.size());
+    nodes[before].successors.push_back(after);
+    nodes[after].numPredecessors++;
+}
+
+void JobGraph::run (void)
+{
+    // Released however run() is left, e.g. when a task throws.
+    struct ResetWaiting {
+        std::unique_ptr<std::atomic<unsigned>[]> &waiting;
+        ~ResetWaiting (void) { waiting.reset(); }
+    } reset_waiting { waiting };
+
+    waiting.reset(new std::atomic<unsigned>[nodes.size()]);
+    for (size_t i=0 ; i<nodes.size() ; ++i) waiting[i] = nodes[i].numPredecessors;
+    completed = 0;
+    {
+        JobGroup group(name);
+        for (size_t i=0 ; i<nodes.size() ; ++i) {
+            if (nodes[i].numPredecessors == 0) spawn(group, Task(i));
+        }
+        group.wait();
+    }
+    if (completed != nodes.size())
+        EXCEPT << "Job graph \"" << name << "\" has a cycle." << ENDL;
+}
+
+void JobGraph::spawn (JobGroup &group, Task t)
+{
+    group.run([this, &group, t] {
+        nodes[t].fn();
+        completed++;
+        for (Task s : nodes[t].successors) {
+            if (--waiting[s] == 0) spawn(group, s);
+        }
+    }, nodes[t].name);
+}
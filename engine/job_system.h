@@ -0,0 +1,152 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Worker threads for spreading CPU-heavy loops over the cores.  Work is split into jobs.  Each
+ * thread has a deque of jobs, it runs the newest of its own first and when it has none, steals the
+ * oldest from another thread.  A thread waiting for jobs to finish runs jobs meanwhile, so jobs
+ * can start and wait for their own jobs without tying up the workers.
+ *
+ * Jobs run on any thread, so must not touch core_L, Ogre, or anything else that is only safe to
+ * use from the main thread.  They may use FrameVector, each worker's arena is reset between jobs.
+ * With no worker threads, jobs are run by the thread that waits for them.
+ *
+ * Jobs are started from the main thread (and from other jobs).  The number of threads must not be
+ * changed while any are running.
+ */
+
+#include <cstdint>
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef JobSystem_h
+#define JobSystem_h
+
+/** Start or stop worker threads, to have n in addition to the main thread. */
+void job_system_set_num_threads (unsigned n);
+
+/** The number of worker threads. */
+unsigned job_system_num_threads (void);
+
+/** Stop the worker threads. */
+void job_system_shutdown (void);
+
+struct JobWorkerStats {
+    std::string name;
+    uint64_t jobs;          // Jobs run by this thread.
+    uint64_t steals;        // Of which, taken from another thread's deque.
+    uint64_t busyMicros;    // Time spent running jobs.
+};
+
+/** The counters of each thread that has run jobs, the main thread (and any other thread that
+ * is not a worker) first. */
+void job_system_stats (std::vector<JobWorkerStats> &stats);
+
+/** Jobs that are waited for together (fork / join). */
+class JobGroup {
+
+    public:
+
+    /** The name of the frame profiler zone of each job, must be a literal. */
+    JobGroup (const char *name = "job") : name(name), pending(0) { }
+
+    /** Waits for the jobs, but any exception thrown by them is lost. */
+    ~JobGroup (void);
+
+    /** Queue a job, which will run on some thread at some point before wait() returns.  The name
+     * overrides the group's. */
+    void run (const std::function<void(void)> &fn, const char *name = NULL);
+
+    /** Run jobs until all of this group's are done.  If any threw an exception, the first is
+     * rethrown here. */
+    void wait (void);
+
+    private:
+
+    JobGroup (const JobGroup &) = delete;
+    JobGroup &operator= (const JobGroup &) = delete;
+
+    void finished (std::exception_ptr e);
+
+    const char *name;
+    std::atomic<unsigned> pending;
+    std::mutex errorLock;
+    std::exception_ptr error;
+
+    friend struct JobSystemRunner;
+};
+
+/** Call fn(i, j) for disjoint subranges [i, j) covering [begin, end), in parallel.  Subranges are
+ * at least grain long (except perhaps the last), so grain should be large enough to amortise the
+ * cost of a job, a microsecond or so.  Returns when all have finished, and rethrows the first
+ * exception, if any. */
+void parallel_for (size_t begin, size_t end, size_t grain,
+                   const std::function<void(size_t, size_t)> &fn,
+                   const char *name = "parallel_for");
+
+/** Tasks with dependencies between them, e.g. the work of a frame.  Build it once, then run it
+ * every frame.  Each task runs once its dependencies have, tasks with no path between them may
+ * run in parallel. */
+class JobGraph {
+
+    public:
+
+    typedef unsigned Task;
+
+    JobGraph (const char *name = "job_graph") : name(name) { }
+
+    /** The name is used for the frame profiler zone, so must be a literal. */
+    Task add (const char *name, const std::function<void(void)> &fn);
+
+    /** Task after will not start until task before has finished. */
+    void depend (Task before, Task after);
+
+    /** Run all the tasks, return when they are finished.  If one throws an exception, the tasks
+     * that depend on it are not run and the exception is rethrown here.  Throws an exception if
+     * there is a cycle. */
+    void run (void);
+
+    size_t size (void) const { return nodes.size(); }
+
+    private:
+
+    struct Node {
+        const char *name;
+        std::function<void(void)> fn;
+        std::vector<Task> successors;
+        unsigned numPredecessors;
+    };
+
+    void spawn (JobGroup &group, Task t);
+
+    const char *name;
+    std::vector<Node> nodes;
+    // Only valid during run().
+    std::unique_ptr<std::atomic<unsigned>[]> waiting;
+    std::atomic<size_t> completed;
+};
+
+#endif
@@ -89,8 +89,11 @@ static bool handle_event (const XEvent &event)
     return true;
 }
 
+// Without clipboard_init (i.e. headless), the clipboard is only shared within this process.
+
 void clipboard_pump (void)
 {
+    if (!display) return;
     XEvent event;
     int r = XCheckTypedEvent(display, SelectionRequest, &event);
     if (!r) return;
@@ -105,12 +108,14 @@ void clipboard_shutdown (void)
 void clipboard_set (const std::string &s)
 {
     data_clipboard = s;
+    if (!display) return;
     XSetSelectionOwner(display, src_clipboard, window, CurrentTime);
 }
 
 void clipboard_selection_set (const std::string &s)
 {
     data_selection = s;
+    if (!display) return;
     XSetSelectionOwner(display, src_selection, window, CurrentTime);
 }
 
@@ -183,11 +188,13 @@ static std::string clipboard_get (Atom source)
 
 std::string clipboard_get (void)
 {
+    if (!display) return data_clipboard;
     return clipboard_get(src_clipboard);
 }
 
 std::string clipboard_selection_get (void)
 {
+    if (!display) return data_selection;
     return clipboard_get(src_selection);
 }
 
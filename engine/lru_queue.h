@@ -0,0 +1,144 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <cstdlib>
+
+template<typename T> class LRUQueue;
+
+#ifndef LRU_QUEUE_H
+#define LRU_QUEUE_H
+
+/** The links that allow a T to be in an LRUQueue<T>.  T must have one of these as a member
+ * called lruLinks, accessible to LRUQueue<T>.  A T can be in at most one queue at a time.
+ */
+template<typename T> class LRUQueueLinks {
+
+    friend class LRUQueue<T>;
+
+    /** Neighbours in the queue, NULL at the ends. */
+    T *older, *younger;
+
+    /** The queue we are in, or NULL. */
+    LRUQueue<T> *queue;
+
+    public:
+
+    LRUQueueLinks (void) : older(NULL), younger(NULL), queue(NULL) { }
+
+    /** Whether we are in any queue. */
+    bool queued (void) const { return queue != NULL; }
+};
+
+/** A least recently used queue, used to select resources to unload in the
+ * event of memory pressure.  The basic idea is you push to the queue when you
+ * no-longer need something, and you pop if you need to free space.  If you
+ * start using something, you call removeIfPresent to mark it as being used
+ * again.
+ *
+ * The queue is intrusive (a doubly linked list threaded through the objects
+ * themselves via LRUQueueLinks) so every operation is O(1) and nothing is
+ * allocated.
+ */
+template<typename T> class LRUQueue {
+
+    public:
+
+    typedef size_t size_type;
+
+    /** Create an empty queue. */
+    LRUQueue () : mSize(0), mYoungest(NULL), mOldest(NULL) { }
+
+    /** Destructor. */
+    ~LRUQueue () { clear(); }
+
+    /** Whether v is in this queue. */
+    inline bool contains (const T *v) const { return v->lruLinks.queue == this; }
+
+    /** If v is in the queue, remove it, otherwise a no-op. */
+    inline void removeIfPresent (T *v)
+    {
+        if (contains(v)) unlink(v);
+    }
+
+    /** Add a new object v to the queue.
+     *
+     * This means you're not intending to use it anymore, but it is the most recently used thing.
+     * If it was already in the queue, it is moved to the young end.
+     */
+    inline void push (T *v)
+    {
+        LRUQueueLinks<T> &l = v->lruLinks;
+        if (l.queue != NULL) l.queue->unlink(v);
+        l.queue = this;
+        l.older = mYoungest;
+        l.younger = NULL;
+        if (mYoungest != NULL) mYoungest->lruLinks.younger = v;
+        else mOldest = v;
+        mYoungest = v;
+        mSize++;
+    }
+
+    /** Retrieve the least-recently used thing, and remove it from the queue. */
+    inline T *pop ()
+    {
+        T *v = mOldest;
+        unlink(v);
+        return v;
+    }
+
+    /** Return the number of elements in the queue.  This is the number of
+     * resources that are loaded but not being used (i.e. it's a cache in case they
+     * need to be used again. */
+    inline size_type size () const { return mSize; }
+
+    /** Make the queue empty. */
+    inline void clear ()
+    {
+        while (mOldest != NULL) unlink(mOldest);
+    }
+
+
+    protected:
+
+    inline void unlink (T *v)
+    {
+        LRUQueueLinks<T> &l = v->lruLinks;
+        if (l.older != NULL) l.older->lruLinks.younger = l.younger;
+        else mOldest = l.younger;
+        if (l.younger != NULL) l.younger->lruLinks.older = l.older;
+        else mYoungest = l.older;
+        l.older = NULL;
+        l.younger = NULL;
+        l.queue = NULL;
+        mSize--;
+    }
+
+    /** Cache of the number of elements in the queue. */
+    size_t mSize;
+
+    /** The young end, where things are pushed. */
+    T *mYoungest;
+
+    /** The old end, where things are popped. */
+    T *mOldest;
+};
+
+#endif
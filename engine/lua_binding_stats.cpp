@@ -0,0 +1,114 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+
+#include <centralised_log.h>
+
+#include "lua_binding_stats.h"
+
+#ifdef USE_LUA_BINDING_STATS
+
+// Boxed so the pointers given out stay valid as more bindings are registered.
+static std::vector<std::unique_ptr<LuaBindingStats>> all_stats;
+
+std::vector<LuaBindingProbe::Running> LuaBindingProbe::running;
+
+LuaBindingStats *lua_binding_stats_register (const char *name, const char *file, int line)
+{
+    LuaBindingStats *s = new LuaBindingStats();
+    s->name = name;
+    s->file = file;
+    s->line = line;
+    s->calls = 0;
+    s->errors = 0;
+    s->nanos = 0;
+    s->argsCalls = 0;
+    s->argsNanos = 0;
+    all_stats.emplace_back(s);
+    return s;
+}
+
+bool lua_binding_stats_enabled (void)
+{
+    return true;
+}
+
+std::vector<LuaBindingStats> lua_binding_stats_sorted (void)
+{
+    std::vector<LuaBindingStats> r;
+    for (const auto &s : all_stats) {
+        if (s->calls > 0) r.push_back(*s);
+    }
+    std::sort(r.begin(), r.end(), [] (const LuaBindingStats &a, const LuaBindingStats &b) {
+        return a.nanos > b.nanos;
+    });
+    return r;
+}
+
+void lua_binding_stats_reset (void)
+{
+    for (const auto &s : all_stats) {
+        s->calls = 0;
+        s->errors = 0;
+        s->nanos = 0;
+        s->argsCalls = 0;
+        s->argsNanos = 0;
+    }
+}
+
+#else
+
+bool lua_binding_stats_enabled (void)
+{
+    return false;
+}
+
+std::vector<LuaBindingStats> lua_binding_stats_sorted (void)
+{
+    return std::vector<LuaBindingStats>();
+}
+
+void lua_binding_stats_reset (void)
+{
+}
+
+#endif
+
+void lua_binding_stats_dump (const std::string &filename)
+{
+    std::ofstream out(filename.c_str());
+    if (!out.good())
+        EXCEPT << "Could not open for writing: \"" << filename << "\"" << ENDL;
+    out << "binding,file,line,calls,errors,time_us,time_per_call_us,args_calls,args_time_us\n";
+    for (const LuaBindingStats &s : lua_binding_stats_sorted()) {
+        out << s.name << "," << s.file << "," << s.line << "," << s.calls << "," << s.errors << ","
+            << s.nanos / 1000.0 << ","
+            << s.nanos / 1000.0 / s.calls << "," << s.argsCalls << ","
+            << s.argsNanos / 1000.0 << "\n";
+    }
+    out.close();
+    if (!out.good())
+        EXCEPT << "Error writing: \"" << filename << "\"" << ENDL;
+}
@@ -0,0 +1,178 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* Call counts and timings for each Lua binding, to find which of the C functions exposed to Lua
+ * dominate the frame time.  Only built when USE_LUA_BINDING_STATS is defined (e.g. set
+ * LUA_BINDING_STATS_DEFS=USE_LUA_BINDING_STATS in user.mk), otherwise the probes compile to
+ * nothing.
+ *
+ * Every binding is probed through TRY_START, and identified by its C function name and the file
+ * and line of its TRY_START, so overloads are kept apart.  The inclusive time covers the whole
+ * call, including any Lua code it calls back into (and any bindings called from there).  A binding
+ * can also mark where it has finished converting its arguments with LUA_BINDING_ARGS_DONE, which
+ * splits off the argument conversion time.  The hottest bindings do this, the rest report no
+ * argument time.
+ *
+ * Calls that end in a Lua error are counted in errors as well as calls.  Lua errors longjmp past
+ * the probe's destructor, so TRY_END stops the probe itself before raising one.  Errors raised
+ * directly from the body of a binding (e.g. by check_args) are only noticed when a later probe
+ * finds the abandoned one, and their time is not known, so it is not counted.
+ *
+ * The stats are only updated from the main (Lua) thread.
+ */
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#ifndef LuaBindingStats_h
+#define LuaBindingStats_h
+
+struct LuaBindingStats {
+    const char *name;
+    const char *file;
+    int line;
+    uint64_t calls;
+    uint64_t errors;  // calls that ended in a Lua error
+    uint64_t nanos;  // inclusive
+    uint64_t argsCalls;  // calls that reached LUA_BINDING_ARGS_DONE
+    uint64_t argsNanos;
+};
+
+#ifdef USE_LUA_BINDING_STATS
+
+#include <chrono>
+
+/** Get the (zeroed) stats for a new binding.  The pointer is valid until shutdown. */
+LuaBindingStats *lua_binding_stats_register (const char *name, const char *file, int line);
+
+/** Times a single binding call, from construction to destruction (or stop).
+ *
+ * The running probes are also kept on a stack, innermost last, so that probes abandoned by a Lua
+ * error can be found.  This is not kept in the probes themselves, as an abandoned probe's memory
+ * is reused.  A probe is abandoned if it is still on the stack when a probe that started before it
+ * finishes, or when a new probe starts at or below it on the C stack, where it could not be
+ * running any more.
+ */
+class LuaBindingProbe {
+    typedef std::chrono::steady_clock Clock;
+
+    struct Running {
+        LuaBindingStats *stats;
+        uintptr_t address;
+        bool stopped;
+    };
+
+    static std::vector<Running> running;
+
+    LuaBindingStats *stats;
+    Clock::time_point start;
+    size_t depth;
+
+    static uint64_t since (Clock::time_point t)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t).count();
+    }
+
+    /** Remove the innermost probe from the stack, counting its call if it was abandoned. */
+    static void popInnermost (void)
+    {
+        const Running &r = running.back();
+        if (!r.stopped) {
+            r.stats->calls++;
+            r.stats->errors++;
+        }
+        running.pop_back();
+    }
+
+    public:
+
+    LuaBindingProbe (LuaBindingStats *stats)
+      : stats(stats), start(Clock::now())
+    {
+        // The C stack grows down, so running probes are all at higher addresses than this one.
+        uintptr_t address = reinterpret_cast<uintptr_t>(this);
+        while (!running.empty() && running.back().address <= address)
+            popInnermost();
+        depth = running.size();
+        Running r = { stats, address, false };
+        running.push_back(r);
+    }
+
+    ~LuaBindingProbe (void)
+    {
+        if (!running[depth].stopped) stop(false);
+        // Anything started during this call and still on the stack was abandoned.
+        while (running.size() > depth + 1) popInnermost();
+        running.pop_back();
+    }
+
+    /** Record the call now, e.g. because a Lua error is about to skip the destructor. */
+    void stop (bool error)
+    {
+        running[depth].stopped = true;
+        stats->calls++;
+        if (error) stats->errors++;
+        stats->nanos += since(start);
+    }
+
+    void argsDone (void)
+    {
+        stats->argsCalls++;
+        stats->argsNanos += since(start);
+    }
+};
+
+#define LUA_BINDING_PROBE \
+    static LuaBindingStats *lua_binding_stats_ = \
+        lua_binding_stats_register(__func__, __FILE__, __LINE__); \
+    LuaBindingProbe lua_binding_probe_(lua_binding_stats_);
+
+#define LUA_BINDING_ARGS_DONE lua_binding_probe_.argsDone()
+
+/** Use before raising a Lua error from the binding, which would skip the probe's destructor. */
+#define LUA_BINDING_ERROR lua_binding_probe_.stop(true)
+
+#else
+
+#define LUA_BINDING_PROBE
+#define LUA_BINDING_ARGS_DONE do { } while (0)
+#define LUA_BINDING_ERROR do { } while (0)
+
+#endif
+
+/** Are the probes compiled in? */
+bool lua_binding_stats_enabled (void);
+
+/** The stats of every binding called at least once since the last reset, most inclusive time
+ * first.  Empty if the probes are not compiled in. */
+std::vector<LuaBindingStats> lua_binding_stats_sorted (void);
+
+/** Zero all the stats. */
+void lua_binding_stats_reset (void);
+
+/** Write lua_binding_stats_sorted() to a CSV file, one binding per line, times in microseconds.
+ * Throws an exception if the file cannot be written. */
+void lua_binding_stats_dump (const std::string &filename);
+
+#endif
@@ -35,11 +35,15 @@
 #include <lua_utf8.h>
 #include <io_util.h>
 
+#include "asset_archive.h"
 #include "audio/lua_wrappers_audio.h"
 #include "background_loader.h"
 #include <centralised_log.h>
 #include "clipboard.h"
 #include "core_option.h"
+#include "frame_arena.h"
+#include "job_system.h"
+#include "frame_profiler.h"
 #include "gfx/gfx_disk_resource.h"
 #include "gfx/lua_wrappers_gfx.h"
 #include "grit_lua_util.h"
@@ -826,6 +830,186 @@ TRY_END
 }
 
 
+/** lua_binding_stats() returns an array of {name, file, line, calls, errors, time, argsCalls,
+ * argsTime} for every binding called since the last reset, most inclusive time first.  Times are
+ * in microseconds. */
+static int global_lua_binding_stats (lua_State *L)
+{
+TRY_START
+    check_args(L, 0);
+    if (!lua_binding_stats_enabled())
+        my_lua_error(L, "Not compiled with USE_LUA_BINDING_STATS");
+    std::vector<LuaBindingStats> stats = lua_binding_stats_sorted();
+    lua_createtable(L, stats.size(), 0);
+    for (size_t i=0 ; i<stats.size() ; ++i) {
+        const LuaBindingStats &s = stats[i];
+        lua_createtable(L, 0, 8);
+        lua_pushstring(L, s.name);
+        lua_setfield(L, -2, "name");
+        lua_pushstring(L, s.file);
+        lua_setfield(L, -2, "file");
+        lua_pushnumber(L, s.line);
+        lua_setfield(L, -2, "line");
+        lua_pushnumber(L, s.calls);
+        lua_setfield(L, -2, "calls");
+        lua_pushnumber(L, s.errors);
+        lua_setfield(L, -2, "errors");
+        lua_pushnumber(L, s.nanos / 1000.0);
+        lua_setfield(L, -2, "time");
+        lua_pushnumber(L, s.argsCalls);
+        lua_setfield(L, -2, "argsCalls");
+        lua_pushnumber(L, s.argsNanos / 1000.0);
+        lua_setfield(L, -2, "argsTime");
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+TRY_END
+}
+
+
+static int global_lua_binding_stats_reset (lua_State *L)
+{
+TRY_START
+    check_args(L, 0);
+    lua_binding_stats_reset();
+    return 0;
+TRY_END
+}
+
+
+static int global_lua_binding_stats_dump (lua_State *L)
+{
+TRY_START
+    check_args(L, 1);
+    std::string filename = luaL_checkstring(L, 1);
+    if (!lua_binding_stats_enabled())
+        my_lua_error(L, "Not compiled with USE_LUA_BINDING_STATS");
+    lua_binding_stats_dump(filename);
+    return 0;
+TRY_END
+}
+
+
+static int global_frame_profiler_enable (lua_State *L)
+{
+TRY_START
+    check_args(L, 1);
+    frame_profiler_enable(check_bool(L, 1));
+    return 0;
+TRY_END
+}
+
+
+static int global_frame_profiler_enabled (lua_State *L)
+{
+TRY_START
+    check_args(L, 0);
+    lua_pushboolean(L, frame_profiler_enabled());
+    return 1;
+TRY_END
+}
+
+
+/** frame_profiler_zone_begin(name) opens a zone, which must be closed with
+ * frame_profiler_zone_end() before the enclosing C++ zone (if any) finishes. */
+static int global_frame_profiler_zone_begin (lua_State *L)
+{
+TRY_START
+    check_args(L, 1);
+    if (!frame_profiler_enabled()) return 0;
+    frame_profiler_begin(frame_profiler_intern(check_string(L, 1)));
+    return 0;
+TRY_END
+}
+
+
+static int global_frame_profiler_zone_end (lua_State *L)
+{
+TRY_START
+    check_args(L, 0);
+    frame_profiler_end();
+    return 0;
+TRY_END
+}
+
+
+static int global_frame_profiler_clear (lua_State *L)
+{
+TRY_START
+    check_args(L, 0);
+    frame_profiler_clear();
+    return 0;
+TRY_END
+}
+
+
+static int global_frame_profiler_dump (lua_State *L)
+{
+TRY_START
+    check_args(L, 1);
+    std::string filename = luaL_checkstring(L, 1);
+    frame_profiler_dump(filename);
+    return 0;
+TRY_END
+}
+
+
+/** frame_arena_stats() returns the counters of the main thread's frame arena.  A steady state
+ * has heapAllocations no longer increasing. */
+static int global_frame_arena_stats (lua_State *L)
+{
+TRY_START
+    check_args(L, 0);
+    const FrameArenaStats &s = frame_arena().getStats();
+    lua_createtable(L, 0, 8);
+    lua_pushnumber(L, s.lastAllocations);
+    lua_setfield(L, -2, "lastAllocations");
+    lua_pushnumber(L, s.lastBytes);
+    lua_setfield(L, -2, "lastBytes");
+    lua_pushnumber(L, s.live);
+    lua_setfield(L, -2, "live");
+    lua_pushnumber(L, s.capacity);
+    lua_setfield(L, -2, "capacity");
+    lua_pushnumber(L, s.peakBytes);
+    lua_setfield(L, -2, "peakBytes");
+    lua_pushnumber(L, s.heapAllocations);
+    lua_setfield(L, -2, "heapAllocations");
+    lua_pushnumber(L, s.resets);
+    lua_setfield(L, -2, "resets");
+    lua_pushnumber(L, s.deferredResets);
+    lua_setfield(L, -2, "deferredResets");
+    return 1;
+TRY_END
+}
+
+
+/** job_system_stats() returns a list with a table of counters for each thread that runs jobs,
+ * the main thread first. */
+static int global_job_system_stats (lua_State *L)
+{
+TRY_START
+    check_args(L, 0);
+    std::vector<JobWorkerStats> stats;
+    job_system_stats(stats);
+    lua_createtable(L, stats.size(), 0);
+    for (size_t i=0 ; i<stats.size() ; ++i) {
+        const JobWorkerStats &w = stats[i];
+        lua_createtable(L, 0, 4);
+        push_string(L, w.name);
+        lua_setfield(L, -2, "name");
+        lua_pushnumber(L, w.jobs);
+        lua_setfield(L, -2, "jobs");
+        lua_pushnumber(L, w.steals);
+        lua_setfield(L, -2, "steals");
+        lua_pushnumber(L, w.busyMicros);
+        lua_setfield(L, -2, "busyMicros");
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+TRY_END
+}
+
+
 static int global_mlockall (lua_State *L)
 {
 TRY_START
@@ -857,6 +1041,8 @@ TRY_END
 
 
 struct LuaIncludeState {
+    // Either the whole file from an archive, or a stream read in chunks.
+    AssetView view;
     Ogre::DataStreamPtr ds;
     char buf[16384];
 };
@@ -865,6 +1051,16 @@ static const char *aux_aux_include (lua_State *L, void *ud, size_t *size)
 {
     (void) L;
     LuaIncludeState &lis = *static_cast<LuaIncludeState*>(ud);
+    if (lis.view.data != NULL) {
+        const char *r = reinterpret_cast<const char*>(lis.view.data);
+        *size = lis.view.length;
+        lis.view = AssetView();
+        return r;
+    }
+    if (lis.ds.isNull()) {
+        *size = 0;
+        return NULL;
+    }
     *size = lis.ds->read(lis.buf, sizeof(lis.buf));
     return lis.buf;
 }
@@ -872,13 +1068,15 @@ static const char *aux_aux_include (lua_State *L, void *ud, size_t *size)
 
 static int aux_include (lua_State *L, const std::string &filename)
 {
-    std::string fname(filename, 1); // strip leading /
-    if (!Ogre::ResourceGroupManager::getSingleton().resourceExists("GRIT", fname)) {
-        lua_pushfstring(L, "File not found: \"%s\"", filename.c_str());
-        return LUA_ERRFILE;
-    }
     LuaIncludeState lis;
-    lis.ds = Ogre::ResourceGroupManager::getSingleton().openResource(fname, "GRIT");
+    if (!asset_archive_find(filename, lis.view)) {
+        std::string fname(filename, 1); // strip leading /
+        if (!Ogre::ResourceGroupManager::getSingleton().resourceExists("GRIT", fname)) {
+            lua_pushfstring(L, "File not found: \"%s\"", filename.c_str());
+            return LUA_ERRFILE;
+        }
+        lis.ds = Ogre::ResourceGroupManager::getSingleton().openResource(fname, "GRIT");
+    }
     // Last argument means it will accept either binary or text files.
     return lua_load(L, aux_aux_include, &lis, ("@" + filename).c_str(), "bt");
 }
@@ -889,6 +1087,13 @@ static int global_import_str (lua_State *L)
 TRY_START
     check_args(L, 1);
     std::string filename = luaL_checkstring(L, 1);
+
+    AssetView view;
+    if (asset_archive_find(filename, view)) {
+        lua_pushlstring(L, reinterpret_cast<const char*>(view.data), view.length);
+        return 1;
+    }
+
     std::string fname(filename, 1); // strip leading /
 
     if (!Ogre::ResourceGroupManager::getSingleton().resourceExists("GRIT", fname))
@@ -1180,6 +1385,20 @@ static const luaL_reg global[] = {
     {"profiler_start", global_profiler_start},
     {"profiler_stop", global_profiler_stop},
 
+    {"lua_binding_stats", global_lua_binding_stats},
+    {"lua_binding_stats_reset", global_lua_binding_stats_reset},
+    {"lua_binding_stats_dump", global_lua_binding_stats_dump},
+
+    {"frame_profiler_enable", global_frame_profiler_enable},
+    {"frame_profiler_enabled", global_frame_profiler_enabled},
+    {"frame_profiler_zone_begin", global_frame_profiler_zone_begin},
+    {"frame_profiler_zone_end", global_frame_profiler_zone_end},
+    {"frame_profiler_clear", global_frame_profiler_clear},
+    {"frame_profiler_dump", global_frame_profiler_dump},
+
+    {"frame_arena_stats", global_frame_arena_stats},
+    {"job_system_stats", global_job_system_stats},
+
     {"input_filter_trickle_button", global_input_filter_trickle_button},
     {"input_filter_trickle_mouse_move", global_input_filter_trickle_mouse_move},
     {"input_filter_pressed", global_input_filter_pressed},
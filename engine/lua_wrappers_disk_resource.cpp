@@ -19,6 +19,7 @@
  * THE SOFTWARE.
  */
 
+#include "asset_archive.h"
 #include "grit_lua_util.h"
 #include "lua_wrappers_disk_resource.h"
 #include "main.h"
@@ -51,6 +52,8 @@ TRY_START
     std::string key = check_string(L, 2);
     if (key == "name") {
         push_string(L, self->getName());
+    } else if (key == "type") {
+        lua_pushstring(L, (*self)->getTypeName());
     } else {
         EXCEPT << "DiskResourceHold no such field: " << key << ENDL;
     }
@@ -278,6 +281,17 @@ TRY_START
 TRY_END
 }
 
+static int global_disk_resource_host_ram (lua_State *L)
+{
+TRY_START
+    check_args(L, 1);
+    std::string name = check_path(L, 1);
+    DiskResource *dr = disk_resource_get_or_make(name);
+    lua_pushnumber(L, dr->getHostRAM() / 1024.0 / 1024.0);
+    return 1;
+TRY_END
+}
+
 
 static int global_disk_resource_check (lua_State *L)
 {
@@ -307,6 +321,40 @@ TRY_START
 TRY_END
 }
 
+static int global_host_ram_used_by_type (lua_State *L)
+{
+TRY_START
+    check_args(L, 0);
+    std::map<std::string, double> by_type = host_ram_used_by_type();
+    lua_newtable(L);
+    for (const auto &pair : by_type) {
+        push_string(L, pair.first);
+        lua_pushnumber(L, pair.second);
+        lua_rawset(L, -3);
+    }
+    return 1;
+TRY_END
+}
+
+static int global_asset_archive_mount (lua_State *L)
+{
+TRY_START
+    check_args(L, 1);
+    std::string filename = check_string(L, 1);
+    asset_archive_mount(filename);
+    return 0;
+TRY_END
+}
+
+static int global_asset_archive_num_mounted (lua_State *L)
+{
+TRY_START
+    check_args(L, 0);
+    lua_pushnumber(L, asset_archive_num_mounted());
+    return 1;
+TRY_END
+}
+
 
 static int global_disk_resource_hold_make (lua_State *L)
 {
@@ -342,6 +390,7 @@ static const luaL_reg global[] = {
     {"disk_resource_add", global_disk_resource_add},
     {"disk_resource_has", global_disk_resource_has},
     {"disk_resource_users", global_disk_resource_users},
+    {"disk_resource_host_ram", global_disk_resource_host_ram},
     {"disk_resource_ensure_loaded", global_disk_resource_ensure_loaded},
     {"disk_resource_loaded", global_disk_resource_loaded},
     {"disk_resource_load", global_disk_resource_load},
@@ -353,6 +402,10 @@ static const luaL_reg global[] = {
 
     {"host_ram_available", global_host_ram_available},
     {"host_ram_used", global_host_ram_used},
+    {"host_ram_used_by_type", global_host_ram_used_by_type},
+
+    {"asset_archive_mount", global_asset_archive_mount},
+    {"asset_archive_num_mounted", global_asset_archive_num_mounted},
 
     {NULL, NULL}
 };
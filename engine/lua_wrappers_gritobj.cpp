@@ -205,6 +205,7 @@ TRY_START
     check_args(L, 2);
     GET_UD_MACRO(GritObjectPtr, self, 1, GRITOBJ_TAG);
     std::string key = check_string(L, 2);
+    LUA_BINDING_ARGS_DONE;
     if (key == "destroy") {
         push_cfunction(L, gritobj_destroy);
     } else if (key == "activated") {
@@ -264,6 +265,7 @@ TRY_START
     check_args(L, 3);
     GET_UD_MACRO(GritObjectPtr, self, 1, GRITOBJ_TAG);
     std::string key = check_string(L, 2);
+    LUA_BINDING_ARGS_DONE;
 
     if (key == "destroy") {
         my_lua_error(L, "Not a writeable GritObject member: " + key);
@@ -337,9 +339,15 @@ MT_MACRO_NEWINDEX(gritobj);
 static int global_streamer_centre (lua_State *L)
 {
 TRY_START
-    check_args(L, 1);
+    if (lua_gettop(L) == 1) {
+        Vector3 pos = check_v3(L, 1);
+        streamer_centre(L, pos, false);
+        return 0;
+    }
+    check_args(L, 2);
     Vector3 pos = check_v3(L, 1);
-    streamer_centre(L, pos, false);
+    Vector3 vel = check_v3(L, 2);
+    streamer_centre(L, pos, vel, false);
     return 0;
 TRY_END
 }
@@ -368,6 +376,15 @@ TRY_START
 TRY_END
 }
 
+static int global_class_invalidate_caches (lua_State *L)
+{
+TRY_START
+    check_args(L, 0);
+    class_invalidate_caches();
+    return 0;
+TRY_END
+}
+
 static int global_class_get (lua_State *L)
 {
 TRY_START
@@ -433,53 +450,59 @@ TRY_END
 }
 
 
-static int global_object_add (lua_State *L)
+/** Create an object of the given class at spawnPos.  The name, rendering distance, lod companions
+ * and user values are taken from the table at table_index, which may be 0 for none.  On error, the
+ * object is deleted again. */
+static GritObjectPtr object_add_from_table (lua_State *L, GritClass *cls, const Vector3 &spawnPos,
+                                            int table_index)
 {
-TRY_START
-    if (lua_gettop(L) == 2) lua_newtable(L);
-    check_args(L, 3);
-    std::string className = check_path(L, 1);
-    Vector3 spawnPos = check_v3(L, 2);
-    int table_index = lua_gettop(L);
-    if (!lua_istable(L, table_index)) my_lua_error(L, "Last parameter should be a table");
-    lua_getfield(L, table_index, "name");
     std::string name;
-    if (lua_isnil(L, -1)) {
-        name = "";
-    } else {
-        if (lua_type(L, -1) != LUA_TSTRING) my_lua_error(L, "Name wasn't a string!");
-        name = lua_tostring(L, -1);
+    if (table_index != 0) {
+        lua_getfield(L, table_index, "name");
+        if (!lua_isnil(L, -1)) {
+            if (lua_type(L, -1) != LUA_TSTRING) my_lua_error(L, "Name wasn't a string!");
+            name = lua_tostring(L, -1);
+        }
+        lua_pop(L, 1);
     }
-    lua_pop(L, 1);
 
-    GritObjectPtr o = object_add(L, name, class_get(className));
+    GritObjectPtr o = object_add(L, name, cls);
     o->userValues.set("spawnPos", spawnPos);
-    lua_getfield(L, table_index, "renderingDistance");
+    if (table_index != 0) {
+        lua_getfield(L, table_index, "renderingDistance");
+    } else {
+        lua_pushnil(L);
+    }
     // Use renderingDistance from table if provided
+    float r;
     if (lua_isnil(L, -1)) {
         lua_pop(L, 1);
         // Otherwise, use class.
-        o->getClass()->get(L, "renderingDistance");
-        if (lua_isnil(L, -1)) {
-            object_del(L, o);
-            my_lua_error(L, "no renderingDistance in class \""
-                            + className + "\"");
-        }
-        if (lua_type(L, -1) != LUA_TNUMBER) {
+        static const ExternalTableKey key("renderingDistance");
+        lua_Number class_r;
+        if (!cls->getCachedNumber(L, key, class_r)) {
+            bool missing = cls->getCachedType(L, key) == LUA_TNIL;
             object_del(L, o);
-            my_lua_error(L, "renderingDistance not a number in class \""
-                            + className + "\"");
+            my_lua_error(L, std::string(missing ? "no renderingDistance in class \""
+                                                : "renderingDistance not a number in class \"")
+                            + cls->name + "\"");
         }
+        r = class_r;
     } else {
         if (lua_type(L, -1) != LUA_TNUMBER) {
             object_del(L, o);
             my_lua_error(L, "renderingDistance not a number in object \""
                             + name + "\"");
         }
+        r = lua_tonumber(L, -1);
+        lua_pop(L, 1);
     }
-    float r = lua_tonumber(L, -1);
     o->updateSphere(spawnPos, r);
-    lua_pop(L, 1);
+
+    if (table_index == 0) {
+        o->init(L, o);
+        return o;
+    }
 
     // TODO move near and far into the loop below ('name' must remain above)
     lua_getfield(L, table_index, "near");
@@ -523,11 +546,94 @@ TRY_START
         }
     }
     o->init(L, o);
+    return o;
+}
+
+static int global_object_add (lua_State *L)
+{
+TRY_START
+    if (lua_gettop(L) == 2) lua_newtable(L);
+    check_args(L, 3);
+    std::string className = check_path(L, 1);
+    Vector3 spawnPos = check_v3(L, 2);
+    int table_index = lua_gettop(L);
+    if (!lua_istable(L, table_index)) my_lua_error(L, "Last parameter should be a table");
+    LUA_BINDING_ARGS_DONE;
+    GritObjectPtr o = object_add_from_table(L, class_get(className), spawnPos, table_index);
     push_gritobj(L, o);
     return 1;
 TRY_END
 }
 
+/** object_add_bulk(classes, positions [, params]) creates many objects in one call, as when
+ * loading a map.  classes is either one class name for all the objects, or an array of them.
+ * positions is an array of vector3.  params, if given, is an array of the tables that object_add
+ * would take (each may be nil).  Objects are added in order, and if one fails, those before it
+ * remain.  Returns the number of objects added.
+ */
+static int global_object_add_bulk (lua_State *L)
+{
+TRY_START
+    if (lua_gettop(L) == 2) lua_pushnil(L);
+    check_args(L, 3);
+    const int classes_index = 1, positions_index = 2, params_index = 3;
+    bool one_class = lua_type(L, classes_index) == LUA_TSTRING;
+    if (!one_class && !lua_istable(L, classes_index))
+        my_lua_error(L, "First parameter should be a class name or an array of them");
+    if (!lua_istable(L, positions_index))
+        my_lua_error(L, "Second parameter should be an array of positions");
+    bool has_params = !lua_isnil(L, params_index);
+    if (has_params && !lua_istable(L, params_index))
+        my_lua_error(L, "Third parameter should be an array of tables");
+
+    size_t n = lua_objlen(L, positions_index);
+    if (!one_class && lua_objlen(L, classes_index) != n)
+        my_lua_error(L, "Number of classes does not match number of positions");
+    object_reserve(object_count() + n);
+
+    // Maps tend to place the same class many times in a row.
+    std::string last_class_name;
+    GritClass *cls = NULL;
+    if (one_class) {
+        cls = class_get(check_path(L, classes_index));
+    }
+
+    int top = lua_gettop(L);
+    for (size_t i=1 ; i<=n ; ++i) {
+        if (!one_class) {
+            lua_rawgeti(L, classes_index, i);
+            std::string class_name = check_path(L, lua_gettop(L));
+            lua_pop(L, 1);
+            if (cls == NULL || class_name != last_class_name) {
+                cls = class_get(class_name);
+                last_class_name = class_name;
+            }
+        }
+
+        lua_rawgeti(L, positions_index, i);
+        Vector3 spawnPos = check_v3(L, lua_gettop(L));
+        lua_pop(L, 1);
+
+        int table_index = 0;
+        if (has_params) {
+            lua_rawgeti(L, params_index, i);
+            if (lua_istable(L, -1)) {
+                table_index = lua_gettop(L);
+            } else if (!lua_isnil(L, -1)) {
+                std::stringstream ss;
+                ss << "Parameters at index " << i << " were not a table";
+                my_lua_error(L, ss.str());
+            }
+        }
+
+        object_add_from_table(L, cls, spawnPos, table_index);
+        lua_settop(L, top);
+    }
+    lua_pushnumber(L, n);
+    return 1;
+TRY_END
+}
+
 static int global_object_del (lua_State *L)
 {
 TRY_START
@@ -572,13 +678,11 @@ static int global_object_all (lua_State *L)
 TRY_START
     check_args(L, 0);
     lua_newtable(L);
-    unsigned int c = 0;
-    GObjMap::iterator i, i_;
-    for (object_all(i, i_) ; i != i_ ; ++i) {
-        const GritObjectPtr &o = i->second;
-        push_gritobj(L, o);
-        lua_rawseti(L, -2, c + 1);
-        c++;         
+    GObjPtrs all;
+    object_all(all);
+    for (size_t i=0 ; i<all.size() ; ++i) {
+        push_gritobj(L, all[i]);
+        lua_rawseti(L, -2, i + 1);
     }       
     return 1;
 TRY_END
@@ -607,11 +711,12 @@ static int global_object_all_deactivate (lua_State *L)
 {
 TRY_START
     check_args(L, 0);
-    GObjMap::iterator i, i_;
-    for (object_all(i, i_) ; i != i_ ; ++i) {
-        const GritObjectPtr &o = i->second;
-        o->deactivate(L, o);
-    }       
+    // Deactivation runs Lua, which may add objects, so work from a snapshot.
+    GObjPtrs all;
+    object_all(all);
+    for (size_t j=0 ; j<all.size() ; ++j) {
+        all[j]->deactivate(L, all[j]);
+    }
     return 0;
 TRY_END
 }
@@ -648,16 +753,11 @@ TRY_START
     check_args(L, 1);
     std::string cls = check_path(L, 1);
     lua_newtable(L);
-    unsigned int c = 0;
-    GObjMap::iterator i, i_;
-    for (object_all(i, i_) ; i != i_ ; ++i) {
-        const GritObjectPtr &o = i->second;
-        GritClass *oc = o->getClass();
-        if (oc == NULL) continue; // object destroyed
-        if (oc->name != cls) continue; // wrong class
-        push_gritobj(L, o);
-        lua_rawseti(L, -2, c + 1);
-        c++;         
+    GObjPtrs all;
+    object_all_of_class(all, cls);
+    for (size_t i=0 ; i<all.size() ; ++i) {
+        push_gritobj(L, all[i]);
+        lua_rawseti(L, -2, i + 1);
     }       
     return 1;
 TRY_END
@@ -668,15 +768,7 @@ static int global_object_count_of_class (lua_State *L)
 TRY_START
     check_args(L, 1);
     std::string cls = check_path(L, 1);
-    unsigned counter = 0;
-    GObjMap::iterator i, i_;
-    for (object_all(i, i_) ; i != i_ ; ++i) {
-        const GritObjectPtr &o = i->second;
-        GritClass *oc = o->getClass();
-        if (oc == NULL) continue; // object destroyed
-        if (oc->name != cls) continue; // wrong class
-        counter++;
-    }       
+    lua_pushnumber(L, object_count_of_class(cls));
     return 1;
 TRY_END
 }
@@ -713,7 +805,9 @@ static const luaL_reg global[] = {
     {"class_has", global_class_has},
     {"class_all", global_class_all},
     {"class_count", global_class_count},
+    {"class_invalidate_caches", global_class_invalidate_caches},
     {"object_add", global_object_add},
+    {"object_add_bulk", global_object_add_bulk},
     {"object_del", global_object_del},
     {"object_all_del", global_object_all_del},
     {"object_get", global_object_get},
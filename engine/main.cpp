@@ -40,8 +40,12 @@
 #include "clipboard.h"
 
 #include <centralised_log.h>
+#include "asset_archive.h"
 #include "core_option.h"
+#include "frame_profiler.h"
 #include "grit_lua_util.h"
+#include "headless_input.h"
+#include "job_system.h"
 #include "lua_wrappers_core.h"
 #include "main.h"
 
@@ -123,25 +127,51 @@ int main (int argc, const char **argv)
         // feenableexcept(FE_DIVBYZERO | FE_INVALID);
         // #endif
 
+        frame_profiler_thread_name("main");
+
         bgl = new BackgroundLoader();
 
-        size_t winid = gfx_init(cb);
+        // Packed game files, searched before loose files.  Separated like PATH.
+        if (const char *archives = getenv("GRIT_ARCHIVES")) {
+            #ifdef WIN32
+            const char sep = ';';
+            #else
+            const char sep = ':';
+            #endif
+            std::string s = archives;
+            for (size_t begin = 0, end ; begin < s.length() ; begin = end + 1) {
+                end = s.find(sep, begin);
+                if (end == std::string::npos) end = s.length();
+                if (end > begin) asset_archive_mount(s.substr(begin, end - begin));
+            }
+        }
+
+        // No window or GPU, e.g. for dedicated servers and benchmarks.
+        bool headless = getenv("GRIT_HEADLESS") != NULL;
 
-        debug_drawer = new BulletDebugDrawer(); // FIXME: hack
+        size_t winid = gfx_init(cb, headless);
 
-        #ifdef WIN32
-        mouse = new MouseDirectInput8(winid);
-        bool use_dinput = getenv("GRIT_DINPUT")!=NULL;
-        keyboard = use_dinput ? (Keyboard *)new KeyboardDirectInput8(winid)
-                      : (Keyboard *)new KeyboardWinAPI(winid);
-        joystick = new JoystickDirectInput8(winid);
-        #else
-        mouse = new MouseX11(winid);
-        keyboard = new KeyboardX11(winid);
-        joystick = new JoystickDevjs(winid);
-        #endif
+        debug_drawer = new BulletDebugDrawer(); // FIXME: hack
 
-        clipboard_init();
+        if (headless) {
+            mouse = new MouseHeadless();
+            keyboard = new KeyboardHeadless();
+            joystick = new JoystickHeadless();
+        } else {
+            #ifdef WIN32
+            mouse = new MouseDirectInput8(winid);
+            bool use_dinput = getenv("GRIT_DINPUT")!=NULL;
+            keyboard = use_dinput ? (Keyboard *)new KeyboardDirectInput8(winid)
+                          : (Keyboard *)new KeyboardWinAPI(winid);
+            joystick = new JoystickDirectInput8(winid);
+            #else
+            mouse = new MouseX11(winid);
+            keyboard = new KeyboardX11(winid);
+            joystick = new JoystickDevjs(winid);
+            #endif
+
+            clipboard_init();
+        }
 
         physics_init();
 
@@ -176,14 +206,21 @@ int main (int argc, const char **argv)
         CVERB << "Shutting down Lua graphics subsystem..." << std::endl;
         gfx_shutdown_lua(core_L);
 
+        CVERB << "Shutting down Lua physics subsystem..." << std::endl;
+        physics_shutdown_lua(core_L);
+
         CVERB << "Shutting down Lua net subsystem..." << std::endl;
         net_shutdown(core_L);
 
         CVERB << "Shutting down navigation subsystem..." << std::endl;
         navigation_shutdown();
 
+        CVERB << "Shutting down job system..." << std::endl;
+        job_system_shutdown();
+
         CVERB << "Shutting down Background Loader..." << std::endl;
         bgl->shutdown();
+        asset_archive_unmount_all();
 
         CVERB << "Shutting down Mouse & Keyboard..." << std::endl;
         if (mouse) delete mouse;
@@ -1,6 +1,8 @@
 #include <sleep.h>
 
 #include <centralised_log.h>
+#include "../frame_profiler.h"
+
 #include "net.h"
 
 #include "net_manager.h"
@@ -21,6 +23,7 @@ void net_shutdown(lua_State *L)
 
 void net_process(lua_State* L)
 {
+    FRAME_PROFILER_ZONE("net_process");
     APP_ASSERT(netManager != NULL);
 
     netManager->process(L);
@@ -0,0 +1,76 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <btBulletCollisionCommon.h>
+#include <BulletCollision/CollisionDispatch/btInternalEdgeUtility.h>
+
+#include "bcol_bake.h"
+#include "tcol_parser.h"
+
+void bcol_bake_trimesh (TColFile &f, BColBakedTriMesh &baked)
+{
+    TColTriMesh &t = f.triMesh;
+
+    // Only the engine's static trimeshes use a bvh.
+    if (f.mass != 0 || t.faces.size() == 0) return;
+
+    // Same triangles as the loader gives Bullet, only the strides differ.
+    std::vector<int> indexes;
+    indexes.reserve(3 * t.faces.size());
+    for (unsigned j=0 ; j<t.faces.size() ; ++j) {
+        indexes.push_back(t.faces[j].v1);
+        indexes.push_back(t.faces[j].v2);
+        indexes.push_back(t.faces[j].v3);
+    }
+    std::vector<float> positions;
+    positions.reserve(3 * t.vertexes.size());
+    for (unsigned j=0 ; j<t.vertexes.size() ; ++j) {
+        positions.push_back(t.vertexes[j].x);
+        positions.push_back(t.vertexes[j].y);
+        positions.push_back(t.vertexes[j].z);
+    }
+    btTriangleIndexVertexArray v(t.faces.size(), &indexes[0], 3*sizeof(int),
+                                 t.vertexes.size(), &positions[0], 3*sizeof(float));
+
+    btBvhTriangleMeshShape tm(&v, true, true);
+    tm.setMargin(t.margin);
+    btTriangleInfoMap tri_info_map;
+    tri_info_map.m_edgeDistanceThreshold = t.edgeDistanceThreshold;
+    btGenerateInternalEdgeInfo(&tm, &tri_info_map);
+
+    // The mesh has only one part, so a triangle's key is just its index.
+    for (unsigned j=0 ; j<t.faces.size() ; ++j) {
+        const btTriangleInfo *info = tri_info_map.find(btHashInt(j));
+        if (info == NULL) continue;
+        BColTriInfo ti = { j, uint32_t(info->m_flags), info->m_edgeV0V1Angle,
+                           info->m_edgeV1V2Angle, info->m_edgeV2V0Angle };
+        baked.infos.push_back(ti);
+    }
+
+    btQuantizedBvh *bvh = tm.getOptimizedBvh();
+    unsigned bytes = bvh->calculateSerializeBufferSize();
+    void *buf = btAlignedAlloc(bytes, 16);
+    if (bvh->serialize(buf, bytes, false)) {
+        baked.bvh.assign(static_cast<char*>(buf), static_cast<char*>(buf) + bytes);
+    }
+    btAlignedFree(buf);
+    baked.bvhTag = bcol_bvh_tag();
+}
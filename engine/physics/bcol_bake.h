@@ -0,0 +1,43 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <btBulletCollisionCommon.h>
+
+#include "bcol_parser.h"
+
+struct TColFile;
+
+#ifndef BColBake_h
+#define BColBake_h
+
+/** Identifies the Bullet build a baked bvh was serialised by.  The loader ignores a baked bvh with
+ * a different tag and builds one instead, as the serialised form depends on the Bullet version and
+ * the size of pointers. */
+static inline uint32_t bcol_bvh_tag (void)
+{
+    return BT_BULLET_VERSION << 16 | sizeof(void*) << 8 | sizeof(btScalar);
+}
+
+/** Does what CollisionMesh would otherwise do when loading the file's static trimesh, so the result
+ * can be given to write_tcol_as_bcol.  Leaves baked empty if there is no static trimesh. */
+void bcol_bake_trimesh (TColFile &f, BColBakedTriMesh &baked);
+
+#endif
@@ -195,18 +195,21 @@ void write_bcol_as_tcol (std::ostream &o, BColFile &f)
     }
 }
 
-namespace {
-
-
+void write_tcol_as_bcol (std::ostream &o, TColFile &f)
+{
+    write_tcol_as_bcol(o, f, BColBakedTriMesh());
 }
 
-void write_tcol_as_bcol (std::ostream &o, TColFile &f)
+void write_tcol_as_bcol (std::ostream &o, TColFile &f, const BColBakedTriMesh &baked)
 {
 
     TColCompound &c = f.compound;
     TColTriMesh &t = f.triMesh;
 
-    const size_t hull_start = BColFile::size();
+    // Only files with something baked need the BCOL1.1 header.
+    const bool any_baked = baked.infos.size() > 0 || baked.bvh.size() > 0;
+
+    const size_t hull_start = any_baked ? BColFile::size() : BColFile::size1_0();
     const size_t box_start = hull_start + BColHull::size()*c.hulls.size();
     const size_t cyl_start = box_start + BColBox::size()*c.boxes.size();
     const size_t cone_start = cyl_start + BColCyl::size()*c.cylinders.size();
@@ -221,9 +224,15 @@ void write_tcol_as_bcol (std::ostream &o, TColFile &f)
     }
 
     size_t trimesh_face_start = trimesh_vert_start + BColVert::size()*t.vertexes.size();
-    size_t text_start = trimesh_face_start + BColFace::size()*t.faces.size();
 
-    ios_write_byte_array(o, "BCOL1.0\n", 8);
+    size_t trimesh_info_start = trimesh_face_start + BColFace::size()*t.faces.size();
+    size_t trimesh_bvh_start = trimesh_info_start + BColTriInfo::size()*baked.infos.size();
+    size_t trimesh_bvh_padding = (16 - trimesh_bvh_start % 16) % 16;
+    if (baked.bvh.size() == 0) trimesh_bvh_padding = 0;
+    trimesh_bvh_start += trimesh_bvh_padding;
+    size_t text_start = trimesh_bvh_start + baked.bvh.size();
+
+    ios_write_byte_array(o, any_baked ? "BCOL1.1\n" : "BCOL1.0\n", 8);
     ios_write_float(o, f.mass);
     ios_write_u32(o, f.hasInertia);
     ios_write_float(o,f.inertia_x);
@@ -246,6 +255,11 @@ void write_tcol_as_bcol (std::ostream &o, TColFile &f)
     ios_write_float(o,t.edgeDistanceThreshold);
     ios_write_u32(o, t.vertexes.size()); ios_write_u32(o, trimesh_vert_start); // verts
     ios_write_u32(o, t.faces.size()); ios_write_u32(o, trimesh_face_start); // faces
+    if (any_baked) {
+        ios_write_u32(o, baked.bvhTag);
+        ios_write_u32(o, baked.bvh.size()); ios_write_u32(o, trimesh_bvh_start); // bvh
+        ios_write_u32(o, baked.infos.size()); ios_write_u32(o, trimesh_info_start); // infos
+    }
     //CTRACE(t.vertexes.size());
     //CTRACE(t.faces.size());
 
@@ -399,6 +413,21 @@ void write_tcol_as_bcol (std::ostream &o, TColFile &f)
         local_trimesh_face_start += BColFace::size();
     }   
 
+    // edge info for trimesh
+    for (unsigned j=0 ; j<baked.infos.size() ; ++j) {
+        const BColTriInfo &ti = baked.infos[j];
+        ios_write_u32(o, ti.face);
+        ios_write_u32(o, ti.flags);
+        ios_write_float(o, ti.edgeV0V1Angle);
+        ios_write_float(o, ti.edgeV1V2Angle);
+        ios_write_float(o, ti.edgeV2V0Angle);
+    }
+
+    // bvh for trimesh
+    const char zeros[16] = { 0 };
+    ios_write_byte_array(o, zeros, trimesh_bvh_padding);
+    if (baked.bvh.size() > 0) ios_write_byte_array(o, &baked.bvh[0], baked.bvh.size());
+
     // text
     sa.write(o);
     
@@ -427,6 +456,7 @@ static bool bcol_assert_structs_size_ok (void) {
     r &= bcol_assert_struct_size_ok<BColPlane>("BColPlane");
     r &= bcol_assert_struct_size_ok<BColSphere>("BColSphere");
     r &= bcol_assert_struct_size_ok<BColFace>("BColFace");
+    r &= bcol_assert_struct_size_ok<BColTriInfo>("BColTriInfo");
     r &= bcol_assert_struct_size_ok<BColFile>("BColFile");
     if (!r) exit(EXIT_FAILURE);
     return r;
@@ -23,11 +23,16 @@
 
 struct BColFile;
 struct TColFile;
+struct BColBakedTriMesh;
 
 void write_bcol_as_tcol (std::ostream &o, BColFile &f);
 
 void write_tcol_as_bcol (std::ostream &o, TColFile &f);
 
+/** Also stores the static trimesh's bvh and internal edge info, as computed by bcol_bake_trimesh,
+ * so they need not be computed every time the bcol is loaded. */
+void write_tcol_as_bcol (std::ostream &o, TColFile &f, const BColBakedTriMesh &baked);
+
 #ifndef BColParser_h
 #define BColParser_h
 
@@ -134,8 +139,16 @@ struct BColFace {
     static size_t size (void) { return 3*4 + BColMat::size(); }
 } GRIT_PACKED_ATTR;
 
+// Internal edge info of one triangle of a static trimesh, as computed by Bullet.
+struct BColTriInfo {
+    uint32_t face; // index into the faces
+    uint32_t flags;
+    float edgeV0V1Angle, edgeV1V2Angle, edgeV2V0Angle;
+    static size_t size (void) { return 2*4 + 3*4; }
+} GRIT_PACKED_ATTR;
+
 struct BColFile : OffsetBase {
-    char header[8]; // "BCOL1.0\n"
+    char header[8]; // "BCOL1.0\n" or "BCOL1.1\n"
     float mass;
     uint32_t inertiaProvided; // 
     float inertia[3];
@@ -156,6 +169,10 @@ struct BColFile : OffsetBase {
     float triMeshEdgeDistanceThreshold;
     uint32_t triMeshVertNum, triMeshVertOff; // offset (relative to this) to BColVertex array
     uint32_t triMeshFaceNum, triMeshFaceOff; // offset (relative to this) to BColFace array
+    // The rest is only present since BCOL1.1, use the accessors below.  Both are optional.
+    uint32_t triMeshBvhTag; // bcol_bvh_tag() of the Bullet that serialised the bvh
+    uint32_t triMeshBvhSize, triMeshBvhOff; // offset (relative to this) to serialised bvh, 16 aligned
+    uint32_t triMeshInfoNum, triMeshInfoOff; // offset (relative to this) to BColTriInfo array
 
     BColHull *hulls (int i=0) { return offset<BColHull>(hullOff,i); }
     BColBox *boxes (int i=0) { return offset<BColBox>(boxOff,i); }
@@ -170,7 +187,27 @@ struct BColFile : OffsetBase {
     BColVert *triMeshVerts (int i=0) { return offset<BColVert>(triMeshVertOff,i); }
     BColFace *triMeshFaces (int i=0) { return offset<BColFace>(triMeshFaceOff,i); }
 
-    static size_t size (void) { return 33*4; }
+    unsigned minorVersion (void) const { return header[6] - '0'; }
+    uint32_t triMeshBvhBytes (void) const { return minorVersion() >= 1 ? triMeshBvhSize : 0; }
+    uint32_t triMeshInfos (void) const { return minorVersion() >= 1 ? triMeshInfoNum : 0; }
+    void *triMeshBvh (void) { return offset<char>(triMeshBvhOff); }
+    BColTriInfo *triMeshInfo (int i=0) { return offset<BColTriInfo>(triMeshInfoOff,i); }
+
+    // Whether the baked sections lie within a file of the given length.
+    bool triMeshBvhInRange (size_t length) const
+    {
+        uint32_t bytes = triMeshBvhBytes();
+        return bytes == 0 || (triMeshBvhOff <= length && bytes <= length - triMeshBvhOff);
+    }
+    bool triMeshInfosInRange (size_t length) const
+    {
+        uint32_t num = triMeshInfos();
+        return num == 0 || (triMeshInfoOff <= length
+                            && num <= (length - triMeshInfoOff) / BColTriInfo::size());
+    }
+
+    static size_t size (void) { return 38*4; }
+    static size_t size1_0 (void) { return 33*4; } // header of files without the BCOL1.1 fields
 } GRIT_PACKED_ATTR;
 
 #ifdef _MSC_VER
@@ -180,4 +217,13 @@ struct BColFile : OffsetBase {
 typedef std::vector<BColFace> BColFaces;
 typedef std::vector<BColVert> BColVerts;
 
+/** The parts of a static trimesh that Bullet would otherwise compute when the bcol is loaded.  Both
+ * are empty if nothing was baked. */
+struct BColBakedTriMesh {
+    BColBakedTriMesh (void) : bvhTag(0) { }
+    std::vector<BColTriInfo> infos;
+    std::vector<char> bvh;
+    uint32_t bvhTag; // bcol_bvh_tag() of the Bullet that serialised the bvh
+};
+
 #endif
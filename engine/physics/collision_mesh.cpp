@@ -28,8 +28,10 @@
 #include <BulletCollision/CollisionDispatch/btInternalEdgeUtility.h>
 
 #include <centralised_log.h>
+#include "../asset_archive.h"
 #include "../path_util.h"
 
+#include "bcol_bake.h"
 #include "collision_mesh.h"
 
 
@@ -169,12 +171,8 @@ void CollisionMesh::loadImpl (void)
 {
     APP_ASSERT(masterShape==NULL);
 
-    Ogre::DataStreamPtr file;
-    try {
-        file = Ogre::ResourceGroupManager::getSingleton().openResource(name.substr(1), "GRIT");
-    } catch (Ogre::Exception &e) {
-        GRIT_EXCEPT(e.getDescription());
-    }
+    AssetView view;
+    Ogre::DataStreamPtr file = disk_resource_open(name, view);
 
     std::string ext = name.substr(name.length()-5);
 
@@ -196,10 +194,16 @@ void CollisionMesh::loadImpl (void)
 
     if (fourcc==0x4c4f4342) { //BCOL
 
-        Ogre::MemoryDataStreamPtr mem = 
-            Ogre::MemoryDataStreamPtr(OGRE_NEW Ogre::MemoryDataStream(name,file));
+        // If the file is in an archive, parse it in place (it is only read), otherwise copy it
+        // into memory.
+        Ogre::MemoryDataStreamPtr mem;
+        if (view.data == NULL) {
+            mem = Ogre::MemoryDataStreamPtr(OGRE_NEW Ogre::MemoryDataStream(name,file));
+            view.data = mem->getPtr();
+            view.length = mem->size();
+        }
 
-        BColFile &bcol = *reinterpret_cast<BColFile*>(mem->getPtr());
+        BColFile &bcol = *reinterpret_cast<BColFile*>(const_cast<uint8_t*>(view.data));
 
         is_static = bcol.mass == 0.0f; // static
 
@@ -300,12 +304,47 @@ void CollisionMesh::loadImpl (void)
 
 
             if (is_static) {
-                btBvhTriangleMeshShape *tm = new btBvhTriangleMeshShape(v,true,true);
+                // Use the bvh from the file if there is one, otherwise build it.  It is copied
+                // because Bullet writes to it and it must outlive the file's memory.
+                uint32_t bvh_bytes = bcol.triMeshBvhBytes();
+                if (!bcol.triMeshBvhInRange(view.length)) {
+                    CERR << "Ignoring out of range bvh in \"" << name << "\"" << std::endl;
+                    bvh_bytes = 0;
+                }
+                if (bvh_bytes > 0 && bcol.triMeshBvhTag == bcol_bvh_tag()) {
+                    void *buf = btAlignedAlloc(bvh_bytes, 16);
+                    memcpy(buf, bcol.triMeshBvh(), bvh_bytes);
+                    bakedBvh = btOptimizedBvh::deSerializeInPlace(buf, bvh_bytes, false);
+                    if (bakedBvh == NULL) {
+                        CERR << "Ignoring corrupt bvh in \"" << name << "\"" << std::endl;
+                        btAlignedFree(buf);
+                    }
+                }
+                btBvhTriangleMeshShape *tm = new btBvhTriangleMeshShape(v,true,bakedBvh==NULL);
+                if (bakedBvh != NULL) tm->setOptimizedBvh(bakedBvh);
                 tm->setMargin(bcol.triMeshMargin);
                 btTriangleInfoMap* tri_info_map = new btTriangleInfoMap();
                 tri_info_map->m_edgeDistanceThreshold = bcol.triMeshEdgeDistanceThreshold;
 
-                btGenerateInternalEdgeInfo(tm,tri_info_map);
+                uint32_t infos = bcol.triMeshInfos();
+                if (!bcol.triMeshInfosInRange(view.length)) {
+                    CERR << "Ignoring out of range edge info in \"" << name << "\"" << std::endl;
+                    infos = 0;
+                }
+                if (infos > 0) {
+                    for (unsigned i=0 ; i<infos ; ++i) {
+                        BColTriInfo &ti = *bcol.triMeshInfo(i);
+                        btTriangleInfo info;
+                        info.m_flags = ti.flags;
+                        info.m_edgeV0V1Angle = ti.edgeV0V1Angle;
+                        info.m_edgeV1V2Angle = ti.edgeV1V2Angle;
+                        info.m_edgeV2V0Angle = ti.edgeV2V0Angle;
+                        tri_info_map->insert(btHashInt(ti.face), info);
+                    }
+                    tm->setTriangleInfoMap(tri_info_map);
+                } else {
+                    btGenerateInternalEdgeInfo(tm,tri_info_map);
+                }
                 masterShape->addChildShape(btTransform::getIdentity(), tm);
             } else {
                 // skip over dynamic trimesh
@@ -487,6 +526,45 @@ void CollisionMesh::loadImpl (void)
             setInertia(from_bullet(i));
         }
     }
+
+    setHostRAM(computeHostRAM());
+}
+
+size_t CollisionMesh::computeHostRAM (void) const
+{
+    size_t r = 0;
+    r += faces.capacity() * sizeof(TColFace);
+    r += verts.capacity() * sizeof(Vector3);
+    r += bcolFaces.capacity() * sizeof(BColFace);
+    r += bcolVerts.capacity() * sizeof(BColVert);
+    r += faceMaterials.capacity() * sizeof(PhysicalMaterial*);
+    r += partMaterials.capacity() * sizeof(PhysicalMaterial*);
+    typedef ProcObjFaceDB::const_iterator I;
+    for (I i=procObjFaceDB.begin(),i_=procObjFaceDB.end() ; i!=i_ ; ++i) {
+        const ProcObjFaceDBEntry &ent = i->second;
+        r += sizeof(ent);
+        r += ent.faces.capacity() * sizeof(ProcObjFace);
+        r += (ent.areas.capacity() + ent.areas10.capacity()) * sizeof(float);
+    }
+
+    r += sizeof(btCompoundShape);
+    int num_children = masterShape->getNumChildShapes();
+    for (int i=0 ; i<num_children ; ++i) {
+        const btCollisionShape *s = masterShape->getChildShape(i);
+        if (auto *hull = dynamic_cast<const btConvexHullShape*>(s)) {
+            r += sizeof(*hull) + hull->getNumPoints() * sizeof(btVector3);
+        } else if (auto *tm = dynamic_cast<const btBvhTriangleMeshShape*>(s)) {
+            // Quantized bvh nodes (about 2 per triangle) and the internal edge info, plus the
+            // mesh interface.
+            size_t tris = faces.size() + bcolFaces.size();
+            r += sizeof(*tm) + sizeof(btTriangleIndexVertexArray);
+            r += tris * 2 * sizeof(btQuantizedBvhNode);
+            r += tris * (sizeof(btTriangleInfo) + 2 * sizeof(int));
+        } else {
+            r += 64;  // Primitives are small.
+        }
+    }
+    return r;
 }
 
 void CollisionMesh::unloadImpl (void)
@@ -509,6 +587,13 @@ void CollisionMesh::unloadImpl (void)
     }
     delete masterShape;
     masterShape = NULL;
+
+    // Deserialised in place, so the object is at the start of the buffer.
+    if (bakedBvh != NULL) {
+        bakedBvh->~btOptimizedBvh();
+        btAlignedFree(bakedBvh);
+        bakedBvh = NULL;
+    }
 }
 
 PhysicalMaterial *CollisionMesh::getMaterialFromPart (unsigned int id) const
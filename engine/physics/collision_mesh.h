@@ -25,6 +25,7 @@ class CollisionMesh;
 #define CollisionMesh_h
 
 class btCompoundShape;
+class btOptimizedBvh;
 
 #include <string>
 
@@ -46,6 +47,7 @@ class CollisionMesh : public DiskResource {
     CollisionMesh (const std::string &name)
           : name(name),
             masterShape(NULL),
+            bakedBvh(NULL),
             inertia(0.0f, 0.0f, 0.0f),
             mass(0.0f),
             ccdMotionThreshold(0.0f),
@@ -62,6 +64,8 @@ class CollisionMesh : public DiskResource {
 
     const std::string &getName (void) const { return name; }
 
+    const char *getTypeName (void) const { return "CollisionMesh"; }
+
     float getMass (void) const { return mass; }
     void setMass (float v) { mass = v; }
 
@@ -242,6 +246,9 @@ class CollisionMesh : public DiskResource {
     const std::string name;
     btCompoundShape *masterShape;
 
+    // The static trimesh's bvh when it came from the bcol, not owned by the shape.
+    btOptimizedBvh *bakedBvh;
+
     Vector3 inertia;
     float mass;
     float ccdMotionThreshold;
@@ -256,6 +263,9 @@ class CollisionMesh : public DiskResource {
     void loadImpl (void);
     void unloadImpl (void);
 
+    /** An estimate of the bytes used by the loaded shapes, faces, and tables. */
+    size_t computeHostRAM (void) const;
+
 
     ProcObjFaceDB procObjFaceDB;
 
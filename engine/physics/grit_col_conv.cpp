@@ -35,6 +35,7 @@
 #include <portable_io.h>
 #include "tcol_parser.h"
 #include "bcol_parser.h"
+#include "bcol_bake.h"
 
 #define VERSION "1.0"
 
@@ -52,7 +53,9 @@ const char *usage =
 "              | \"-o\" | \"--output\" <name>   output file\n"
 "                                                 (ignored if binary col found)\n\n"
 "              | \"-B\" | \"--output-bcol\"     output binary\n"
-"              | \"-T\" | \"--output-tcol\"     output text (default)\n";
+"              | \"-T\" | \"--output-tcol\"     output text (default)\n"
+"              | \"-b\" | \"--bake\"            precompute static trimesh bvh\n"
+"                                                 and edge info (binary output only)\n";
 
 std::string next_arg(int& so_far, int argc, char **argv)
 {
@@ -80,6 +83,7 @@ int main (int argc, char **argv)
     int debug_level = 0;
     bool output_binary_specified = false;
     bool output_binary = false; // always overwritten
+    bool bake = false;
     std::string input_filename;
     std::string output_filename;
     std::string mat_prefix;
@@ -102,6 +106,8 @@ int main (int argc, char **argv)
         } else if (arg=="-T" || arg=="--output-tcol") {
             output_binary = false;
             output_binary_specified = true;
+        } else if (arg=="-b" || arg=="--bake") {
+            bake = true;
         } else if (arg=="-m" || arg=="--material-prefix") {
             mat_prefix = next_arg(so_far,argc,argv);
         } else if (arg=="-h" || arg=="--help") {
@@ -162,7 +168,9 @@ int main (int argc, char **argv)
             delete qlex;
 
             if (output_binary) {
-                    write_tcol_as_bcol(*out, tcol);
+                    BColBakedTriMesh baked;
+                    if (bake) bcol_bake_trimesh(tcol, baked);
+                    write_tcol_as_bcol(*out, tcol, baked);
             } else {
                     pretty_print_tcol(*out,tcol);
             }
@@ -205,6 +213,11 @@ int main (int argc, char **argv)
                 return EXIT_FAILURE;
             }
 
+            if (!bcol->triMeshBvhInRange(sz) || !bcol->triMeshInfosInRange(sz)) {
+                CERR << "baked trimesh data out of range: \""<<in_name<<"\"" << std::endl;
+                return EXIT_FAILURE;
+            }
+
             if (output_binary) {
                 GRIT_EXCEPT("Writing a BCol from a BCol not implemented.");
                 return EXIT_FAILURE;
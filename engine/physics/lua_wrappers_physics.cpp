@@ -599,6 +599,7 @@ TRY_START
         check_args(L, 2);
         GET_UD_MACRO(RigidBody, self, 1, RBODY_TAG);
         const char *key = luaL_checkstring(L, 2);
+        LUA_BINDING_ARGS_DONE;
         if (!::strcmp(key, "force")) {
                 push_cfunction(L, rbody_force);
         } else if (!::strcmp(key, "impulse")) {
@@ -700,8 +701,16 @@ TRY_START
                 self.stepCallbackPtr.push(L);
         } else if (!::strcmp(key, "collisionCallback")) {
                 self.collisionCallbackPtr.push(L);
+        } else if (!::strcmp(key, "collisionImpulseThreshold")) {
+                lua_pushnumber(L, self.collisionImpulseThreshold);
         } else if (!::strcmp(key, "stabiliseCallback")) {
                 self.stabiliseCallbackPtr.push(L);
+        } else if (!::strcmp(key, "gfxNode")) {
+                push_gfx_node_concrete(L, self.getGfxNode());
+        } else if (!::strcmp(key, "gfxNodeOffset")) {
+                push_v3(L, self.getGfxNodeOffset());
+        } else if (!::strcmp(key, "gfxNodeOffsetOrientation")) {
+                push_quat(L, self.getGfxNodeOffsetOrientation());
         } else {
                 my_lua_error(L, "Not a readable RigidBody member: "+std::string(key));
         }
@@ -715,6 +724,7 @@ TRY_START
         check_args(L, 3);
         GET_UD_MACRO(RigidBody, self, 1, RBODY_TAG);
         const char *key = luaL_checkstring(L, 2);
+        LUA_BINDING_ARGS_DONE;
         if (!::strcmp(key, "linearVelocity")) {
                 Vector3 v = check_v3(L, 3);
                 self.setLinearVelocity(v);
@@ -749,13 +759,29 @@ TRY_START
                 bool v = check_bool(L, 3);
                 self.setGhost(v);
         } else if (!::strcmp(key, "updateCallback")) {
-                self.updateCallbackPtr.set(L);
+                self.setUpdateCallback(L);
         } else if (!::strcmp(key, "stepCallback")) {
-                self.stepCallbackPtr.set(L);
+                self.setStepCallback(L);
         } else if (!::strcmp(key, "collisionCallback")) {
                 self.collisionCallbackPtr.set(L);
+        } else if (!::strcmp(key, "collisionImpulseThreshold")) {
+                float v = check_float(L, 3);
+                self.collisionImpulseThreshold = v;
         } else if (!::strcmp(key, "stabiliseCallback")) {
-                self.stabiliseCallbackPtr.set(L);
+                self.setStabiliseCallback(L);
+        } else if (!::strcmp(key, "gfxNode")) {
+                if (lua_isnil(L, 3)) {
+                        self.setGfxNode(GfxNodePtr(NULL));
+                } else {
+                        GfxNodePtr v = check_gfx_node(L, 3);
+                        self.setGfxNode(v);
+                }
+        } else if (!::strcmp(key, "gfxNodeOffset")) {
+                Vector3 v = check_v3(L, 3);
+                self.setGfxNodeOffset(v);
+        } else if (!::strcmp(key, "gfxNodeOffsetOrientation")) {
+                Quaternion v = check_quat(L, 3);
+                self.setGfxNodeOffsetOrientation(v);
         } else if (!::strcmp(key, "inertia")) {
                 Vector3 v = check_v3(L, 3);
                 self.setInertia(v);
@@ -888,6 +914,17 @@ TRY_START
 TRY_END
 }
 
+static int global_physics_set_collision_handler (lua_State *L)
+{
+TRY_START
+        check_args(L, 1);
+        if (!lua_isnil(L, 1) && !lua_isfunction(L, 1))
+                my_lua_error(L, "Collision handler must be a function or nil.");
+        physics_set_collision_handler(L);
+        return 0;
+TRY_END
+}
+
 static int global_physics_update_graphics (lua_State *L)
 {
 TRY_START
@@ -1060,6 +1097,7 @@ static const luaL_reg global[] = {
 
         {"physics_update", global_physics_update},
         {"physics_update_graphics", global_physics_update_graphics},
+        {"physics_set_collision_handler", global_physics_set_collision_handler},
 
         {"physics_body_make", global_physics_body_make},
         {"physics_get_gravity", global_physics_get_gravity},
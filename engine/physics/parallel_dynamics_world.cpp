@@ -0,0 +1,211 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <atomic>
+
+#include <BulletCollision/CollisionDispatch/btSimulationIslandManager.h>
+
+#include <centralised_log.h>
+
+#include "../frame_profiler.h"
+#include "../job_system.h"
+
+#include "parallel_dynamics_world.h"
+
+namespace {
+
+    // As in btDiscreteDynamicsWorld, a constraint belongs to the island of either of its bodies
+    // that is in one.
+    int constraint_island (const btTypedConstraint *c)
+    {
+        int a = c->getRigidBodyA().getIslandTag();
+        return a >= 0 ? a : c->getRigidBodyB().getIslandTag();
+    }
+
+    struct ConstraintIslandLess {
+        bool operator() (const btTypedConstraint *a, const btTypedConstraint *b) const
+        { return constraint_island(a) < constraint_island(b); }
+    };
+
+    bool touches_kinematic (const btCollisionObject *a, const btCollisionObject *b)
+    {
+        return a->isKinematicObject() || b->isKinematicObject();
+    }
+
+    // Cost estimate for ordering the islands.
+    int island_size (int bodies, int manifolds, int constraints)
+    {
+        return bodies + manifolds + 2 * constraints;
+    }
+
+}
+
+// Records the islands instead of solving them.  They are given in order of island id.
+struct ParallelDynamicsWorld::IslandGatherer : public btSimulationIslandManager::IslandCallback {
+
+    ParallelDynamicsWorld &world;
+    btTypedConstraint **constraints;
+    int numConstraints;
+    int nextConstraint;
+
+    IslandGatherer (ParallelDynamicsWorld &world, btTypedConstraint **constraints,
+                    int num_constraints)
+      : world(world), constraints(constraints), numConstraints(num_constraints), nextConstraint(0)
+    { }
+
+    void processIsland (btCollisionObject **bodies, int num_bodies,
+                        btPersistentManifold **manifolds, int num_manifolds,
+                        int island_id) override
+    {
+        Island island;
+        island.id = island_id;
+        // The bodies are only valid during this call.
+        island.bodiesBegin = world.islandBodies.size();
+        island.numBodies = num_bodies;
+        for (int i=0 ; i<num_bodies ; ++i) world.islandBodies.push_back(bodies[i]);
+        island.manifolds = manifolds;
+        island.numManifolds = num_manifolds;
+
+        if (island_id < 0) {
+            // Islands are not being split, so this is everything.
+            island.constraints = constraints;
+            island.numConstraints = numConstraints;
+        } else {
+            // Constraints of sleeping islands and between static bodies are skipped.
+            while (nextConstraint < numConstraints
+                   && constraint_island(constraints[nextConstraint]) < island_id)
+                nextConstraint++;
+            island.constraints = constraints + nextConstraint;
+            island.numConstraints = 0;
+            while (nextConstraint < numConstraints
+                   && constraint_island(constraints[nextConstraint]) == island_id) {
+                nextConstraint++;
+                island.numConstraints++;
+            }
+        }
+
+        island.kinematic = false;
+        for (int i=0 ; i<island.numManifolds && !island.kinematic ; ++i) {
+            btPersistentManifold *m = island.manifolds[i];
+            island.kinematic = touches_kinematic(static_cast<btCollisionObject*>(m->getBody0()),
+                                                 static_cast<btCollisionObject*>(m->getBody1()));
+        }
+        for (int i=0 ; i<island.numConstraints && !island.kinematic ; ++i) {
+            btTypedConstraint *c = island.constraints[i];
+            island.kinematic = touches_kinematic(&c->getRigidBodyA(), &c->getRigidBodyB());
+        }
+
+        if (island.kinematic) world.kinematicIslands.push_back(island);
+        else world.islands.push_back(island);
+    }
+};
+
+
+ParallelDynamicsWorld::ParallelDynamicsWorld (btDispatcher *dispatcher,
+                                              btBroadphaseInterface *broadphase,
+                                              btConstraintSolver *solver,
+                                              btCollisionConfiguration *conf)
+  : btDiscreteDynamicsWorld(dispatcher, broadphase, solver, conf), numThreads(1)
+{
+}
+
+ParallelDynamicsWorld::~ParallelDynamicsWorld (void)
+{
+    for (size_t i=0 ; i<solvers.size() ; ++i) delete solvers[i];
+}
+
+void ParallelDynamicsWorld::setNumThreads (unsigned n)
+{
+    if (n < 1) n = 1;
+    #ifndef BT_NO_PROFILE
+    if (n > 1) {
+        CERR << "Bullet was compiled with its profiler, which is not thread safe, so physics "
+             << "will use only 1 thread.  Build with BT_NO_PROFILE to use more." << std::endl;
+        n = 1;
+    }
+    #endif
+    numThreads = n;
+    // With 1 thread, the usual solver is used.
+    size_t pool = n > 1 ? n : 0;
+    while (solvers.size() < pool) solvers.push_back(new btSequentialImpulseConstraintSolver());
+    while (solvers.size() > pool) {
+        delete solvers.back();
+        solvers.pop_back();
+    }
+}
+
+void ParallelDynamicsWorld::solveIsland (btSequentialImpulseConstraintSolver &solver,
+                                         const Island &island, const btContactSolverInfo &info)
+{
+    // Only matters with SOLVER_RANDMIZE_ORDER.
+    solver.setRandSeed(island.id);
+    // The debug drawer is not thread safe, and the stack allocator is not used by this solver.
+    solver.solveGroup(island.numBodies > 0 ? &islandBodies[island.bodiesBegin] : NULL,
+                      island.numBodies, island.manifolds, island.numManifolds,
+                      island.constraints, island.numConstraints, info, NULL, m_stackAlloc,
+                      m_dispatcher1);
+}
+
+void ParallelDynamicsWorld::solveConstraints (btContactSolverInfo &info)
+{
+    unsigned threads = std::min(numThreads, job_system_num_threads() + 1);
+    if (threads < 2) {
+        btDiscreteDynamicsWorld::solveConstraints(info);
+        return;
+    }
+    FRAME_PROFILER_ZONE("physics_solve_islands");
+
+    // Disabled constraints (e.g. broken ones) are left out, as btSimulationIslandManager does.
+    sortedConstraints.resize(0);
+    for (int i=0 ; i<m_constraints.size() ; ++i) {
+        if (m_constraints[i]->isEnabled()) sortedConstraints.push_back(m_constraints[i]);
+    }
+    sortedConstraints.quickSort(ConstraintIslandLess());
+
+    islands.clear();
+    kinematicIslands.clear();
+    islandBodies.resize(0);
+    IslandGatherer gatherer(*this, sortedConstraints.size() > 0 ? &sortedConstraints[0] : NULL,
+                            sortedConstraints.size());
+    m_islandManager->buildAndProcessIslands(m_dispatcher1, this, &gatherer);
+
+    // Biggest first, so the last ones to be picked up are quick.  Stable, so it is deterministic.
+    std::stable_sort(islands.begin(), islands.end(), [] (const Island &a, const Island &b) {
+        return island_size(a.numBodies, a.numManifolds, a.numConstraints)
+             > island_size(b.numBodies, b.numManifolds, b.numConstraints);
+    });
+
+    // Each thread takes the next island until there are none left.  A solver is used by only
+    // one thread at a time.
+    std::atomic<size_t> next(0);
+    auto work = [&] (unsigned solver) {
+        for (size_t i=next++ ; i<islands.size() ; i=next++)
+            solveIsland(*solvers[solver], islands[i], info);
+    };
+    JobGroup group("physics_solve_islands");
+    for (unsigned s=1 ; s<threads && s<islands.size() ; ++s) group.run([&work, s] { work(s); });
+    work(0);
+    group.wait();
+
+    for (size_t i=0 ; i<kinematicIslands.size() ; ++i)
+        solveIsland(*solvers[0], kinematicIslands[i], info);
+}
@@ -0,0 +1,85 @@
+/* Copyright (c) The Grit Game Engine authors 2016
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* A btDiscreteDynamicsWorld that solves its simulation islands in parallel, on the job system.
+ * Islands do not interact, so each is solved on its own, by one of a pool of constraint solvers.
+ * Each island's solver is seeded from the island, so the result does not depend on which thread
+ * solved it or in which order.  Islands touching a kinematic body are solved afterwards on the
+ * calling thread, as the solver may keep state in the body and several islands can share it.
+ *
+ * Bullet's own profiler (BT_PROFILE) is not thread safe, so if Bullet is compiled with it, the
+ * world behaves like a btDiscreteDynamicsWorld.
+ */
+
+#include <vector>
+
+#include <btBulletDynamicsCommon.h>
+
+#ifndef ParallelDynamicsWorld_h
+#define ParallelDynamicsWorld_h
+
+class ParallelDynamicsWorld : public btDiscreteDynamicsWorld {
+
+    public:
+
+    ParallelDynamicsWorld (btDispatcher *dispatcher, btBroadphaseInterface *broadphase,
+                           btConstraintSolver *solver, btCollisionConfiguration *conf);
+
+    ~ParallelDynamicsWorld (void);
+
+    /** Solve islands on up to this many threads at once (including the calling thread), if the
+     * job system has that many.  With 1, the given constraint solver is used as usual. */
+    void setNumThreads (unsigned n);
+
+    unsigned getNumThreads (void) const { return numThreads; }
+
+    protected:
+
+    void solveConstraints (btContactSolverInfo &info) override;
+
+    private:
+
+    struct Island {
+        int id;
+        int bodiesBegin, numBodies;  // In islandBodies.
+        btPersistentManifold **manifolds;
+        int numManifolds;
+        btTypedConstraint **constraints;
+        int numConstraints;
+        bool kinematic;
+    };
+
+    struct IslandGatherer;
+
+    void solveIsland (btSequentialImpulseConstraintSolver &solver, const Island &island,
+                      const btContactSolverInfo &info);
+
+    unsigned numThreads;
+    std::vector<btSequentialImpulseConstraintSolver*> solvers;
+
+    // Rebuilt every step, kept to avoid reallocating.
+    btAlignedObjectArray<btTypedConstraint*> sortedConstraints;
+    std::vector<Island> islands;
+    std::vector<Island> kinematicIslands;
+    btAlignedObjectArray<btCollisionObject*> islandBodies;
+};
+
+#endif
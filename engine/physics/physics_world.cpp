@@ -19,6 +19,10 @@
  * THE SOFTWARE.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <unordered_map>
+
 #include <BulletCollision/CollisionShapes/btTriangleShape.h>
 #include <BulletCollision/CollisionDispatch/btInternalEdgeUtility.h>
 
@@ -26,8 +30,14 @@
 #include "../main.h"
 #include <centralised_log.h>
 #include "../option.h"
+#include "../frame_arena.h"
+#include "../frame_profiler.h"
+#include "../job_system.h"
 #include "../grit_lua_util.h"
 
+#include "../gfx/gfx_fertile_node.h"
+
+#include "parallel_dynamics_world.h"
 #include "physics_world.h"
 #include "lua_wrappers_physics.h"
 
@@ -42,15 +52,111 @@ static DynamicsWorld *world;
 
 static btVector3 gravity; // cached in here in vector form
 
+// {{{ lists of bodies that need attention each step
+
+namespace {
+    // A dense list of bodies, where each body remembers its position so it can be removed in O(1).
+    class BodyList {
+        std::vector<RigidBody*> bodies;
+        int RigidBody::*index;
+        public:
+        BodyList (int RigidBody::*index) : index(index) { }
+        bool contains (const RigidBody *rb) const { return rb->*index >= 0; }
+        void add (RigidBody *rb)
+        {
+            if (contains(rb)) return;
+            rb->*index = bodies.size();
+            bodies.push_back(rb);
+        }
+        void remove (RigidBody *rb)
+        {
+            if (!contains(rb)) return;
+            RigidBody *last = bodies.back();
+            bodies[rb->*index] = last;
+            last->*index = rb->*index;
+            bodies.pop_back();
+            rb->*index = -1;
+        }
+        void clear (void)
+        {
+            for (size_t i=0 ; i<bodies.size() ; ++i) bodies[i]->*index = -1;
+            bodies.clear();
+        }
+        size_t size (void) const { return bodies.size(); }
+        RigidBody *operator[] (size_t i) const { return bodies[i]; }
+    };
+}
+
+// Bodies that may have moved, so need NaN checks and graphics updates.  Bodies are added when woken
+// and removed at the end of the step in which they stop moving.
+static BodyList awake_bodies(&RigidBody::awakeIndex);
+// Bodies that stopped moving (or got a new update callback) since the last graphics update.
+static BodyList settled_bodies(&RigidBody::settledIndex);
+// Bodies with callbacks.
+static BodyList step_bodies(&RigidBody::stepIndex);
+static BodyList stabilise_bodies(&RigidBody::stabiliseIndex);
+
+// Callbacks can add bodies to and remove them from the lists, and destroy them, so iterate over a
+// copy that holds a reference to each body.
+static void hold_bodies (const BodyList &list, FrameVector<RigidBody*> &held)
+{
+    for (size_t i=0 ; i<list.size() ; ++i) {
+        list[i]->incRefCount();
+        held.push_back(list[i]);
+    }
+}
+
+static void release_bodies (lua_State *L, FrameVector<RigidBody*> &held)
+{
+    for (size_t i=0 ; i<held.size() ; ++i) held[i]->decRefCount(L);
+}
+
+// Bullet wakes a sleeping body when a body in the same simulation island is awake (Grit has no
+// kinematic bodies, which would also wake what they touch).  So after a step, only the islands of
+// the awake bodies need to be looked at.  The island manager leaves its elements sorted by island.
+static void wake_touched_bodies (void)
+{
+    btUnionFind &islands = world->getSimulationIslandManager()->getUnionFind();
+    int num_elements = islands.getNumElements();
+    if (num_elements == 0) return;
+
+    FrameVector<int> tags;
+    for (size_t i=0 ; i<awake_bodies.size() ; ++i) {
+        int tag = awake_bodies[i]->getIslandTag();
+        if (tag >= 0) tags.push_back(tag);
+    }
+    std::sort(tags.begin(), tags.end());
+    tags.erase(std::unique(tags.begin(), tags.end()), tags.end());
+
+    btCollisionObjectArray &objects = world->getCollisionObjectArray();
+    for (size_t t=0 ; t<tags.size() ; ++t) {
+        // Binary search for the first element of the island.
+        int lo = 0, hi = num_elements;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (islands.getElement(mid).m_id < tags[t]) lo = mid + 1;
+            else hi = mid;
+        }
+        for (int i=lo ; i<num_elements && islands.getElement(i).m_id == tags[t] ; ++i) {
+            btRigidBody *brb = btRigidBody::upcast(objects[islands.getElement(i).m_sz]);
+            if (brb == NULL) continue;
+            RigidBody *rb = static_cast<RigidBody*>(brb->getMotionState());
+            if (!awake_bodies.contains(rb) && rb->moving()) awake_bodies.add(rb);
+        }
+    }
+}
+
+// }}}
+
 // {{{ get access to some protected members in btDiscreteDynamicsWorld
 
-class DynamicsWorld : public btDiscreteDynamicsWorld {
+class DynamicsWorld : public ParallelDynamicsWorld {
     public:
     DynamicsWorld (btCollisionDispatcher *colDisp,
                btBroadphaseInterface *broadphase,
                btConstraintSolver *conSolver,
                btCollisionConfiguration *colConf)
-          : btDiscreteDynamicsWorld(colDisp,broadphase,conSolver,colConf)
+          : ParallelDynamicsWorld(colDisp,broadphase,conSolver,colConf)
     { }
 
     // used to be protected
@@ -102,7 +208,8 @@ static PhysicsBoolOption option_keys_bool[] = {
 };
 
 static PhysicsIntOption option_keys_int[] = {
-    PHYSICS_SOLVER_ITERATIONS
+    PHYSICS_SOLVER_ITERATIONS,
+    PHYSICS_SOLVER_THREADS
 };
 
 static PhysicsFloatOption option_keys_float[] = {
@@ -175,6 +282,7 @@ std::string physics_option_to_string (PhysicsIntOption o)
 {
     switch (o) {
         case PHYSICS_SOLVER_ITERATIONS: return "SOLVER_ITERATIONS";
+        case PHYSICS_SOLVER_THREADS: return "SOLVER_THREADS";
     }
     return "UNKNOWN_INT_OPTION";
 }
@@ -234,6 +342,7 @@ void physics_option_from_string (const std::string &s,
     else if (s=="DEBUG_FAST_WIREFRAME") { t = 0 ; o0 = PHYSICS_DEBUG_FAST_WIREFRAME; }
 
     else if (s=="SOLVER_ITERATIONS") { t = 1 ; o1 = PHYSICS_SOLVER_ITERATIONS; }
+    else if (s=="SOLVER_THREADS") { t = 1 ; o1 = PHYSICS_SOLVER_THREADS; }
 
     else if (s=="GRAVITY_X") { t = 2 ; o2 = PHYSICS_GRAVITY_X; }
     else if (s=="GRAVITY_Y") { t = 2 ; o2 = PHYSICS_GRAVITY_Y; }
@@ -316,6 +425,9 @@ static void options_update (bool flush)
             case PHYSICS_SOLVER_ITERATIONS:
             world->getSolverInfo().m_numIterations = v_new;
             break;
+            case PHYSICS_SOLVER_THREADS:
+            world->setNumThreads(v_new);
+            break;
         }
     }
     for (unsigned i=0 ; i<sizeof(option_keys_float)/sizeof(*option_keys_float) ; ++i) {
@@ -378,6 +490,7 @@ static void options_update (bool flush)
             if (victim2==NULL) continue;
             victim2->applyForce(gravity / victim2->getInvMass(), btVector3(0,0,0));
             victim2->activate();
+            awake_bodies.add(static_cast<RigidBody*>(victim2->getMotionState()));
         }
 
     }
@@ -441,6 +554,7 @@ void physics_option_reset (void)
     physics_option(PHYSICS_DEBUG_FAST_WIREFRAME, false);
 
     physics_option(PHYSICS_SOLVER_ITERATIONS, 10);
+    physics_option(PHYSICS_SOLVER_THREADS, 1);
 
     physics_option(PHYSICS_GRAVITY_X, 0.0f);
     physics_option(PHYSICS_GRAVITY_Y, 0.0f);
@@ -464,6 +578,7 @@ static void init_options (void)
     }
 
     valid_option(PHYSICS_SOLVER_ITERATIONS, new ValidOptionRange<int>(0,1000));
+    valid_option(PHYSICS_SOLVER_THREADS, new ValidOptionRange<int>(1,64));
 
     valid_option(PHYSICS_GRAVITY_X, new ValidOptionRange<float>(-1000, 1000));
     valid_option(PHYSICS_GRAVITY_Y, new ValidOptionRange<float>(-1000, 1000));
@@ -842,55 +957,124 @@ extern ContactAddedCallback gContactAddedCallback;
 // }}}
 
 
-// C++ requires this to not be a local class
-namespace {
-    struct Info {
-        RigidBody *body, *other;
-        float life, imp, dist;
-        unsigned mat, matOther;
-        Vector3 pos, posOther, norm;
-    };
+bool RigidBody::hasNaN (void) const
+{
+    const btTransform &current_xform = body->getWorldTransform();
+    const btVector3 &pos = current_xform.getOrigin();
+    btQuaternion quat;
+    current_xform.getBasis().getRotation(quat);
+    return std::isnan(pos.x()) || std::isnan(pos.y()) || std::isnan(pos.z())
+        || std::isnan(quat.w()) || std::isnan(quat.x()) || std::isnan(quat.y())
+        || std::isnan(quat.z());
 }
 
-void physics_update (lua_State *L)
-{
-    float step_size = physics_option(PHYSICS_STEP_SIZE);
-    world->internalStepSimulation(step_size);
+namespace {
+    // All the contacts between two bodies, with the same pair of materials, in one step.
+    struct Collision {
+        RigidBody *a, *b;
+        int lifetime;
+        float impulse, totalImpulse;
+        int numPoints;
+        int matA, matB;
+        float distance;
+        Vector3 posA, posB, normalOnB;
+
+        void swap (void)
+        {
+            std::swap(a, b);
+            std::swap(matA, matB);
+            std::swap(posA, posB);
+            distance = -distance;
+            normalOnB = -normalOnB;
+        }
 
-    // NAN CHECKS
-    // check whether NaN has crept in anywhere
-    std::vector<RigidBody*> nan_bodies;
-    for (int i=0 ; i<world->getNumCollisionObjects() ; ++i) {
+        CollisionReport report (bool for_a) const
+        {
+            CollisionReport r;
+            r.other = for_a ? b : a;
+            r.lifetime = lifetime;
+            r.impulse = impulse;
+            r.totalImpulse = totalImpulse;
+            r.numPoints = numPoints;
+            r.mat = for_a ? matA : matB;
+            r.matOther = for_a ? matB : matA;
+            r.penetration = for_a ? -distance : distance;
+            r.pos = for_a ? posA : posB;
+            r.posOther = for_a ? posB : posA;
+            r.normal = for_a ? -normalOnB : normalOnB;
+            return r;
+        }
+    };
 
-        btCollisionObject* victim = world->getCollisionObjectArray()[i];
-        btRigidBody* victim2 = btRigidBody::upcast(victim);
-        if (victim2==NULL) continue;
-        RigidBody *rb = static_cast<RigidBody*>(victim2->getMotionState());
-
-        const btTransform &current_xform = victim2->getWorldTransform();
-        const btVector3 &pos = current_xform.getOrigin();
-        btQuaternion quat;
-        current_xform.getBasis().getRotation(quat);
-        float x=pos.x(), y=pos.y(), z=pos.z();
-        float qw=quat.w(), qx=quat.x(), qy=quat.y(), qz=quat.z();
-        if (std::isnan(x) || std::isnan(y) || std::isnan(z) ||
-            std::isnan(qw) || std::isnan(qx) || std::isnan(qy) || std::isnan(qz)) {
-            CERR << "NaN from physics engine position update." << std::endl;
-            nan_bodies.push_back(rb);
+    struct CollisionKey {
+        RigidBody *a, *b;
+        int matA, matB;
+        bool operator== (const CollisionKey &other) const
+        {
+            return a == other.a && b == other.b && matA == other.matA && matB == other.matB;
         }
+    };
+
+    struct CollisionKeyHash {
+        size_t operator() (const CollisionKey &k) const
+        {
+            std::hash<RigidBody*> h;
+            return ((h(k.a) * 31 + h(k.b)) * 31 + size_t(k.matA)) * 31 + size_t(k.matB);
+        }
+    };
+
+    // The order the callbacks are called in, which does not depend on where bodies are in memory.
+    bool collision_order (const Collision &x, const Collision &y)
+    {
+        if (x.a->id != y.a->id) return x.a->id < y.a->id;
+        if (x.b->id != y.b->id) return x.b->id < y.b->id;
+        if (x.matA != y.matA) return x.matA < y.matA;
+        return x.matB < y.matB;
     }
-    // chuck them out if they have misbehaved
-    for (unsigned int i=0 ; i<nan_bodies.size() ; ++i) {
-        nan_bodies[i]->destroy(L);
+}
+
+// Kept between steps so their memory is reused.
+static std::vector<Collision> collisions;
+static std::unordered_map<CollisionKey, size_t, CollisionKeyHash> collision_index;
+
+// If not nil, called once per step instead of the collision callbacks of the bodies.
+static LuaPtr collision_handler;
+// The table given to collision_handler, reused every step.
+static LuaPtr collision_batch;
+static int collision_batch_size = 0;
+
+void physics_set_collision_handler (lua_State *L)
+{
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        collision_handler.setNil(L);
+    } else {
+        collision_handler.set(L);
     }
+}
 
-    // COLLISION CALLBACKS
-    std::vector<Info> infos;
-    // first, check for collisions
+static bool wants_collision (RigidBody *rb, float impulse)
+{
+    return !rb->destroyed() && !rb->collisionCallbackPtr.isNil()
+           && impulse >= rb->collisionImpulseThreshold;
+}
+
+// Summarise the manifolds into one Collision per pair of bodies and materials, skipping pairs where
+// neither body has a collision callback.  The strongest point is reported, with the lifetime of
+// the youngest, so a new contact is still seen as one.
+static void gather_collisions (void)
+{
+    collisions.clear();
+    collision_index.clear();
     unsigned num_manifolds = world->getDispatcher()->getNumManifolds();
     for (unsigned i=0 ; i<num_manifolds; ++i) {
         btPersistentManifold* manifold =
             world->getDispatcher()->getManifoldByIndexInternal(i);
+        // each manifold has a number of points (usually 3?) that provide
+        // a stable foundation
+        unsigned num_contacts = manifold->getNumContacts();
+        if (num_contacts == 0) continue;
+
         btCollisionObject
             *ob_a = static_cast<btCollisionObject*>(manifold->getBody0()),
             *ob_b = static_cast<btCollisionObject*>(manifold->getBody1());
@@ -906,72 +1090,252 @@ void physics_update (lua_State *L)
         RigidBody *rb_a = static_cast<RigidBody*>(brb_a->getMotionState());
         RigidBody *rb_b = static_cast<RigidBody*>(brb_b->getMotionState());
 
-        // each manifold has a number of points (usually 3?) that provide
-        // a stable foundation
-        unsigned num_contacts = manifold->getNumContacts();
+        if (rb_a->collisionCallbackPtr.isNil() && rb_b->collisionCallbackPtr.isNil()) continue;
+
         for (unsigned j=0 ; j<num_contacts ; ++j) {
             btManifoldPoint &p = manifold->getContactPoint(j);
-            unsigned mat0 = p.m_partId0;
-            unsigned mat1 = p.m_partId1;
-            Info infoA = {
-                rb_a, rb_b, 
-                (float)p.getLifeTime(), p.getAppliedImpulse(), -p.getDistance(),
-                mat0, mat1, from_bullet(p.m_positionWorldOnA),
-                from_bullet(p.m_positionWorldOnB), -from_bullet(p.m_normalWorldOnB)
-            };
-            infos.push_back(infoA);
-            Info infoB = {
-                rb_b, rb_a, 
-                (float)p.getLifeTime(), p.getAppliedImpulse(), p.getDistance(),
-                mat1, mat0, from_bullet(p.m_positionWorldOnB),
-                from_bullet(p.m_positionWorldOnA), from_bullet(p.m_normalWorldOnB)
+            Collision c = {
+                rb_a, rb_b, p.getLifeTime(), p.getAppliedImpulse(), p.getAppliedImpulse(), 1,
+                p.m_partId0, p.m_partId1, p.getDistance(),
+                from_bullet(p.m_positionWorldOnA), from_bullet(p.m_positionWorldOnB),
+                from_bullet(p.m_normalWorldOnB)
             };
-            infos.push_back(infoB);
+            // A pair of bodies can have several manifolds (e.g. compounds), not always in the same
+            // order.
+            if (rb_b->id < rb_a->id) c.swap();
+
+            CollisionKey key = { c.a, c.b, c.matA, c.matB };
+            auto it = collision_index.find(key);
+            if (it == collision_index.end()) {
+                collision_index[key] = collisions.size();
+                collisions.push_back(c);
+                continue;
+            }
+            Collision &existing = collisions[it->second];
+            c.totalImpulse += existing.totalImpulse;
+            c.numPoints += existing.numPoints;
+            c.lifetime = std::min(c.lifetime, existing.lifetime);
+            if (c.impulse > existing.impulse) {
+                existing = c;
+            } else {
+                existing.totalImpulse = c.totalImpulse;
+                existing.numPoints = c.numPoints;
+                existing.lifetime = c.lifetime;
+            }
+        }
+    }
+    std::sort(collisions.begin(), collisions.end(), collision_order);
+}
+
+// Pushes the arguments of a collision callback, 11 values.
+static void push_collision_report (lua_State *L, const CollisionReport &r)
+{
+    lua_pushnumber(L, r.lifetime);
+    lua_pushnumber(L, r.impulse);
+    push_rbody(L, r.other);
+    lua_pushstring(L, phys_mats.getMaterial(r.mat)->name.c_str());
+    lua_pushstring(L, phys_mats.getMaterial(r.matOther)->name.c_str());
+    lua_pushnumber(L, r.penetration);
+    push_v3(L, r.pos);
+    push_v3(L, r.posOther);
+    push_v3(L, r.normal);
+    lua_pushnumber(L, r.totalImpulse);
+    lua_pushnumber(L, r.numPoints);
+}
+
+static const int COLLISION_BATCH_STRIDE = 12;
+
+// One call of collision_handler with a flat table: the body and then its 11 callback arguments,
+// for each report.  Bodies still opt in by having a collision callback, which the handler can call
+// itself.
+static void deliver_collision_batch (lua_State *L)
+{
+    STACK_BASE;
+
+    // to handle errors raised by the lua callback
+    push_cfunction(L, my_lua_error_handler);
+    int error_handler = lua_gettop(L);
+
+    collision_handler.push(L);
+    if (collision_batch.isNil()) {
+        lua_newtable(L);
+        collision_batch.set(L);
+    }
+    collision_batch.push(L);
+    int batch = lua_gettop(L);
+
+    int n = 0;
+    for (size_t i=0 ; i<collisions.size() ; ++i) {
+        const Collision &c = collisions[i];
+        for (int side=0 ; side<2 ; ++side) {
+            RigidBody *rb = side == 0 ? c.a : c.b;
+            if (!wants_collision(rb, c.impulse)) continue;
+            push_rbody(L, rb);
+            push_collision_report(L, c.report(side == 0));
+            for (int k=COLLISION_BATCH_STRIDE ; k>0 ; --k)
+                lua_rawseti(L, batch, n * COLLISION_BATCH_STRIDE + k);
+            n++;
         }
     }
-    for (unsigned i=0 ; i<infos.size(); ++i) {
-        Info &info = infos[i];
-        if (info.body->destroyed()) continue;
-        info.body->collisionCallback(L, info.life, info.imp, info.other,
-                                        info.mat, info.matOther,
-                                        info.dist, info.pos, info.posOther, info.norm);
+    // Clear whatever was left over from a busier step.
+    for (int k=n*COLLISION_BATCH_STRIDE ; k<collision_batch_size*COLLISION_BATCH_STRIDE ; ++k) {
+        lua_pushnil(L);
+        lua_rawseti(L, batch, k + 1);
+    }
+    collision_batch_size = n;
+
+    if (n == 0) {
+        lua_pop(L, 3); // batch, handler, error handler
+        STACK_CHECK;
+        return;
+    }
+
+    lua_pushnumber(L, n);
+    int status = lua_pcall(L, 2, 0, error_handler);
+    if (status) {
+        lua_pop(L,1);
+        collision_handler.setNil(L);
+    }
+
+    lua_pop(L,1); // error handler
+
+    STACK_CHECK;
+}
+
+static void deliver_collision_callbacks (lua_State *L)
+{
+    // to handle errors raised by the lua callbacks
+    push_cfunction(L, my_lua_error_handler);
+    int error_handler = lua_gettop(L);
+
+    for (size_t i=0 ; i<collisions.size() ; ++i) {
+        const Collision &c = collisions[i];
+        if (wants_collision(c.a, c.impulse))
+            c.a->collisionCallback(L, error_handler, c.report(true));
+        if (wants_collision(c.b, c.impulse))
+            c.b->collisionCallback(L, error_handler, c.report(false));
+    }
+
+    lua_pop(L,1); // error handler
+}
+
+static void deliver_collisions (lua_State *L)
+{
+    if (collisions.empty()) return;
+    // Callbacks can destroy bodies, and a body is deleted once nothing refers to it.
+    for (size_t i=0 ; i<collisions.size() ; ++i) {
+        collisions[i].a->incRefCount();
+        collisions[i].b->incRefCount();
+    }
+    if (collision_handler.isNil()) {
+        deliver_collision_callbacks(L);
+    } else {
+        deliver_collision_batch(L);
+    }
+    for (size_t i=0 ; i<collisions.size() ; ++i) {
+        collisions[i].a->decRefCount(L);
+        collisions[i].b->decRefCount(L);
+    }
+}
+
+void physics_update (lua_State *L)
+{
+    FRAME_PROFILER_ZONE("physics_update");
+    float step_size = physics_option(PHYSICS_STEP_SIZE);
+    world->internalStepSimulation(step_size);
+
+    wake_touched_bodies();
+
+    // NAN CHECKS
+    // check whether NaN has crept in anywhere.  It hardly ever has, so scan in parallel and
+    // only look for the culprits if there are any.  Only bodies that moved can have changed.
+    std::atomic<bool> any_nan(false);
+    parallel_for(0, awake_bodies.size(), 1024, [&] (size_t begin, size_t end) {
+        for (size_t i=begin ; i<end ; ++i) {
+            if (awake_bodies[i]->hasNaN()) {
+                any_nan = true;
+                return;
+            }
+        }
+    }, "physics_nan_check");
+    FrameVector<RigidBody*> nan_bodies;
+    for (size_t i=0 ; any_nan && i<awake_bodies.size() ; ++i) {
+        if (!awake_bodies[i]->hasNaN()) continue;
+        CERR << "NaN from physics engine position update." << std::endl;
+        nan_bodies.push_back(awake_bodies[i]);
+    }
+    // chuck them out if they have misbehaved
+    for (unsigned int i=0 ; i<nan_bodies.size() ; ++i) {
+        nan_bodies[i]->destroy(L);
+    }
+
+    // COLLISION CALLBACKS
+    gather_collisions();
+    deliver_collisions(L);
+
+    // STATIC BODIES
+    for (size_t i=0 ; i<awake_bodies.size() ; ++i) {
+        awake_bodies[i]->integrateStatic(step_size);
     }
 
     // STEP CALLBACKS
-    for (int i=0 ; i<world->getNumCollisionObjects() ; ++i) {
-        btCollisionObject* victim = world->getCollisionObjectArray()[i];
-        btRigidBody* victim2 = btRigidBody::upcast(victim);
-        if (victim2==NULL) continue;
-        RigidBody *rb = static_cast<RigidBody*>(victim2->getMotionState());
-        rb->stepCallback(L, step_size);
+    FrameVector<RigidBody*> held;
+    hold_bodies(step_bodies, held);
+    for (size_t i=0 ; i<held.size() ; ++i) {
+        if (held[i]->destroyed()) continue;
+        held[i]->stepCallback(L, step_size);
     }
+    release_bodies(L, held);
 
     // STABILISE CALLBACKS
-    for (int i=0 ; i<world->getNumCollisionObjects() ; ++i) {
-
-        btCollisionObject* victim = world->getCollisionObjectArray()[i];
-        btRigidBody* victim2 = btRigidBody::upcast(victim);
-        if (victim2==NULL) continue;
-        RigidBody *rb = static_cast<RigidBody*>(victim2->getMotionState());
-        rb->stabiliseCallback(L, step_size);
+    held.clear();
+    hold_bodies(stabilise_bodies, held);
+    for (size_t i=0 ; i<held.size() ; ++i) {
+        if (held[i]->destroyed()) continue;
+        held[i]->stabiliseCallback(L, step_size);
+    }
+    release_bodies(L, held);
+
+    // Bodies that have stopped get one more graphics update, then are left alone until woken.
+    for (size_t i=awake_bodies.size() ; i-- > 0 ; ) {
+        RigidBody *rb = awake_bodies[i];
+        if (rb->moving()) continue;
+        awake_bodies.remove(rb);
+        settled_bodies.add(rb);
     }
 }
 
 void physics_update_graphics (lua_State *L, float extrapolate)
 {
+    FRAME_PROFILER_ZONE("physics_update_graphics");
+
+    // Graphics nodes are moved directly, only the bodies with Lua callbacks are kept for later.
+    FrameVector<RigidBody*> held;
+    auto update = [&] (RigidBody *rb) {
+        rb->updateGfxNode(extrapolate);
+        if (rb->updateCallbackPtr.isNil()) return;
+        rb->incRefCount();
+        held.push_back(rb);
+    };
+    for (size_t i=0 ; i<awake_bodies.size() ; ++i) {
+        update(awake_bodies[i]);
+    }
+    for (size_t i=0 ; i<settled_bodies.size() ; ++i) {
+        if (!awake_bodies.contains(settled_bodies[i])) update(settled_bodies[i]);
+    }
+    settled_bodies.clear();
+
     // to handle errors raised by the lua callback
     push_cfunction(L, my_lua_error_handler);
 
-    // call all the graphic update callbacks
-    for (int i=0 ; i<world->getNumCollisionObjects() ; ++i) {
-        btCollisionObject* victim = world->getCollisionObjectArray()[i];
-        btRigidBody* victim2 = btRigidBody::upcast(victim);
-        if (victim2==NULL) continue;
-        RigidBody *rb = static_cast<RigidBody*>(victim2->getMotionState());
-        rb->updateGraphicsCallback(L, extrapolate);
+    for (size_t i=0 ; i<held.size() ; ++i) {
+        if (held[i]->destroyed()) continue;
+        held[i]->updateGraphicsCallback(L, extrapolate);
     }
 
     lua_pop(L,1); // error handler
+
+    release_bodies(L, held);
 }
 
 class BulletRayCallback : public btCollisionWorld::RayResultCallback {
@@ -1211,10 +1575,14 @@ void physics_draw (void)
 
 // {{{ RigidBody
 
+static uint64_t next_body_id = 0;
+
 RigidBody::RigidBody (const std::string &col_mesh,
                       const Vector3 &pos,
                       const Quaternion &quat)
-      : lastXform(to_bullet(quat),to_bullet(pos)), refCount(0)
+      : lastXform(to_bullet(quat),to_bullet(pos)),
+        gfxNodeOffset(0,0,0), gfxNodeOffsetOrientation(1,0,0,0), collisionImpulseThreshold(0),
+        id(next_body_id++), awakeIndex(-1), settledIndex(-1), stepIndex(-1), stabiliseIndex(-1), refCount(0)
 {
     DiskResource *dr = disk_resource_get_or_make(col_mesh);
     colMesh = dynamic_cast<CollisionMesh*>(dr);
@@ -1283,6 +1651,8 @@ void RigidBody::addToWorld (void)
 void RigidBody::removeFromWorld (void)
 {
     lastXform = body->getCenterOfMassTransform();
+    awake_bodies.remove(this);
+    settled_bodies.remove(this);
     world->removeRigidBody(body);
     delete body;
     delete shape;
@@ -1294,6 +1664,9 @@ void RigidBody::destroy (lua_State *L)
     colMesh->unregisterReloadWatcher(this);
     if (body==NULL) return;
     removeFromWorld();
+    step_bodies.remove(this);
+    stabilise_bodies.remove(this);
+    gfxNode = GfxNodePtr(NULL);
     stepCallbackPtr.setNil(L);
     updateCallbackPtr.setNil(L);
     collisionCallbackPtr.setNil(L);
@@ -1335,10 +1708,8 @@ void RigidBody::setWorldTransform (const btTransform& )
 {
 }
 
-void RigidBody::updateGraphicsCallback (lua_State *L, float extrapolate)
+void RigidBody::getGraphicsTransform (float extrapolate, Vector3 &pos, Quaternion &quat) const
 {
-    if (updateCallbackPtr.isNil()) return;
-
     btTransform current_xform;
 
     btTransformUtil::integrateTransform(
@@ -1348,24 +1719,65 @@ void RigidBody::updateGraphicsCallback (lua_State *L, float extrapolate)
         extrapolate*body->getHitFraction(),
         current_xform);
 
+    pos = from_bullet(check_nan(current_xform.getOrigin()));
+    btQuaternion q;
+    current_xform.getBasis().getRotation(q);
+    quat = from_bullet(check_nan(q));
+}
+
+void RigidBody::updateGfxNode (float extrapolate)
+{
+    if (gfxNode.isNull()) return;
+    if (gfxNode->destroyed()) {
+        gfxNode = GfxNodePtr(NULL);
+        return;
+    }
+    Vector3 pos;
+    Quaternion quat;
+    getGraphicsTransform(extrapolate, pos, quat);
+    gfxNode->setLocalPosition(pos + quat * gfxNodeOffset);
+    gfxNode->setLocalOrientation(quat * gfxNodeOffsetOrientation);
+}
+
+void RigidBody::setGfxNode (const GfxNodePtr &node)
+{
+    gfxNode = node;
+    // So it is moved at least once, even if the body is asleep.
+    if (!destroyed() && !gfxNode.isNull()) settled_bodies.add(this);
+}
+
+void RigidBody::setGfxNodeOffset (const Vector3 &v)
+{
+    gfxNodeOffset = v;
+    if (!destroyed() && !gfxNode.isNull()) settled_bodies.add(this);
+}
+
+void RigidBody::setGfxNodeOffsetOrientation (const Quaternion &q)
+{
+    gfxNodeOffsetOrientation = q;
+    if (!destroyed() && !gfxNode.isNull()) settled_bodies.add(this);
+}
+
+void RigidBody::updateGraphicsCallback (lua_State *L, float extrapolate)
+{
+    if (updateCallbackPtr.isNil()) return;
 
     STACK_BASE;
 
     // args
-    const btVector3 &pos = check_nan(current_xform.getOrigin());
-    btQuaternion quat;
-    current_xform.getBasis().getRotation(quat);
-    quat = check_nan(quat);
+    Vector3 pos;
+    Quaternion quat;
+    getGraphicsTransform(extrapolate, pos, quat);
 
     int error_handler = lua_gettop(L);
 
     // get callback
     updateCallbackPtr.push(L);
 
-    push_v3(L,from_bullet(pos)); // arg 1
-    push_quat(L,from_bullet(quat)); // arg 1
+    push_v3(L,pos); // arg 1
+    push_quat(L,quat); // arg 2
 
-    // call callback (7 args, no return values)
+    // call callback (2 args, no return values)
     int status = lua_pcall(L,2,0,error_handler);
     if (status) {
         // pop the error message since the error handler will
@@ -1377,17 +1789,55 @@ void RigidBody::updateGraphicsCallback (lua_State *L, float extrapolate)
     STACK_CHECK;
 }
 
+int RigidBody::getIslandTag (void) const
+{
+    if (body==NULL) return -1;
+    return body->getIslandTag();
+}
+
+bool RigidBody::moving (void) const
+{
+    if (body==NULL) return false;
+    if (body->getInvMass()!=0) return body->isActive();
+    return body->getLinearVelocity().length2() != 0
+        || body->getInterpolationAngularVelocity().length2() != 0;
+}
+
+void RigidBody::integrateStatic (float step_size)
+{
+    if (body->getInvMass()!=0) return;
+    btTransform after;
+    btTransformUtil::integrateTransform(body->getCenterOfMassTransform(),
+                        body->getLinearVelocity(),
+                        body->getInterpolationAngularVelocity(),
+                        step_size,
+                        after);
+    body->proceedToTransform(after);
+}
+
+void RigidBody::setUpdateCallback (lua_State *L)
+{
+    updateCallbackPtr.set(L);
+    // So it is called at least once, even if the body is asleep.
+    if (!destroyed() && !updateCallbackPtr.isNil()) settled_bodies.add(this);
+}
+
+void RigidBody::setStepCallback (lua_State *L)
+{
+    stepCallbackPtr.set(L);
+    if (!destroyed() && !stepCallbackPtr.isNil()) step_bodies.add(this);
+    else step_bodies.remove(this);
+}
+
+void RigidBody::setStabiliseCallback (lua_State *L)
+{
+    stabiliseCallbackPtr.set(L);
+    if (!destroyed() && !stabiliseCallbackPtr.isNil()) stabilise_bodies.add(this);
+    else stabilise_bodies.remove(this);
+}
+
 void RigidBody::stepCallback (lua_State *L, float step_size)
 {
-    if (body->getInvMass()==0) {
-        btTransform after;
-        btTransformUtil::integrateTransform(body->getCenterOfMassTransform(),
-                            body->getLinearVelocity(),
-                            body->getInterpolationAngularVelocity(),
-                            step_size,
-                            after);
-        body->proceedToTransform(after);
-    }
     if (stepCallbackPtr.isNil()) return;
 
     STACK_BASE;
@@ -1405,6 +1855,7 @@ void RigidBody::stepCallback (lua_State *L, float step_size)
     if (status) {
         lua_pop(L,1);
         stepCallbackPtr.setNil(L);
+        step_bodies.remove(this);
     }
 
     lua_pop(L,1); // error handler
@@ -1412,39 +1863,21 @@ void RigidBody::stepCallback (lua_State *L, float step_size)
     STACK_CHECK;
 }
 
-void RigidBody::collisionCallback (lua_State *L, int lifetime, float impulse,
-                                   RigidBody *other, int m, int m2,
-                                   float penetration, const Vector3 &pos, const Vector3 &pos2,
-                                   const Vector3 &wnormal)
+void RigidBody::collisionCallback (lua_State *L, int error_handler, const CollisionReport &r)
 {
     if (collisionCallbackPtr.isNil()) return;
 
     STACK_BASE;
 
-    // to handle errors raised by the lua callback
-    push_cfunction(L, my_lua_error_handler);
-    int error_handler = lua_gettop(L);
-
     // get callback
     collisionCallbackPtr.push(L);
-
-    lua_pushnumber(L,lifetime);
-    lua_pushnumber(L,impulse);
-    push_rbody(L,other);
-    lua_pushstring(L,phys_mats.getMaterial(m)->name.c_str());
-    lua_pushstring(L,phys_mats.getMaterial(m2)->name.c_str());
-    lua_pushnumber(L,penetration);
-    push_v3(L,pos);
-    push_v3(L,pos2);
-    push_v3(L,wnormal);
-    int status = lua_pcall(L,9,0,error_handler);
+    push_collision_report(L, r);
+    int status = lua_pcall(L,11,0,error_handler);
     if (status) {
         lua_pop(L,1);
         collisionCallbackPtr.setNil(L);
     }
 
-    lua_pop(L,1); // error handler
-
     STACK_CHECK;
 }
 
@@ -1468,6 +1901,7 @@ void RigidBody::stabiliseCallback (lua_State *L, float elapsed)
     if (status) {
         lua_pop(L,1);
         stabiliseCallbackPtr.setNil(L);
+        stabilise_bodies.remove(this);
     }
 
     lua_pop(L,1); // error handler
@@ -1481,7 +1915,7 @@ void RigidBody::force (const Vector3 &force)
         GRIT_EXCEPT("RigidBody::force received NaN element in force vector");
     if (body==NULL) return;
     body->applyCentralImpulse(to_bullet(force*physics_option(PHYSICS_STEP_SIZE)));
-    body->activate();
+    activate();
 }
 
 void RigidBody::force (const Vector3 &force,
@@ -1494,7 +1928,7 @@ void RigidBody::force (const Vector3 &force,
     if (body==NULL) return;
     body->applyImpulse(to_bullet(force*physics_option(PHYSICS_STEP_SIZE)),
                to_bullet(rel_pos));
-    body->activate();
+    activate();
 }
 
 void RigidBody::impulse (const Vector3 &impulse)
@@ -1503,7 +1937,7 @@ void RigidBody::impulse (const Vector3 &impulse)
         GRIT_EXCEPT("RigidBody::impulse received NaN element in impulse vector");
     if (body==NULL) return;
     body->applyCentralImpulse(to_bullet(impulse));
-    body->activate();
+    activate();
 }
 
 void RigidBody::impulse (const Vector3 &impulse,
@@ -1515,7 +1949,7 @@ void RigidBody::impulse (const Vector3 &impulse,
         GRIT_EXCEPT("RigidBody::impulse received NaN element in position vector");
     if (body==NULL) return;
     body->applyImpulse(to_bullet(impulse),to_bullet(rel_pos));
-    body->activate();
+    activate();
 }
 
 void RigidBody::torque (const Vector3 &torque)
@@ -1524,7 +1958,7 @@ void RigidBody::torque (const Vector3 &torque)
         GRIT_EXCEPT("RigidBody::torque received NaN element in torque vector");
     if (body==NULL) return;
     body->applyTorqueImpulse(to_bullet(torque*physics_option(PHYSICS_STEP_SIZE)));
-    body->activate();
+    activate();
 }
 
 void RigidBody::torqueImpulse (const Vector3 &torque)
@@ -1533,7 +1967,7 @@ void RigidBody::torqueImpulse (const Vector3 &torque)
         GRIT_EXCEPT("RigidBody::torque received NaN element in torque vector");
     if (body==NULL) return;
     body->applyTorqueImpulse(to_bullet(torque));
-    body->activate();
+    activate();
 }
 
 float RigidBody::getContactProcessingThreshold (void) const
@@ -1602,6 +2036,7 @@ void RigidBody::activate (void)
 {
     if (body==NULL) return;
     body->activate();
+    awake_bodies.add(this);
 }
 
 void RigidBody::deactivate (void)
@@ -1619,7 +2054,7 @@ void RigidBody::setLinearVelocity (const Vector3 &v)
 {
     if (body==NULL) return;
     body->setLinearVelocity(to_bullet(v));
-    body->activate();
+    activate();
 }
 
 Vector3 RigidBody::getAngularVelocity (void) const
@@ -1638,7 +2073,7 @@ void RigidBody::setAngularVelocity (const Vector3 &v)
 {
     if (body==NULL) return;
     body->setAngularVelocity(to_bullet(v));
-    body->activate();
+    activate();
 }
 
 static inline float invert0 (float v)
@@ -1773,7 +2208,7 @@ void RigidBody::setPosition (const Vector3 &v)
     body->setCenterOfMassTransform(
         btTransform(body->getOrientation(), to_bullet(v)));
     world->updateSingleAabb(body);
-    body->activate();
+    activate();
 }
 
 void RigidBody::setOrientation (const Quaternion &q)
@@ -1782,7 +2217,7 @@ void RigidBody::setOrientation (const Quaternion &q)
     body->setCenterOfMassTransform(
          btTransform(to_bullet(q),body->getCenterOfMassPosition()));
     world->updateSingleAabb(body);
-    body->activate();
+    activate();
 }
 
 
@@ -1794,7 +2229,7 @@ void RigidBody::updateCollisionFlags (void)
       | (ghost ? btCollisionObject::CF_NO_CONTACT_RESPONSE : 0)
       | (mass == 0 ? btCollisionObject::CF_STATIC_OBJECT : 0)
     );
-    body->activate();
+    activate();
 }
 
 // }}}
@@ -1841,3 +2276,10 @@ void physics_shutdown (void)
     delete col_disp;
     delete col_conf;
 }
+
+void physics_shutdown_lua (lua_State *L)
+{
+    collision_handler.setNil(L);
+    collision_batch.setNil(L);
+    collision_batch_size = 0;
+}
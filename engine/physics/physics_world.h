@@ -19,6 +19,7 @@
  * THE SOFTWARE.
  */
 
+#include <cstdint>
 #include <map>
 
 #include <centralised_log.h>
@@ -64,7 +65,10 @@ enum PhysicsBoolOption {
 };
 
 enum PhysicsIntOption {
-    PHYSICS_SOLVER_ITERATIONS
+    PHYSICS_SOLVER_ITERATIONS,
+    /** Simulation islands are solved in parallel on up to this many threads (the job system's
+     * workers and the main thread).  The result is the same for any number above 1. */
+    PHYSICS_SOLVER_THREADS
 };
 
 enum PhysicsFloatOption {
@@ -120,6 +124,11 @@ extern "C" {
 
 #include "../lua_ptr.h"
 
+#include "../intrusive_ptr.h"
+
+class GfxFertileNode;
+typedef IntrusivePtr<GfxFertileNode> GfxNodePtr;
+
 #include "physical_material.h"
 
 
@@ -128,6 +137,27 @@ class DynamicsWorld;
 
 void physics_update (lua_State *L);
 
+/** Contacts between a pair of bodies during one physics step, summarised from the point of view
+ * of one of them.  The point of contact, materials, and penetration are those of the contact point
+ * with the strongest impulse. */
+/** The contacts between a body and another, with the same pair of materials, in one step.  The
+ * position, normal, penetration and impulse are those of the strongest contact point. */
+struct CollisionReport {
+    RigidBody *other;
+    int lifetime;  // Of the youngest contact point, so a new contact is reported as one.
+    float impulse;
+    float totalImpulse;  // Sum over all the contact points.
+    int numPoints;
+    int mat, matOther;
+    float penetration;
+    Vector3 pos, posOther, normal;
+};
+
+/** Instead of calling the collision callback of each body, call the Lua function at the top of the
+ * stack once per step with all the collisions of that step.  Pops the stack.  If it is nil, go
+ * back to calling the callbacks of the bodies. */
+void physics_set_collision_handler (lua_State *L);
+
 // to be extended by lua wrapper or whatever
 class SweepCallback {
     public:
@@ -202,14 +232,42 @@ class RigidBody : public btMotionState, public CollisionMesh::ReloadWatcher {
 
     void setOrientation (const Quaternion &q);
 
+    /** Whether the body can move in the next step: it is dynamic and awake, or it is static but
+     * has a velocity. */
+    bool moving (void) const;
+
+    /** The Bullet simulation island the body was in during the last step, -1 if it is static or
+     * destroyed. */
+    int getIslandTag (void) const;
+
+    /** Whether NaN has crept into the position or orientation.  Safe to call from jobs. */
+    bool hasNaN (void) const;
+
+    /** Move a static body by its velocity, as Bullet does not. */
+    void integrateStatic (float step_size);
+
+    // These pop the callback (or nil) from the stack.
+    void setUpdateCallback (lua_State *L);
+    void setStepCallback (lua_State *L);
+    void setStabiliseCallback (lua_State *L);
+
     void stepCallback (lua_State *L, float step_size);
-    void collisionCallback (lua_State *L, int lifetime, float impulse,
-                RigidBody *other,
-                int m, int m2, float penetration,
-                const Vector3 &pos, const Vector3 &pos2, const Vector3 &wnormal);
+    void collisionCallback (lua_State *L, int error_handler, const CollisionReport &r);
     void stabiliseCallback (lua_State *L, float elapsed);
     void updateGraphicsCallback (lua_State *L, float extrapolate);
 
+    /** Move the graphics node (if any) to where the body is. */
+    void updateGfxNode (float extrapolate);
+
+    /** A graphics node that follows the body without involving Lua, or null.  The node should not
+     * have a parent.  The offset is in the body's coordinate frame. */
+    const GfxNodePtr &getGfxNode (void) const { return gfxNode; }
+    void setGfxNode (const GfxNodePtr &node);
+    const Vector3 &getGfxNodeOffset (void) const { return gfxNodeOffset; }
+    void setGfxNodeOffset (const Vector3 &v);
+    const Quaternion &getGfxNodeOffsetOrientation (void) const { return gfxNodeOffsetOrientation; }
+    void setGfxNodeOffsetOrientation (const Quaternion &q);
+
     void activate (void);
     void deactivate (void);
 
@@ -289,12 +347,28 @@ class RigidBody : public btMotionState, public CollisionMesh::ReloadWatcher {
 
     btTransform lastXform;
 
+    GfxNodePtr gfxNode;
+    Vector3 gfxNodeOffset;
+    Quaternion gfxNodeOffsetOrientation;
+
+    // Where the graphics should be, extrapolated from the last step.
+    void getGraphicsTransform (float extrapolate, Vector3 &pos, Quaternion &quat) const;
+
     public:
     LuaPtr updateCallbackPtr;
     LuaPtr stepCallbackPtr;
     LuaPtr collisionCallbackPtr;
     LuaPtr stabiliseCallbackPtr;
 
+    // Collisions with a weaker impulse than this are not reported to this body.
+    float collisionImpulseThreshold;
+
+    // Unique, in order of creation, so collision callbacks are called in the same order each run.
+    const uint64_t id;
+
+    // Positions in the world's lists of bodies (-1 if not present), only for use by those lists.
+    int awakeIndex, settledIndex, stepIndex, stabiliseIndex;
+
     protected:
     btRigidBody *body;
     btCompoundShape *shape;
@@ -313,4 +387,7 @@ class RigidBody : public btMotionState, public CollisionMesh::ReloadWatcher {
 void physics_init (void);
 void physics_shutdown (void);
 
+/** Release everything physics holds on the Lua heap.  Call before closing Lua. */
+void physics_shutdown_lua (lua_State *L);
+
 #endif
@@ -19,8 +19,12 @@
  * THE SOFTWARE.
  */
 
-#include "cache_friendly_range_space_simd.h"
+#include <sleep.h>
+
+#include "cache_friendly_range_space.h"
 #include "core_option.h"
+#include "frame_arena.h"
+#include "frame_profiler.h"
 #include "grit_class.h"
 #include "main.h"
 #include "streamer.h"
@@ -29,37 +33,197 @@ float streamer_visibility;
 float streamer_prepare_distance_factor;
 float streamer_fade_out_factor;
 float streamer_fade_overlap_factor;
+float streamer_lookahead_distance;
 
-typedef CacheFriendlyRangeSpace<GritObjectPtr> Space;
+typedef LooseGridRangeSpace<GritObjectPtr> Space;
 static Space rs;
 
-static GObjPtrs activated;
+/** The activated objects.  Each object remembers its index (GritObject::getActivatedIndex) so
+ * adding and removing are O(1).  The spheres are packed alongside, so the range test for
+ * deactivation is a single pass over contiguous floats.
+ */
+class ActivatedObjects {
+
+    GObjPtrs objs;
+    std::vector<float> xs, ys, zs, ds;
+    /** Output of the range test. */
+    std::vector<float> range2s;
+
+    public:
+
+    size_t size (void) const { return objs.size(); }
+
+    const GritObjectPtr &get (size_t i) const { return objs[i]; }
+
+    float getRange2 (size_t i) const { return range2s[i]; }
+
+    GObjPtrs &getObjects (void) { return objs; }
+
+    void add (const GritObjectPtr &o)
+    {
+        if (o->getActivatedIndex() != -1) return;
+        o->updateActivatedIndex(objs.size());
+        objs.push_back(o);
+        Vector3 pos = o->getPos();
+        xs.push_back(pos.x);
+        ys.push_back(pos.y);
+        zs.push_back(pos.z);
+        ds.push_back(o->getR());
+        range2s.push_back(0);
+    }
+
+    void remove (const GritObjectPtr &o_)
+    {
+        // o_ may be a reference into objs
+        GritObjectPtr o = o_;
+        int index = o->getActivatedIndex();
+        if (index == -1) return;
+        size_t last = objs.size() - 1;
+        objs[index] = objs[last];
+        objs[index]->updateActivatedIndex(index);
+        xs[index] = xs[last];
+        ys[index] = ys[last];
+        zs[index] = zs[last];
+        ds[index] = ds[last];
+        range2s[index] = range2s[last];
+        objs.pop_back();
+        xs.pop_back();
+        ys.pop_back();
+        zs.pop_back();
+        ds.pop_back();
+        range2s.pop_back();
+        o->updateActivatedIndex(-1);
+    }
+
+    void updateSphere (int index, const Vector3 &pos, float d)
+    {
+        xs[index] = pos.x;
+        ys[index] = pos.y;
+        zs[index] = pos.z;
+        ds[index] = d;
+    }
+
+    /** Same as GritObject::range2 (divided by vis2) for every object. */
+    void computeRange2 (const Vector3 &cam_pos, float vis2)
+    {
+        const size_t sz = objs.size();
+        const float *x = xs.data(), *y = ys.data(), *z = zs.data(), *d = ds.data();
+        float *out = range2s.data();
+        for (size_t i=0 ; i<sz ; ++i) {
+            float dx = cam_pos.x - x[i];
+            float dy = cam_pos.y - y[i];
+            float dz = cam_pos.z - z[i];
+            out[i] = (dx*dx + dy*dy + dz*dz) / (d[i]*d[i]) / vis2;
+        }
+    }
+};
+
+static ActivatedObjects activated;
 static GObjPtrs loaded;
 static GObjPtrs fresh; // just been added - skip the queue for activation
+static GObjPtrs prefetched; // not in range yet, but loading because we are heading that way
+
+/** How many seconds ahead to predict the player's path, before CORE_LOOKAHEAD_DISTANCE caps it. */
+static const float LOOKAHEAD_TIME = 5;
+
+/** Faster than this (metres per second) is assumed to be a teleport, not movement. */
+static const float TELEPORT_SPEED = 2000;
 
 typedef std::vector<StreamerCallback*> StreamerCallbacks;
 StreamerCallbacks streamer_callbacks;
 
-static void remove_if_exists (GObjPtrs &list, const GritObjectPtr &o)
+void streamer_init (void)
 {
-    GObjPtrs::iterator iter = find(list.begin(), list.end(), o);
-    if (iter!=list.end()) {
-        size_t offset = iter - list.begin();
-        list[offset] = list[list.size()-1];
-        list.pop_back();
-    }
 }
 
-void streamer_init (void)
+
+void streamer_centre (lua_State *L, const Vector3 &new_pos, bool everything)
 {
+    static Vector3 last_pos(0, 0, 0);
+    static unsigned long long last_micros = 0;
+    static Vector3 velocity(0, 0, 0);
+
+    unsigned long long now = micros();
+    if (last_micros != 0 && now > last_micros) {
+        float elapsed = (now - last_micros) / 1E6f;
+        Vector3 v = (new_pos - last_pos) * (1 / elapsed);
+        if (v.length() > TELEPORT_SPEED) {
+            velocity = Vector3(0, 0, 0);
+        } else {
+            // Smooth over a few frames, positions are often updated unevenly.
+            velocity = velocity * 0.8f + v * 0.2f;
+        }
+    }
+    last_pos = new_pos;
+    last_micros = now;
+
+    streamer_centre(L, new_pos, velocity, everything);
 }
 
+/** Cancel the prefetch of objects that we no-longer expect to need, and hand over those that
+ * are now in range to the normal loading mechanism.  Then start prefetching objects near the
+ * segment from new_pos to lookahead.  The objects of interest are those that will come into
+ * range, so the spheres are scaled by tpF just as for normal loading.
+ */
+static void prefetch (const Vector3 &new_pos, const Vector3 &lookahead, float tpF)
+{
+    FrameVector<GritObjectPtr> ahead;
+    if ((lookahead - new_pos).length2() > 0) {
+        rs.getPresentAlong(new_pos.x, new_pos.y, new_pos.z,
+                           lookahead.x, lookahead.y, lookahead.z, tpF, ahead);
+    }
+    for (size_t i=0 ; i<ahead.size() ; ++i) {
+        const GritObjectPtr &o = ahead[i];
+        if (o->getClass() == NULL) continue;
+        if (o->isActivated()) continue;
+        if (o->isPrefetching()) {
+            o->requestPrefetch(new_pos);  // update priority
+            continue;
+        }
+        // These are dealt with by the normal mechanism.
+        if (o->withinRange(new_pos, tpF)) continue;
+        if (o->backgroundLoadingCausedError()) continue;
+        // If it is loaded or loading already, it is either in 'loaded' or ought to be.
+        if (o->isInBackgroundQueue()) continue;
+        if (o->requestPrefetch(new_pos)) {
+            o->setPrefetching(true);
+            prefetched.push_back(o);
+        }
+    }
 
-void streamer_centre (lua_State *L, const Vector3 &new_pos, bool everything)
+    // Prefetched objects that are no-longer ahead are either now in range, or we changed
+    // direction.
+    for (size_t i=0, i_=prefetched.size(); i<i_ ;) {
+        const GritObjectPtr &o = prefetched[i];
+        // Destroyed objects have already released their resources.
+        bool keep = o->getClass() != NULL;
+        if (keep && o->withinRange(new_pos, tpF)) {
+            // Now the responsibility of the normal mechanism, which will unload it later.
+            loaded.push_back(o);
+            keep = false;
+        } else if (keep && !o->withinRangeOfSegment(new_pos, lookahead, tpF)) {
+            o->tryUnloadResources();
+            keep = false;
+        }
+        if (keep) {
+            ++i;
+        } else {
+            o->setPrefetching(false);
+            prefetched[i] = prefetched[i_-1];
+            prefetched.pop_back();
+            --i_;
+        }
+    }
+}
+
+void streamer_centre (lua_State *L, const Vector3 &new_pos, const Vector3 &velocity,
+                      bool everything)
 {
+    FRAME_PROFILER_ZONE("streamer_centre");
     int step_size = everything ? INT_MAX : core_option(CORE_STEP_SIZE);
 
-    Space::Cargo fnd = fresh;
+    // Copied so that 'fresh' keeps its capacity from one frame to the next.
+    FrameVector<GritObjectPtr> fnd(fresh.begin(), fresh.end());
     fresh.clear();
 
     const float visibility = streamer_visibility;
@@ -68,23 +232,23 @@ void streamer_centre (lua_State *L, const Vector3 &new_pos, bool everything)
     const float tpF = pF * visibility; // prepare and visibility factors
     const float vis2 = visibility * visibility;
 
-    typedef GObjPtrs::iterator I;
-
     // iterate through, deactivating things
 
 
     ////////////////////////////////////////////////////////////////////////
     // DEACTIVATE DISTANT GRIT OBJECTS /////////////////////////////////////
     ////////////////////////////////////////////////////////////////////////
-    // use victims because deactivate() changes the 'activated' list
-    // and so does notifyRange2 if the callback raises an error
-    GObjPtrs victims = activated;
-    for (I i=victims.begin(), i_=victims.end() ; i!=i_ ; ++i) {
-        const GritObjectPtr &o = *i;
-         //note we use vis2 not visibility
-        float range2 = o->range2(new_pos) / vis2;
+    //note we use vis2 not visibility
+    activated.computeRange2(new_pos, vis2);
+    // Iterate backwards because deactivate() removes from the 'activated' list (and so does
+    // notifyRange2 if the callback raises an error), which moves the last object into the gap.
+    // Since that one has already been considered, nothing is skipped.  If a callback removes an
+    // earlier object, a considered one may be considered again, which is harmless.
+    for (size_t i=activated.size() ; i-- > 0 ; ) {
+        if (i >= activated.size()) continue;
+        GritObjectPtr o = activated.get(i);
+        float range2 = activated.getRange2(i);
         // sometimes deactivation of an object can cause the deletion of other objects
-        // if those objects are also in the victims list, this can become a problem
         // so just skip them
         if (o->getClass()==NULL) continue;
         o->notifyRange2(L, o, range2);
@@ -97,7 +261,6 @@ void streamer_centre (lua_State *L, const Vector3 &new_pos, bool everything)
         }
         if (range2 > 1) {
             // now out of range
-            const GritObjectPtr &o = *i;
             const GritObjectPtr &the_far = o->getFarObj();
             bool killme = o->deactivate(L, o);
             if (!the_far.isNull()) {
@@ -132,7 +295,18 @@ void streamer_centre (lua_State *L, const Vector3 &new_pos, bool everything)
     }
 
 
-    GObjPtrs must_kill;
+    ////////////////////////////////////////////////////////////////////////
+    // PREFETCH RESOURCES FOR GRIT OBJECTS AHEAD OF US /////////////////////
+    ////////////////////////////////////////////////////////////////////////
+    // When loading everything, everything in range will be loaded anyway.
+    Vector3 lookahead = new_pos;
+    if (!everything) {
+        float dist = std::min(streamer_lookahead_distance, velocity.length() * LOOKAHEAD_TIME);
+        if (dist > 0) lookahead = new_pos + velocity.normalisedCopy() * dist;
+    }
+    prefetch(new_pos, lookahead, tpF);
+
+    FrameVector<GritObjectPtr> must_kill;
 
     ////////////////////////////////////////////////////////////////////////
     // LOAD RESOURCES FOR APPROACHING GRIT OBJECTS /////////////////////////
@@ -141,7 +315,7 @@ void streamer_centre (lua_State *L, const Vector3 &new_pos, bool everything)
     // note: since fnd is prepopulated by new objects and the lods of deactivated objects
     // it may have duplicates after the rangespace has gone through
     rs.getPresent(new_pos.x, new_pos.y, new_pos.z, step_size, tpF, fnd);
-    for (Space::Cargo::iterator i=fnd.begin(), i_=fnd.end() ; i!=i_ ; ++i) {
+    for (auto i=fnd.begin(), i_=fnd.end() ; i!=i_ ; ++i) {
         const GritObjectPtr &o = *i;
 
         // this can happen if there is a duplicate in the list and it gets destroyed
@@ -209,7 +383,7 @@ void streamer_centre (lua_State *L, const Vector3 &new_pos, bool everything)
         skip:;
     }
 
-    for (GObjPtrs::iterator i=must_kill.begin(), i_=must_kill.end() ; i!=i_ ; ++i) {
+    for (auto i=must_kill.begin(), i_=must_kill.end() ; i!=i_ ; ++i) {
         CERR << "Object: \"" << (*i)->name << "\" raised an error while background loading "
              << "resources, so destroying it." << std::endl;
         object_del(L, *i);
@@ -230,10 +404,15 @@ void streamer_update_sphere (size_t index, const Vector3 &pos, float d)
     rs.updateSphere(index, pos.x, pos.y, pos.z, d);
 }
 
+void streamer_update_activated_sphere (int index, const Vector3 &pos, float d)
+{
+    activated.updateSphere(index, pos, d);
+}
+
 void streamer_object_activated (GObjPtrs::iterator &begin, GObjPtrs::iterator &end)
 {
-    begin = activated.begin();
-    end = activated.end();
+    begin = activated.getObjects().begin();
+    end = activated.getObjects().end();
 }
 
 int streamer_object_activated_count (void)
@@ -250,25 +429,18 @@ void streamer_list(const GritObjectPtr &o)
 void streamer_unlist(const GritObjectPtr &o)
 {
     rs.remove(o);
-    remove_if_exists(fresh, o);
+    // It may still be in 'fresh', but destroyed objects are skipped by streamer_centre, which
+    // clears 'fresh' every frame.
 }
 
 void streamer_list_as_activated (const GritObjectPtr &o)
 {
-    GObjPtrs::iterator begin = activated.begin(), end = activated.end();
-    GObjPtrs::iterator iter  = find(begin, end, o);
-    if (iter!=end) return;
-    activated.push_back(o);
+    activated.add(o);
 }
 
 void streamer_unlist_as_activated (const GritObjectPtr &o)
 {
-    GObjPtrs::iterator begin = activated.begin(), end = activated.end();
-    GObjPtrs::iterator iter  = find(begin, end, o);
-    if (iter==end) return;
-    size_t index = iter - begin;
-    activated[index] = activated[activated.size()-1];
-    activated.pop_back();
+    activated.remove(o);
 }
 
 
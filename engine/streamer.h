@@ -47,13 +47,21 @@ extern float streamer_fade_out_factor;
 /** Single var cache of CORE_FADE_OVERLAP_FACTOR. */
 extern float streamer_fade_overlap_factor;
 
+/** Single var cache of CORE_LOOKAHEAD_DISTANCE. */
+extern float streamer_lookahead_distance;
+
 /** Call before anything else.  Sets up internal state of the subsystem. */
 void streamer_init();
 
 /** Called frequently to action streaming.
  * \param L Lua state for calling object activation callbacks.
  * \param new_pos The player's position.
+ * \param velocity The player's velocity (metres per second), used to prefetch ahead.
  */
+void streamer_centre (lua_State *L, const Vector3 &new_pos, const Vector3 &velocity,
+                      bool everything);
+
+/** As above, but the velocity is estimated from the positions given in previous calls. */
 void streamer_centre (lua_State *L, const Vector3 &new_pos, bool everything);
 
 /** Called by objects when they change position or rendering distance.
@@ -62,6 +70,13 @@ void streamer_centre (lua_State *L, const Vector3 &new_pos, bool everything);
  * \param d The new rendering distance of the object.
  */
 void streamer_update_sphere (size_t index, const Vector3 &pos, float d);
+
+/** Called by activated objects when they change position or rendering distance.
+ * \param index The index of the object within the list of activated objects.
+ * \param pos The new position of the object.
+ * \param d The new rendering distance of the object.
+ */
+void streamer_update_activated_sphere (int index, const Vector3 &pos, float d);
         
 /** Add a new object to the 'map', i.e. set of objects considered for streaming in. */
 void streamer_list (const GritObjectPtr &o);
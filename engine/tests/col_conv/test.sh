@@ -0,0 +1,27 @@
+#!/bin/bash
+
+set -e
+
+make -C ../../.. grit_col_conv
+
+COL_CONV=../../../grit_col_conv
+TCOL=../engine/cast_sphere/test.gcol
+
+# The test mesh is a static trimesh, so it gets baked.  The baked bcol must read back as the same
+# mesh as the unbaked one.  Reading a bcol also checks that its baked sections lie within the file.
+test_round_trip() {
+    local TCOL="$1"
+    local NAME=$(basename "${TCOL}" .gcol)
+    ${COL_CONV} -B -i "${TCOL}" -o "${NAME}.bcol"
+    ${COL_CONV} -B -b -i "${TCOL}" -o "${NAME}.baked.bcol"
+    ${COL_CONV} -T -i "${NAME}.bcol" -o "${NAME}.out.tcol"
+    ${COL_CONV} -T -i "${NAME}.baked.bcol" -o "${NAME}.baked.out.tcol"
+    test "$(head -c 7 "${NAME}.bcol")" == "BCOL1.0"
+    test "$(head -c 7 "${NAME}.baked.bcol")" == "BCOL1.1"
+    if ! diff -u "${NAME}.out.tcol" "${NAME}.baked.out.tcol" ; then
+        echo "Baked bcol differs from unbaked: ${TCOL}"
+        exit 1
+    fi
+}
+
+test_round_trip ${TCOL}
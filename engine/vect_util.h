@@ -123,4 +123,102 @@ template<class T> class fast_erase_vector {
     std::vector<T> vect;
 };
 
+/** A binary heap with the smallest element (according to Less) at the top.  Like
+ * fast_erase_vector, the elements must have an _index member variable (or be pointers to such
+ * objects), which is kept up to date so that any element can be removed or moved to its new
+ * place after its key changed, in O(log n) time.
+ */
+template<class T, class Less> class fast_erase_heap {
+    public:
+
+    /** Add an object to the heap. */
+    void push (const T &v)
+    {
+        size_t i = vect.size();
+        vect.push_back(v);
+        maybe_deref<T>::_(vect[i])._index = i;
+        siftUp(i);
+    }
+
+    /** Remove an object from the heap. */
+    void erase (const T &v)
+    {
+        size_t index = maybe_deref<T>::_(v)._index;
+        vect_remove_fast(vect, index);
+        if (vect.size() == index) return; // v happened to be at the end
+        // vect[index] now contains something else, put it in the right place
+        maybe_deref<T>::_(vect[index])._index = index;
+        update(vect[index]);
+    }
+
+    /** Restore the heap property after the key of v has changed. */
+    void update (const T &v)
+    {
+        size_t index = maybe_deref<T>::_(v)._index;
+        siftUp(index);
+        siftDown(maybe_deref<T>::_(v)._index);
+    }
+
+    /** The smallest object. */
+    const T &top (void) const { return vect[0]; }
+
+    /** Remove and return the smallest object. */
+    T pop (void)
+    {
+        T v = vect[0];
+        erase(v);
+        return v;
+    }
+
+    /** Return the number of objects present. */
+    size_t size (void) const { return vect.size(); }
+
+    /** Remove all objects from the heap. */
+    void clear (void) { vect.clear(); }
+
+    /** Prepare the heap for holding the given number of objects. */
+    void reserve (size_t n) { vect.reserve(n); }
+
+    private:
+
+    bool less (size_t a, size_t b)
+    {
+        return Less()(maybe_deref<T>::_(vect[a]), maybe_deref<T>::_(vect[b]));
+    }
+
+    void swap (size_t a, size_t b)
+    {
+        T tmp = vect[a];
+        vect[a] = vect[b];
+        vect[b] = tmp;
+        maybe_deref<T>::_(vect[a])._index = a;
+        maybe_deref<T>::_(vect[b])._index = b;
+    }
+
+    void siftUp (size_t i)
+    {
+        while (i > 0) {
+            size_t parent = (i - 1) / 2;
+            if (!less(i, parent)) break;
+            swap(i, parent);
+            i = parent;
+        }
+    }
+
+    void siftDown (size_t i)
+    {
+        while (true) {
+            size_t smallest = i;
+            size_t l = 2 * i + 1, r = 2 * i + 2;
+            if (l < vect.size() && less(l, smallest)) smallest = l;
+            if (r < vect.size() && less(r, smallest)) smallest = r;
+            if (smallest == i) break;
+            swap(i, smallest);
+            i = smallest;
+        }
+    }
+
+    std::vector<T> vect;
+};
+
 #endif